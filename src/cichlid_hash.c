@@ -0,0 +1,133 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash.c
+ *
+ * Table of all available hash algorithms, giving access to them by name
+ * through a common interface.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "cichlid_hash.h"
+
+#include "cichlid_hash_adler32.h"
+#include "cichlid_hash_blake3.h"
+#include "cichlid_hash_crc32.h"
+#include "cichlid_hash_crc32c.h"
+#include "cichlid_hash_crc64_nvme.h"
+#include "cichlid_hash_crc64_xz.h"
+#include "cichlid_hash_md5.h"
+#include "cichlid_hash_sha224.h"
+#include "cichlid_hash_sha256.h"
+#include "cichlid_hash_sha384.h"
+#include "cichlid_hash_sha512.h"
+#include "cichlid_hash_sha512_224.h"
+#include "cichlid_hash_sha512_256.h"
+#include "cichlid_hash_xxh3_64.h"
+#include "cichlid_hash_xxh3_128.h"
+
+#include <stddef.h>
+#include <strings.h>
+
+/* Adapters from the typed functions of each algorithm to the common interface */
+#define ADAPTERS(prefix, type)                                                 \
+    static void prefix##_init(void *self)                                      \
+    {                                                                          \
+        cichlid_hash_##prefix##_init((type *)self);                            \
+    }                                                                          \
+    static void prefix##_update(void *self, const char *data, size_t size)     \
+    {                                                                          \
+        cichlid_hash_##prefix##_update((type *)self, data, size);              \
+    }                                                                          \
+    static char *prefix##_get_hash(void *self)                                 \
+    {                                                                          \
+        return cichlid_hash_##prefix##_get_hash((type *)self);                 \
+    }
+
+#define ZEROS_ADAPTER(prefix, type)                                             \
+    static void prefix##_update_zeros(void *self, uint64_t size)               \
+    {                                                                          \
+        cichlid_hash_##prefix##_update_zeros((type *)self, size);              \
+    }
+
+#define ENTRY(name, label, prefix, type) \
+    { name, label, sizeof(type), prefix##_init, prefix##_update, prefix##_get_hash, NULL, NULL }
+
+#define ZEROS_ENTRY(name, label, prefix, type)                                            \
+    { name, label, sizeof(type), prefix##_init, prefix##_update, prefix##_get_hash, NULL, \
+      prefix##_update_zeros }
+
+ADAPTERS(adler32, CichlidHashAdler32)
+ADAPTERS(crc32, CichlidHashCrc32)
+ADAPTERS(crc32c, CichlidHashCrc32c)
+ADAPTERS(crc64_xz, CichlidHashCrc64Xz)
+ADAPTERS(crc64_nvme, CichlidHashCrc64Nvme)
+ADAPTERS(md5, CichlidHashMd5)
+ADAPTERS(sha224, CichlidHashSha224)
+ADAPTERS(sha256, CichlidHashSha256)
+ADAPTERS(sha384, CichlidHashSha384)
+ADAPTERS(sha512, CichlidHashSha512)
+ADAPTERS(sha512_224, CichlidHashSha512_224)
+ADAPTERS(sha512_256, CichlidHashSha512_256)
+ADAPTERS(blake3, CichlidHashBlake3)
+ADAPTERS(xxh3_64, CichlidHashXxh3_64)
+ADAPTERS(xxh3_128, CichlidHashXxh3_128)
+
+ZEROS_ADAPTER(adler32, CichlidHashAdler32)
+ZEROS_ADAPTER(crc32, CichlidHashCrc32)
+ZEROS_ADAPTER(crc32c, CichlidHashCrc32c)
+ZEROS_ADAPTER(crc64_xz, CichlidHashCrc64Xz)
+ZEROS_ADAPTER(crc64_nvme, CichlidHashCrc64Nvme)
+
+static void blake3_set_threads(void *self, unsigned int n_threads)
+{
+    cichlid_hash_blake3_set_threads((CichlidHashBlake3 *)self, n_threads);
+}
+
+static const CichlidHashAlgorithm algorithms[] = {
+    ZEROS_ENTRY("adler32",    "ADLER32",    adler32,    CichlidHashAdler32),
+    ZEROS_ENTRY("crc32",      "CRC32",      crc32,      CichlidHashCrc32),
+    ZEROS_ENTRY("crc32c",     "CRC32C",     crc32c,     CichlidHashCrc32c),
+    ZEROS_ENTRY("crc64-xz",   "CRC64/XZ",   crc64_xz,   CichlidHashCrc64Xz),
+    ZEROS_ENTRY("crc64-nvme", "CRC64/NVME", crc64_nvme, CichlidHashCrc64Nvme),
+    ENTRY("md5",        "MD5",        md5,        CichlidHashMd5),
+    ENTRY("sha224",     "SHA224",     sha224,     CichlidHashSha224),
+    ENTRY("sha256",     "SHA256",     sha256,     CichlidHashSha256),
+    ENTRY("sha384",     "SHA384",     sha384,     CichlidHashSha384),
+    ENTRY("sha512",     "SHA512",     sha512,     CichlidHashSha512),
+    ENTRY("sha512-224", "SHA512/224", sha512_224, CichlidHashSha512_224),
+    ENTRY("sha512-256", "SHA512/256", sha512_256, CichlidHashSha512_256),
+    { "blake3", "BLAKE3", sizeof(CichlidHashBlake3), blake3_init, blake3_update, blake3_get_hash,
+      blake3_set_threads, NULL },
+    ENTRY("xxh3-64",    "XXH3-64",    xxh3_64,    CichlidHashXxh3_64),
+    ENTRY("xxh3-128",   "XXH3-128",   xxh3_128,   CichlidHashXxh3_128),
+};
+
+const CichlidHashAlgorithm *cichlid_hash_algorithm_find(const char *name)
+{
+    for (size_t i = 0; i < sizeof(algorithms) / sizeof(*algorithms); ++i) {
+        if (!strcasecmp(algorithms[i].name, name)) {
+            return &algorithms[i];
+        }
+    }
+    return NULL;
+}
+
+const CichlidHashAlgorithm *cichlid_hash_algorithm_get(size_t index)
+{
+    if (index >= sizeof(algorithms) / sizeof(*algorithms)) {
+        return NULL;
+    }
+    return &algorithms[index];
+}
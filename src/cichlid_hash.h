@@ -0,0 +1,56 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash.h
+ *
+ * Table of all available hash algorithms, giving access to them by name
+ * through a common interface.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CICHLID_HASH_H
+#define CICHLID_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct _CichlidHashAlgorithm CichlidHashAlgorithm;
+struct _CichlidHashAlgorithm
+{
+    const char *name;         /* Name used to select the algorithm */
+    const char *label;        /* Name used when printing the hash */
+    size_t      context_size; /* Size of the state struct */
+    void      (*init)(void *self);
+    void      (*update)(void *self, const char *data, size_t data_size);
+    char     *(*get_hash)(void *self);
+    /* Optional, for algorithms that can split large updates over threads */
+    void      (*set_threads)(void *self, unsigned int n_threads);
+    /* Optional, for algorithms that can account for a run of zero bytes
+     * without processing them */
+    void      (*update_zeros)(void *self, uint64_t size);
+};
+
+/*!
+ * Look up an algorithm by name, ignoring case.
+ * \returns The algorithm or NULL if there is none with that name
+ */
+const CichlidHashAlgorithm *cichlid_hash_algorithm_find(const char *name);
+/*!
+ * Iterate over all algorithms.
+ * \returns The algorithm at index or NULL if index is past the last one
+ */
+const CichlidHashAlgorithm *cichlid_hash_algorithm_get(size_t index);
+
+#endif /* CICHLID_HASH_H */
@@ -0,0 +1,245 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_adler32.c
+ *
+ * Adler-32 checksum as used by zlib (RFC 1950). Uses SSSE3 or AVX2 when
+ * available.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cichlid_hash_adler32.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ADLER32_X86_SIMD
+#include <immintrin.h>
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+/* Largest prime smaller than 2^16 */
+#define BASE (65521)
+/* Largest n such that 255n(n+1)/2 + (n+1)(BASE-1) fits in 32 bits, i.e. the
+ * number of bytes that can be summed before the modulo must be taken */
+#define NMAX (5552)
+
+typedef uint32_t (*UpdateFunc)(uint32_t adler, const uint8_t *data, size_t data_size);
+
+static uint32_t update_scalar(uint32_t adler, const uint8_t *data, size_t data_size)
+{
+    uint32_t s1 = adler & 0xFFFF;
+    uint32_t s2 = adler >> 16;
+
+    while (data_size > 0) {
+        size_t n = data_size < NMAX ? data_size : NMAX;
+        data_size -= n;
+        for (; n >= 8; n -= 8, data += 8) {
+            s1 += data[0]; s2 += s1;
+            s1 += data[1]; s2 += s1;
+            s1 += data[2]; s2 += s1;
+            s1 += data[3]; s2 += s1;
+            s1 += data[4]; s2 += s1;
+            s1 += data[5]; s2 += s1;
+            s1 += data[6]; s2 += s1;
+            s1 += data[7]; s2 += s1;
+        }
+        for (; n > 0; --n, ++data) {
+            s1 += *data;
+            s2 += s1;
+        }
+        s1 %= BASE;
+        s2 %= BASE;
+    }
+    return s1 | (s2 << 16);
+}
+
+#ifdef ADLER32_X86_SIMD
+
+/*
+ * The vectorized versions split the input into chunks of at most NMAX bytes
+ * and the chunks into blocks of 32 (SSSE3) or 64 (AVX2) bytes. Within a chunk
+ * s1 is the plain byte sum, while the contribution of each block to s2 is
+ * its position weighted byte sum (PMADDUBSW) plus the block length times the
+ * s1 accumulated by the preceding blocks. The latter are summed in v_ps and
+ * multiplied by the block length once per chunk, and the modulo is only
+ * taken at the end of each chunk.
+ */
+
+TARGET_SSSE3 static inline uint32_t hsum_epi32_128(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (uint32_t)_mm_cvtsi128_si32(v);
+}
+
+TARGET_SSSE3 static uint32_t update_ssse3(uint32_t adler, const uint8_t *data, size_t data_size)
+{
+    const size_t  block_size = 32;
+    const __m128i weights_hi = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+    const __m128i weights_lo = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t      s1 = adler & 0xFFFF;
+    uint32_t      s2 = adler >> 16;
+
+    while (data_size >= block_size) {
+        size_t  n = (data_size < NMAX ? data_size : NMAX) / block_size;
+        __m128i v_s1 = zero, v_s2 = zero, v_ps = zero;
+
+        s2 += s1 * (uint32_t)(n * block_size);
+        data_size -= n * block_size;
+        for (; n > 0; --n, data += block_size) {
+            __m128i bytes0 = _mm_loadu_si128((const __m128i *)(const void *)data);
+            __m128i bytes1 = _mm_loadu_si128((const __m128i *)(const void *)(data + 16));
+
+            v_ps = _mm_add_epi32(v_ps, v_s1);
+            v_s1 = _mm_add_epi32(v_s1, _mm_add_epi32(_mm_sad_epu8(bytes0, zero), _mm_sad_epu8(bytes1, zero)));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes0, weights_hi), ones));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes1, weights_lo), ones));
+        }
+        s1 += hsum_epi32_128(v_s1);
+        s2 += hsum_epi32_128(v_s2) + (uint32_t)block_size * hsum_epi32_128(v_ps);
+        s1 %= BASE;
+        s2 %= BASE;
+    }
+    return update_scalar(s1 | (s2 << 16), data, data_size);
+}
+
+TARGET_AVX2 static inline uint32_t hsum_epi32_256(__m256i v)
+{
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (uint32_t)_mm_cvtsi128_si32(sum);
+}
+
+TARGET_AVX2 static uint32_t update_avx2(uint32_t adler, const uint8_t *data, size_t data_size)
+{
+    const size_t  block_size = 64;
+    const __m256i weights_hi = _mm256_setr_epi8(64, 63, 62, 61, 60, 59, 58, 57, 56, 55, 54, 53, 52, 51, 50, 49,
+                                                48, 47, 46, 45, 44, 43, 42, 41, 40, 39, 38, 37, 36, 35, 34, 33);
+    const __m256i weights_lo = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+                                                16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i zero = _mm256_setzero_si256();
+    uint32_t      s1 = adler & 0xFFFF;
+    uint32_t      s2 = adler >> 16;
+
+    while (data_size >= block_size) {
+        size_t  n = (data_size < NMAX ? data_size : NMAX) / block_size;
+        __m256i v_s1 = zero, v_s2 = zero, v_ps = zero;
+
+        s2 += s1 * (uint32_t)(n * block_size);
+        data_size -= n * block_size;
+        for (; n > 0; --n, data += block_size) {
+            __m256i bytes0 = _mm256_loadu_si256((const __m256i *)(const void *)data);
+            __m256i bytes1 = _mm256_loadu_si256((const __m256i *)(const void *)(data + 32));
+
+            v_ps = _mm256_add_epi32(v_ps, v_s1);
+            v_s1 = _mm256_add_epi32(v_s1, _mm256_add_epi32(_mm256_sad_epu8(bytes0, zero),
+                                                           _mm256_sad_epu8(bytes1, zero)));
+            v_s2 = _mm256_add_epi32(v_s2, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes0, weights_hi), ones));
+            v_s2 = _mm256_add_epi32(v_s2, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes1, weights_lo), ones));
+        }
+        s1 += hsum_epi32_256(v_s1);
+        s2 += hsum_epi32_256(v_s2) + (uint32_t)block_size * hsum_epi32_256(v_ps);
+        s1 %= BASE;
+        s2 %= BASE;
+    }
+    return update_scalar(s1 | (s2 << 16), data, data_size);
+}
+
+#endif /* ADLER32_X86_SIMD */
+
+static UpdateFunc select_implementation(void)
+{
+#ifdef ADLER32_X86_SIMD
+    if (__builtin_cpu_supports("avx2")) {
+        return update_avx2;
+    } else if (__builtin_cpu_supports("ssse3")) {
+        return update_ssse3;
+    }
+#endif
+    return update_scalar;
+}
+
+void cichlid_hash_adler32_init(CichlidHashAdler32 *self)
+{
+    self->hash = 1;
+}
+
+void cichlid_hash_adler32_update(CichlidHashAdler32 *self, const char *data, size_t data_size)
+{
+    UpdateFunc update;
+
+    if (!data_size) {
+        return;
+    }
+
+    update = select_implementation();
+    self->hash = update(self->hash, (const uint8_t *)data, data_size);
+}
+
+void cichlid_hash_adler32_update_zeros(CichlidHashAdler32 *self, uint64_t size)
+{
+    uint32_t s1 = self->hash & 0xFFFF;
+    uint32_t s2 = self->hash >> 16;
+
+    /* Zeros leave s1 unchanged and add it to s2 once per byte */
+    s2 = (uint32_t)((s2 + (size % BASE) * s1) % BASE);
+    self->hash = (s2 << 16) | s1;
+}
+
+void cichlid_hash_adler32_combine(CichlidHashAdler32 *self, const CichlidHashAdler32 *next, uint64_t next_size)
+{
+    uint32_t rem = (uint32_t)(next_size % BASE);
+    uint32_t s1 = self->hash & 0xFFFF;
+    uint32_t s2 = (uint32_t)(((uint64_t)rem * s1) % BASE);
+
+    /* Shift the first range's s1 into s2 past next_size bytes and remove the
+     * initial 1 of the second checksum from both sums, adding BASE to keep
+     * them positive */
+    s1 += (next->hash & 0xFFFF) + BASE - 1;
+    s2 += (self->hash >> 16) + (next->hash >> 16) + BASE - rem;
+    if (s1 >= BASE) {
+        s1 -= BASE;
+    }
+    if (s1 >= BASE) {
+        s1 -= BASE;
+    }
+    if (s2 >= 2 * BASE) {
+        s2 -= 2 * BASE;
+    }
+    if (s2 >= BASE) {
+        s2 -= BASE;
+    }
+    self->hash = s1 | (s2 << 16);
+}
+
+char *cichlid_hash_adler32_get_hash(const CichlidHashAdler32 *self)
+{
+    char *hash_string;
+
+    hash_string = malloc(sizeof(char) * 9);
+    sprintf(hash_string, "%.8x", self->hash);
+
+    return hash_string;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_adler32.h
+ *
+ * Adler-32 checksum as used by zlib (RFC 1950). Uses SSSE3 or AVX2 when
+ * available.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CICHLID_HASH_ADLER32_H
+#define CICHLID_HASH_ADLER32_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct _CichlidHashAdler32 CichlidHashAdler32;
+struct _CichlidHashAdler32
+{
+    uint32_t hash;
+};
+
+void cichlid_hash_adler32_init(CichlidHashAdler32 *self);
+void cichlid_hash_adler32_update(CichlidHashAdler32 *self, const char *data, size_t data_size);
+char *cichlid_hash_adler32_get_hash(const CichlidHashAdler32 *self);
+/*!
+ * Update the checksum as if size zero bytes were hashed, in constant time.
+ * Used for holes in sparse files.
+ * \param self Checksum calculator instance
+ * \param size Number of zero bytes
+ */
+void cichlid_hash_adler32_update_zeros(CichlidHashAdler32 *self, uint64_t size);
+/*!
+ * Combine the checksums of two consecutive ranges hashed separately, so that
+ * self holds the checksum of both.
+ * \param self Checksum of the first range, is updated
+ * \param next Checksum of the range following it
+ * \param next_size Size of the second range in bytes
+ */
+void cichlid_hash_adler32_combine(CichlidHashAdler32 *self, const CichlidHashAdler32 *next, uint64_t next_size);
+
+#endif /* CICHLID_HASH_ADLER32_H */
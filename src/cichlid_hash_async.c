@@ -0,0 +1,356 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_async.c
+ *
+ * Asynchronous hashing on a pool of worker threads, for callers running an
+ * event loop. Finished jobs are reported through a completion queue and an
+ * eventfd that can be polled together with other file descriptors.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cichlid_hash_async.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+typedef enum
+{
+    JOB_UPDATE,
+    JOB_FINISH
+} JobType;
+
+struct CichlidHashAsyncJob_
+{
+    JobType                  type;
+    CichlidHashAsyncContext *context;
+    const char              *data;
+    size_t                   data_size;
+    char                    *hash;
+    void                    *user_data;
+    /* Next job of the context, then next in the completion queue */
+    CichlidHashAsyncJob     *next;
+};
+
+struct CichlidHashAsync_
+{
+    /* Contexts with jobs that no worker is running, guarded by lock */
+    pthread_mutex_t          lock;
+    pthread_cond_t           ready;
+    CichlidHashAsyncContext *first_ready;
+    CichlidHashAsyncContext *last_ready;
+    bool                     stopping;
+
+    /* Intrusive multi-producer single-consumer queue of completed jobs.
+     * Workers push at head, the poller pops at tail, stub keeps it non-empty. */
+    CichlidHashAsyncJob     *head;
+    CichlidHashAsyncJob     *tail;
+    CichlidHashAsyncJob      stub;
+
+    size_t                   n_pending;
+    size_t                   max_pending;
+    int                      event_fd;
+    unsigned int             n_threads;
+    pthread_t               *threads;
+};
+
+static void completion_push(CichlidHashAsync *self, CichlidHashAsyncJob *job)
+{
+    CichlidHashAsyncJob *prev;
+
+    __atomic_store_n(&job->next, NULL, __ATOMIC_RELAXED);
+    prev = __atomic_exchange_n(&self->head, job, __ATOMIC_ACQ_REL);
+    /* Until this store the job is invisible to the poller */
+    __atomic_store_n(&prev->next, job, __ATOMIC_RELEASE);
+}
+
+/*!
+ * \returns The oldest completed job, or NULL if there is none or the next one
+ *          is still being pushed
+ */
+static CichlidHashAsyncJob *completion_pop(CichlidHashAsync *self)
+{
+    CichlidHashAsyncJob *tail = self->tail;
+    CichlidHashAsyncJob *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    if (tail == &self->stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+        self->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+    if (next) {
+        self->tail = next;
+        return tail;
+    }
+    if (tail != __atomic_load_n(&self->head, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    /* tail is the last job, push the stub behind it so it can be unlinked */
+    completion_push(self, &self->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next) {
+        self->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+/* Must be called with the lock held */
+static void schedule(CichlidHashAsync *self, CichlidHashAsyncContext *context)
+{
+    context->scheduled = true;
+    context->next_ready = NULL;
+    if (self->last_ready) {
+        self->last_ready->next_ready = context;
+    } else {
+        self->first_ready = context;
+    }
+    self->last_ready = context;
+    pthread_cond_signal(&self->ready);
+}
+
+static void run_job(CichlidHashAsyncJob *job)
+{
+    CichlidHashAsyncContext *context = job->context;
+
+    if (job->type == JOB_UPDATE) {
+        context->algorithm->update(context->state, job->data, job->data_size);
+    } else {
+        job->hash = context->algorithm->get_hash(context->state);
+        context->algorithm->init(context->state);
+    }
+}
+
+/*!
+ * Run one job at a time from the contexts in the ready list. A context is
+ * taken off the list while its job runs, which keeps its jobs in order, and
+ * goes to the back of the list afterwards if it has more.
+ */
+static void *worker(void *arg)
+{
+    CichlidHashAsync *self = arg;
+    const uint64_t    one = 1;
+
+    pthread_mutex_lock(&self->lock);
+    for (;;) {
+        CichlidHashAsyncContext *context;
+        CichlidHashAsyncJob     *job;
+
+        while (self->first_ready == NULL && !self->stopping) {
+            pthread_cond_wait(&self->ready, &self->lock);
+        }
+        context = self->first_ready;
+        if (context == NULL) {
+            break;
+        }
+        self->first_ready = context->next_ready;
+        if (self->first_ready == NULL) {
+            self->last_ready = NULL;
+        }
+        job = context->first_job;
+        context->first_job = job->next;
+        if (context->first_job == NULL) {
+            context->last_job = NULL;
+        }
+        pthread_mutex_unlock(&self->lock);
+
+        run_job(job);
+
+        pthread_mutex_lock(&self->lock);
+        if (context->first_job) {
+            schedule(self, context);
+        } else {
+            context->scheduled = false;
+        }
+        /* Pushed before the lock lets another worker take the context, so the
+         * completions of a context are queued in order, and the context is
+         * not touched after its last completion is visible */
+        completion_push(self, job);
+        while (write(self->event_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+        }
+    }
+    pthread_mutex_unlock(&self->lock);
+    return NULL;
+}
+
+CichlidHashAsync *cichlid_hash_async_new(unsigned int n_threads, size_t max_pending)
+{
+    CichlidHashAsync *self = calloc(1, sizeof(*self));
+
+    if (self == NULL) {
+        return NULL;
+    }
+    self->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (self->event_fd < 0) {
+        free(self);
+        return NULL;
+    }
+    pthread_mutex_init(&self->lock, NULL);
+    pthread_cond_init(&self->ready, NULL);
+    self->head = &self->stub;
+    self->tail = &self->stub;
+    self->max_pending = max_pending ? max_pending : 1;
+    self->threads = malloc(sizeof(*self->threads) * (n_threads ? n_threads : 1));
+    if (self->threads == NULL) {
+        cichlid_hash_async_free(self);
+        return NULL;
+    }
+    for (unsigned int i = 0; i < (n_threads ? n_threads : 1); ++i) {
+        if (pthread_create(&self->threads[self->n_threads], NULL, worker, self) == 0) {
+            ++self->n_threads;
+        }
+    }
+    if (self->n_threads == 0) {
+        cichlid_hash_async_free(self);
+        return NULL;
+    }
+    return self;
+}
+
+void cichlid_hash_async_free(CichlidHashAsync *self)
+{
+    CichlidHashAsyncJob *job;
+
+    pthread_mutex_lock(&self->lock);
+    self->stopping = true;
+    pthread_cond_broadcast(&self->ready);
+    pthread_mutex_unlock(&self->lock);
+    for (unsigned int i = 0; i < self->n_threads; ++i) {
+        pthread_join(self->threads[i], NULL);
+    }
+
+    while ((job = completion_pop(self)) != NULL) {
+        free(job->hash);
+        free(job);
+    }
+    close(self->event_fd);
+    pthread_cond_destroy(&self->ready);
+    pthread_mutex_destroy(&self->lock);
+    free(self->threads);
+    free(self);
+}
+
+int cichlid_hash_async_get_fd(const CichlidHashAsync *self)
+{
+    return self->event_fd;
+}
+
+bool cichlid_hash_async_context_init(CichlidHashAsyncContext *context, const CichlidHashAlgorithm *algorithm)
+{
+    context->algorithm = algorithm;
+    context->state = malloc(algorithm->context_size);
+    if (context->state == NULL) {
+        return false;
+    }
+    algorithm->init(context->state);
+    context->first_job = NULL;
+    context->last_job = NULL;
+    context->scheduled = false;
+    context->next_ready = NULL;
+    return true;
+}
+
+void cichlid_hash_async_context_destroy(CichlidHashAsyncContext *context)
+{
+    free(context->state);
+    context->state = NULL;
+}
+
+static bool submit(CichlidHashAsync *self, CichlidHashAsyncContext *context, JobType type,
+                   const char *data, size_t data_size, void *user_data)
+{
+    CichlidHashAsyncJob *job;
+    size_t               n_pending = __atomic_load_n(&self->n_pending, __ATOMIC_RELAXED);
+
+    do {
+        if (n_pending >= self->max_pending) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&self->n_pending, &n_pending, n_pending + 1, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    job = malloc(sizeof(*job));
+    if (job == NULL) {
+        __atomic_fetch_sub(&self->n_pending, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    job->type = type;
+    job->context = context;
+    job->data = data;
+    job->data_size = data_size;
+    job->hash = NULL;
+    job->user_data = user_data;
+    job->next = NULL;
+
+    pthread_mutex_lock(&self->lock);
+    if (context->last_job) {
+        context->last_job->next = job;
+    } else {
+        context->first_job = job;
+    }
+    context->last_job = job;
+    if (!context->scheduled) {
+        schedule(self, context);
+    }
+    pthread_mutex_unlock(&self->lock);
+    return true;
+}
+
+bool cichlid_hash_async_update(CichlidHashAsync *self, CichlidHashAsyncContext *context,
+                               const char *data, size_t data_size, void *user_data)
+{
+    return submit(self, context, JOB_UPDATE, data, data_size, user_data);
+}
+
+bool cichlid_hash_async_finish(CichlidHashAsync *self, CichlidHashAsyncContext *context, void *user_data)
+{
+    return submit(self, context, JOB_FINISH, NULL, 0, user_data);
+}
+
+bool cichlid_hash_async_poll(CichlidHashAsync *self, CichlidHashAsyncCompletion *completion)
+{
+    CichlidHashAsyncJob *job = completion_pop(self);
+
+    if (job == NULL) {
+        uint64_t count;
+        /* Reset the eventfd before looking again. A job pushed after the
+         * first look either shows up now or writes the eventfd later. */
+        if (read(self->event_fd, &count, sizeof(count)) < 0) {
+            return false;
+        }
+        job = completion_pop(self);
+        if (job == NULL) {
+            return false;
+        }
+    }
+
+    completion->context = job->context;
+    completion->data = job->data;
+    completion->data_size = job->data_size;
+    completion->hash = job->hash;
+    completion->user_data = job->user_data;
+    free(job);
+    __atomic_fetch_sub(&self->n_pending, 1, __ATOMIC_RELAXED);
+    return true;
+}
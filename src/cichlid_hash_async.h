@@ -0,0 +1,124 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_async.h
+ *
+ * Asynchronous hashing on a pool of worker threads, for callers running an
+ * event loop. Finished jobs are reported through a completion queue and an
+ * eventfd that can be polled together with other file descriptors.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CICHLID_HASH_ASYNC_H
+#define CICHLID_HASH_ASYNC_H
+
+#include "cichlid_hash.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct CichlidHashAsync_ CichlidHashAsync;
+typedef struct CichlidHashAsyncJob_ CichlidHashAsyncJob;
+
+/*!
+ * A hash calculation whose updates run on the worker pool. Updates submitted
+ * for the same context are applied, and completed, in submission order.
+ */
+typedef struct CichlidHashAsyncContext_ CichlidHashAsyncContext;
+struct CichlidHashAsyncContext_
+{
+    const CichlidHashAlgorithm *algorithm;
+    void                       *state;
+    /* Owned by the pool */
+    CichlidHashAsyncJob        *first_job;
+    CichlidHashAsyncJob        *last_job;
+    bool                        scheduled;
+    CichlidHashAsyncContext    *next_ready;
+};
+
+typedef struct
+{
+    CichlidHashAsyncContext *context;
+    const char              *data;      /* Buffer of an update, may be reused now */
+    size_t                   data_size;
+    char                    *hash;      /* Result of a finish, NULL for updates, to be freed */
+    void                    *user_data;
+} CichlidHashAsyncCompletion;
+
+/*!
+ * Start a worker pool.
+ * \param n_threads Number of worker threads
+ * \param max_pending Maximum number of jobs submitted but not yet returned by
+ *                    cichlid_hash_async_poll, further submissions fail
+ * \returns The pool or NULL if it could not be started
+ */
+CichlidHashAsync *cichlid_hash_async_new(unsigned int n_threads, size_t max_pending);
+/*!
+ * Wait for all submitted jobs to run and stop the pool. Completions that were
+ * never polled are dropped.
+ * \param self Worker pool
+ */
+void cichlid_hash_async_free(CichlidHashAsync *self);
+/*!
+ * \returns An eventfd that becomes readable when completions are available.
+ *          It is reset by cichlid_hash_async_poll and must not be read
+ *          directly.
+ */
+int cichlid_hash_async_get_fd(const CichlidHashAsync *self);
+/*!
+ * Initialize an asynchronous hash calculation.
+ * \param context Context instance
+ * \param algorithm Algorithm to calculate
+ * \returns false if the context state could not be allocated
+ */
+bool cichlid_hash_async_context_init(CichlidHashAsyncContext *context, const CichlidHashAlgorithm *algorithm);
+/*!
+ * Free the resources held by a context, which must have no jobs in flight.
+ * \param context Context instance
+ */
+void cichlid_hash_async_context_destroy(CichlidHashAsyncContext *context);
+/*!
+ * Queue an update of a context. The data must stay valid until the job is
+ * completed.
+ * \param self Worker pool
+ * \param context Context to update
+ * \param data Pointer to data stream
+ * \param data_size Size of available data
+ * \param user_data Returned with the completion
+ * \returns false if max_pending jobs are already in flight or the job could
+ *          not be allocated
+ */
+bool cichlid_hash_async_update(CichlidHashAsync *self, CichlidHashAsyncContext *context,
+                               const char *data, size_t data_size, void *user_data);
+/*!
+ * Queue the retrieval of the hash of a context, after which the context is
+ * reinitialized for a new calculation. The hash is returned in the
+ * completion.
+ * \param self Worker pool
+ * \param context Context to finish
+ * \param user_data Returned with the completion
+ * \returns false if max_pending jobs are already in flight or the job could
+ *          not be allocated
+ */
+bool cichlid_hash_async_finish(CichlidHashAsync *self, CichlidHashAsyncContext *context, void *user_data);
+/*!
+ * Retrieve a completed job without blocking. Call until it returns false
+ * each time the eventfd becomes readable, from one thread at a time.
+ * \param self Worker pool
+ * \param completion Filled in with the completed job
+ * \returns false if no job has completed
+ */
+bool cichlid_hash_async_poll(CichlidHashAsync *self, CichlidHashAsyncCompletion *completion);
+
+#endif /* CICHLID_HASH_ASYNC_H */
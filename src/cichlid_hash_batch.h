@@ -0,0 +1,35 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_batch.h
+ *
+ * Description of messages hashed together by the one-shot batch functions.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CICHLID_HASH_BATCH_H
+#define CICHLID_HASH_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    const char *data;      /* Message */
+    size_t      data_size; /* Size of the message in bytes */
+    uint8_t    *digest;    /* Receives the raw digest */
+} CichlidHashBatchItem;
+
+#endif /* CICHLID_HASH_BATCH_H */
@@ -0,0 +1,911 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_blake3.c
+ *
+ * BLAKE3 hash (256-bit output) as defined in the BLAKE3 specification.
+ * Whole chunks are compressed several at a time using AVX2/AVX-512 when the
+ * CPU supports it, and large updates can optionally be split over a pool of
+ * threads shared by all calculators.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "cichlid_hash_blake3.h"
+
+#include <stdint.h>
+#include "cichlid_hash_common.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BLAKE3_X86_SIMD
+#include <immintrin.h>
+#define TARGET_AVX2   __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+#define BLOCK_LEN       CICHLID_HASH_BLAKE3_BLOCK_LEN
+#define CHUNK_LEN       CICHLID_HASH_BLAKE3_CHUNK_LEN
+#define OUT_LEN         CICHLID_HASH_BLAKE3_OUT_LEN
+#define MAX_SIMD_DEGREE (16)
+
+/* Subtrees smaller than this are not worth handing to another thread */
+#define MT_MIN_SUBTREE_SIZE (256 * 1024)
+
+enum {
+    CHUNK_START = 1 << 0,
+    CHUNK_END   = 1 << 1,
+    PARENT      = 1 << 2,
+    ROOT        = 1 << 3
+};
+
+typedef struct
+{
+    uint32_t input_cv[8];
+    uint64_t counter;
+    uint8_t  block[BLOCK_LEN];
+    uint8_t  block_len;
+    uint8_t  flags;
+} Output;
+
+typedef enum
+{
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE
+} JobState;
+
+typedef struct _SubtreeJob SubtreeJob;
+struct _SubtreeJob
+{
+    const uint8_t  *input;
+    size_t          input_len;
+    const uint32_t *key;
+    uint64_t        chunk_counter;
+    uint8_t         flags;
+    uint8_t        *out;
+    unsigned int    n_threads;
+    size_t          n_cvs;
+    JobState        state;
+    SubtreeJob     *next;
+};
+
+/* Workers are started as needed and then kept for the life of the process,
+ * so that large updates do not pay for creating threads */
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  work;
+    pthread_cond_t  done;
+    SubtreeJob     *queue;
+    unsigned int    n_workers;
+} pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0 };
+
+static const uint32_t iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const uint8_t msg_schedule[7][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+    {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+    {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+    {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+    {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+    {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+static inline uint32_t load32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void store32(uint8_t *p, uint32_t w)
+{
+    p[0] = (uint8_t)w;
+    p[1] = (uint8_t)(w >> 8);
+    p[2] = (uint8_t)(w >> 16);
+    p[3] = (uint8_t)(w >> 24);
+}
+
+static inline void store_cv(uint8_t out[OUT_LEN], const uint32_t cv[8])
+{
+    for (int i = 0; i < 8; ++i) {
+        store32(out + 4 * i, cv[i]);
+    }
+}
+
+static inline size_t round_down_to_power_of_2(uint64_t x)
+{
+    uint64_t p = 1;
+    while (p <= x / 2) {
+        p *= 2;
+    }
+    return (size_t)p;
+}
+
+static inline unsigned int popcount64(uint64_t x)
+{
+    unsigned int n = 0;
+    for (; x; x &= x - 1) {
+        ++n;
+    }
+    return n;
+}
+
+/*
+ * Portable compression function
+ */
+
+static inline void g(uint32_t *v, int a, int b, int c, int d, uint32_t x, uint32_t y)
+{
+    v[a] = v[a] + v[b] + x;
+    v[d] = cichlid_rotate_right_32(v[d] ^ v[a], 16);
+    v[c] = v[c] + v[d];
+    v[b] = cichlid_rotate_right_32(v[b] ^ v[c], 12);
+    v[a] = v[a] + v[b] + y;
+    v[d] = cichlid_rotate_right_32(v[d] ^ v[a], 8);
+    v[c] = v[c] + v[d];
+    v[b] = cichlid_rotate_right_32(v[b] ^ v[c], 7);
+}
+
+static void compress_pre(uint32_t v[16], const uint32_t cv[8], const uint8_t block[BLOCK_LEN],
+                         uint8_t block_len, uint64_t counter, uint8_t flags)
+{
+    uint32_t m[16];
+
+    for (int i = 0; i < 16; ++i) {
+        m[i] = load32(block + 4 * i);
+    }
+
+    memcpy(v, cv, sizeof(*v) * 8);
+    memcpy(v + 8, iv, sizeof(*v) * 4);
+    v[12] = (uint32_t)counter;
+    v[13] = (uint32_t)(counter >> 32);
+    v[14] = block_len;
+    v[15] = flags;
+
+    for (int r = 0; r < 7; ++r) {
+        const uint8_t *s = msg_schedule[r];
+        g(v, 0, 4,  8, 12, m[s[0]],  m[s[1]]);
+        g(v, 1, 5,  9, 13, m[s[2]],  m[s[3]]);
+        g(v, 2, 6, 10, 14, m[s[4]],  m[s[5]]);
+        g(v, 3, 7, 11, 15, m[s[6]],  m[s[7]]);
+        g(v, 0, 5, 10, 15, m[s[8]],  m[s[9]]);
+        g(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+        g(v, 2, 7,  8, 13, m[s[12]], m[s[13]]);
+        g(v, 3, 4,  9, 14, m[s[14]], m[s[15]]);
+    }
+}
+
+static void compress_in_place(uint32_t cv[8], const uint8_t block[BLOCK_LEN],
+                              uint8_t block_len, uint64_t counter, uint8_t flags)
+{
+    uint32_t v[16];
+
+    compress_pre(v, cv, block, block_len, counter, flags);
+    for (int i = 0; i < 8; ++i) {
+        cv[i] = v[i] ^ v[i + 8];
+    }
+}
+
+/*!
+ * Hash n_inputs equally sized inputs placed stride bytes apart, each
+ * consisting of blocks whole blocks, and store one chaining value per
+ * input in out.
+ */
+static void hash_many_portable(const uint8_t *input, size_t stride, size_t n_inputs, size_t blocks,
+                               const uint32_t key[8], uint64_t counter, bool increment_counter,
+                               uint8_t flags, uint8_t flags_start, uint8_t flags_end, uint8_t *out)
+{
+    for (size_t i = 0; i < n_inputs; ++i) {
+        const uint8_t *block = input + i * stride;
+        uint8_t block_flags = (uint8_t)(flags | flags_start);
+        uint32_t cv[8];
+
+        memcpy(cv, key, sizeof(cv));
+        for (size_t b = 0; b < blocks; ++b) {
+            if (b + 1 == blocks) {
+                block_flags |= flags_end;
+            }
+            compress_in_place(cv, block, BLOCK_LEN, counter, block_flags);
+            block += BLOCK_LEN;
+            block_flags = flags;
+        }
+        store_cv(out + i * OUT_LEN, cv);
+        if (increment_counter) {
+            ++counter;
+        }
+    }
+}
+
+#ifdef BLAKE3_X86_SIMD
+
+/*
+ * AVX2, eight inputs per call. Lane i of every vector belongs to input i,
+ * the message words are gathered straight from the strided inputs.
+ */
+
+TARGET_AVX2 static inline __m256i rot16_avx2(__m256i x)
+{
+    return _mm256_or_si256(_mm256_srli_epi32(x, 16), _mm256_slli_epi32(x, 16));
+}
+
+TARGET_AVX2 static inline __m256i rot12_avx2(__m256i x)
+{
+    return _mm256_or_si256(_mm256_srli_epi32(x, 12), _mm256_slli_epi32(x, 20));
+}
+
+TARGET_AVX2 static inline __m256i rot8_avx2(__m256i x)
+{
+    return _mm256_or_si256(_mm256_srli_epi32(x, 8), _mm256_slli_epi32(x, 24));
+}
+
+TARGET_AVX2 static inline __m256i rot7_avx2(__m256i x)
+{
+    return _mm256_or_si256(_mm256_srli_epi32(x, 7), _mm256_slli_epi32(x, 25));
+}
+
+TARGET_AVX2 static inline void g_avx2(__m256i *v, int a, int b, int c, int d, __m256i x, __m256i y)
+{
+    v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), x);
+    v[d] = rot16_avx2(_mm256_xor_si256(v[d], v[a]));
+    v[c] = _mm256_add_epi32(v[c], v[d]);
+    v[b] = rot12_avx2(_mm256_xor_si256(v[b], v[c]));
+    v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), y);
+    v[d] = rot8_avx2(_mm256_xor_si256(v[d], v[a]));
+    v[c] = _mm256_add_epi32(v[c], v[d]);
+    v[b] = rot7_avx2(_mm256_xor_si256(v[b], v[c]));
+}
+
+TARGET_AVX2 static void hash8_avx2(const uint8_t *input, size_t stride, size_t blocks,
+                                   const uint32_t key[8], uint64_t counter, bool increment_counter,
+                                   uint8_t flags, uint8_t flags_start, uint8_t flags_end, uint8_t *out)
+{
+    __m256i  h[8], v[16], m[16];
+    uint32_t lanes[8][8];
+    uint32_t counter_low[8], counter_high[8];
+    uint8_t  block_flags = (uint8_t)(flags | flags_start);
+    const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                               _mm256_set1_epi32((int)stride));
+
+    for (int i = 0; i < 8; ++i) {
+        uint64_t c = counter + (increment_counter ? (uint64_t)i : 0);
+        counter_low[i] = (uint32_t)c;
+        counter_high[i] = (uint32_t)(c >> 32);
+        h[i] = _mm256_set1_epi32((int)key[i]);
+    }
+
+    for (size_t b = 0; b < blocks; ++b) {
+        const uint8_t *block = input + b * BLOCK_LEN;
+
+        if (b + 1 == blocks) {
+            block_flags |= flags_end;
+        }
+        for (int w = 0; w < 16; ++w) {
+            m[w] = _mm256_i32gather_epi32((const int *)(const void *)(block + 4 * w), offsets, 1);
+        }
+        for (int i = 0; i < 8; ++i) {
+            v[i] = h[i];
+        }
+        for (int i = 0; i < 4; ++i) {
+            v[8 + i] = _mm256_set1_epi32((int)iv[i]);
+        }
+        v[12] = _mm256_loadu_si256((const __m256i *)(const void *)counter_low);
+        v[13] = _mm256_loadu_si256((const __m256i *)(const void *)counter_high);
+        v[14] = _mm256_set1_epi32(BLOCK_LEN);
+        v[15] = _mm256_set1_epi32(block_flags);
+
+        for (int r = 0; r < 7; ++r) {
+            const uint8_t *s = msg_schedule[r];
+            g_avx2(v, 0, 4,  8, 12, m[s[0]],  m[s[1]]);
+            g_avx2(v, 1, 5,  9, 13, m[s[2]],  m[s[3]]);
+            g_avx2(v, 2, 6, 10, 14, m[s[4]],  m[s[5]]);
+            g_avx2(v, 3, 7, 11, 15, m[s[6]],  m[s[7]]);
+            g_avx2(v, 0, 5, 10, 15, m[s[8]],  m[s[9]]);
+            g_avx2(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+            g_avx2(v, 2, 7,  8, 13, m[s[12]], m[s[13]]);
+            g_avx2(v, 3, 4,  9, 14, m[s[14]], m[s[15]]);
+        }
+        for (int i = 0; i < 8; ++i) {
+            h[i] = _mm256_xor_si256(v[i], v[i + 8]);
+        }
+        block_flags = flags;
+    }
+
+    for (int i = 0; i < 8; ++i) {
+        _mm256_storeu_si256((__m256i *)(void *)lanes[i], h[i]);
+    }
+    for (int lane = 0; lane < 8; ++lane) {
+        for (int i = 0; i < 8; ++i) {
+            store32(out + lane * OUT_LEN + 4 * i, lanes[i][lane]);
+        }
+    }
+}
+
+/*
+ * AVX-512, sixteen inputs per call, otherwise identical to the AVX2 version.
+ * The gather intrinsic is a macro with a signed mask cast when GCC does not
+ * optimize, which would trip -Wsign-conversion.
+ */
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+
+TARGET_AVX512 static inline void g_avx512(__m512i *v, int a, int b, int c, int d, __m512i x, __m512i y)
+{
+    v[a] = _mm512_add_epi32(_mm512_add_epi32(v[a], v[b]), x);
+    v[d] = _mm512_ror_epi32(_mm512_xor_si512(v[d], v[a]), 16);
+    v[c] = _mm512_add_epi32(v[c], v[d]);
+    v[b] = _mm512_ror_epi32(_mm512_xor_si512(v[b], v[c]), 12);
+    v[a] = _mm512_add_epi32(_mm512_add_epi32(v[a], v[b]), y);
+    v[d] = _mm512_ror_epi32(_mm512_xor_si512(v[d], v[a]), 8);
+    v[c] = _mm512_add_epi32(v[c], v[d]);
+    v[b] = _mm512_ror_epi32(_mm512_xor_si512(v[b], v[c]), 7);
+}
+
+TARGET_AVX512 static void hash16_avx512(const uint8_t *input, size_t stride, size_t blocks,
+                                        const uint32_t key[8], uint64_t counter, bool increment_counter,
+                                        uint8_t flags, uint8_t flags_start, uint8_t flags_end, uint8_t *out)
+{
+    __m512i  h[8], v[16], m[16];
+    uint32_t lanes[8][16];
+    uint32_t counter_low[16], counter_high[16];
+    uint8_t  block_flags = (uint8_t)(flags | flags_start);
+    const __m512i offsets = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+                                                                 8, 9, 10, 11, 12, 13, 14, 15),
+                                               _mm512_set1_epi32((int)stride));
+
+    for (int i = 0; i < 16; ++i) {
+        uint64_t c = counter + (increment_counter ? (uint64_t)i : 0);
+        counter_low[i] = (uint32_t)c;
+        counter_high[i] = (uint32_t)(c >> 32);
+    }
+    for (int i = 0; i < 8; ++i) {
+        h[i] = _mm512_set1_epi32((int)key[i]);
+    }
+
+    for (size_t b = 0; b < blocks; ++b) {
+        const uint8_t *block = input + b * BLOCK_LEN;
+
+        if (b + 1 == blocks) {
+            block_flags |= flags_end;
+        }
+        for (int w = 0; w < 16; ++w) {
+            m[w] = _mm512_i32gather_epi32(offsets, (const void *)(block + 4 * w), 1);
+        }
+        for (int i = 0; i < 8; ++i) {
+            v[i] = h[i];
+        }
+        for (int i = 0; i < 4; ++i) {
+            v[8 + i] = _mm512_set1_epi32((int)iv[i]);
+        }
+        v[12] = _mm512_loadu_si512((const void *)counter_low);
+        v[13] = _mm512_loadu_si512((const void *)counter_high);
+        v[14] = _mm512_set1_epi32(BLOCK_LEN);
+        v[15] = _mm512_set1_epi32(block_flags);
+
+        for (int r = 0; r < 7; ++r) {
+            const uint8_t *s = msg_schedule[r];
+            g_avx512(v, 0, 4,  8, 12, m[s[0]],  m[s[1]]);
+            g_avx512(v, 1, 5,  9, 13, m[s[2]],  m[s[3]]);
+            g_avx512(v, 2, 6, 10, 14, m[s[4]],  m[s[5]]);
+            g_avx512(v, 3, 7, 11, 15, m[s[6]],  m[s[7]]);
+            g_avx512(v, 0, 5, 10, 15, m[s[8]],  m[s[9]]);
+            g_avx512(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+            g_avx512(v, 2, 7,  8, 13, m[s[12]], m[s[13]]);
+            g_avx512(v, 3, 4,  9, 14, m[s[14]], m[s[15]]);
+        }
+        for (int i = 0; i < 8; ++i) {
+            h[i] = _mm512_xor_si512(v[i], v[i + 8]);
+        }
+        block_flags = flags;
+    }
+
+    for (int i = 0; i < 8; ++i) {
+        _mm512_storeu_si512((void *)lanes[i], h[i]);
+    }
+    for (int lane = 0; lane < 16; ++lane) {
+        for (int i = 0; i < 8; ++i) {
+            store32(out + lane * OUT_LEN + 4 * i, lanes[i][lane]);
+        }
+    }
+}
+
+#pragma GCC diagnostic pop
+
+#endif /* BLAKE3_X86_SIMD */
+
+static size_t simd_degree(void)
+{
+#ifdef BLAKE3_X86_SIMD
+    if (__builtin_cpu_supports("avx512f")) {
+        return 16;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return 8;
+    }
+#endif
+    return 1;
+}
+
+static void hash_many(const uint8_t *input, size_t stride, size_t n_inputs, size_t blocks,
+                      const uint32_t key[8], uint64_t counter, bool increment_counter,
+                      uint8_t flags, uint8_t flags_start, uint8_t flags_end, uint8_t *out)
+{
+#ifdef BLAKE3_X86_SIMD
+    if (__builtin_cpu_supports("avx512f")) {
+        for (; n_inputs >= 16; n_inputs -= 16) {
+            hash16_avx512(input, stride, blocks, key, counter, increment_counter,
+                          flags, flags_start, flags_end, out);
+            input += 16 * stride;
+            out += 16 * OUT_LEN;
+            counter += increment_counter ? 16 : 0;
+        }
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        for (; n_inputs >= 8; n_inputs -= 8) {
+            hash8_avx2(input, stride, blocks, key, counter, increment_counter,
+                       flags, flags_start, flags_end, out);
+            input += 8 * stride;
+            out += 8 * OUT_LEN;
+            counter += increment_counter ? 8 : 0;
+        }
+    }
+#endif
+    hash_many_portable(input, stride, n_inputs, blocks, key, counter, increment_counter,
+                       flags, flags_start, flags_end, out);
+}
+
+/*
+ * Chunk state
+ */
+
+static void chunk_init(CichlidHashBlake3Chunk *chunk, const uint32_t key[8], uint64_t chunk_counter, uint8_t flags)
+{
+    memcpy(chunk->cv, key, sizeof(chunk->cv));
+    chunk->chunk_counter = chunk_counter;
+    memset(chunk->buf, 0, sizeof(chunk->buf));
+    chunk->buf_len = 0;
+    chunk->blocks_compressed = 0;
+    chunk->flags = flags;
+}
+
+static inline size_t chunk_len(const CichlidHashBlake3Chunk *chunk)
+{
+    return BLOCK_LEN * (size_t)chunk->blocks_compressed + chunk->buf_len;
+}
+
+static inline uint8_t chunk_start_flag(const CichlidHashBlake3Chunk *chunk)
+{
+    return chunk->blocks_compressed == 0 ? CHUNK_START : 0;
+}
+
+static void chunk_update(CichlidHashBlake3Chunk *chunk, const uint8_t *data, size_t data_size)
+{
+    /* The last block is always kept buffered since it needs the CHUNK_END flag */
+    if (chunk->buf_len > 0) {
+        size_t take = BLOCK_LEN - chunk->buf_len;
+        if (take > data_size) {
+            take = data_size;
+        }
+        memcpy(chunk->buf + chunk->buf_len, data, take);
+        chunk->buf_len = (uint8_t)(chunk->buf_len + take);
+        data += take;
+        data_size -= take;
+        if (data_size > 0) {
+            compress_in_place(chunk->cv, chunk->buf, BLOCK_LEN, chunk->chunk_counter,
+                              (uint8_t)(chunk->flags | chunk_start_flag(chunk)));
+            ++chunk->blocks_compressed;
+            chunk->buf_len = 0;
+            memset(chunk->buf, 0, sizeof(chunk->buf));
+        }
+    }
+
+    while (data_size > BLOCK_LEN) {
+        compress_in_place(chunk->cv, data, BLOCK_LEN, chunk->chunk_counter,
+                          (uint8_t)(chunk->flags | chunk_start_flag(chunk)));
+        ++chunk->blocks_compressed;
+        data += BLOCK_LEN;
+        data_size -= BLOCK_LEN;
+    }
+
+    memcpy(chunk->buf + chunk->buf_len, data, data_size);
+    chunk->buf_len = (uint8_t)(chunk->buf_len + data_size);
+}
+
+static Output chunk_output(const CichlidHashBlake3Chunk *chunk)
+{
+    Output output;
+
+    memcpy(output.input_cv, chunk->cv, sizeof(output.input_cv));
+    memcpy(output.block, chunk->buf, BLOCK_LEN);
+    output.block_len = chunk->buf_len;
+    output.counter = chunk->chunk_counter;
+    output.flags = (uint8_t)(chunk->flags | chunk_start_flag(chunk) | CHUNK_END);
+    return output;
+}
+
+static Output parent_output(const uint8_t block[BLOCK_LEN], const uint32_t key[8], uint8_t flags)
+{
+    Output output;
+
+    memcpy(output.input_cv, key, sizeof(output.input_cv));
+    memcpy(output.block, block, BLOCK_LEN);
+    output.block_len = BLOCK_LEN;
+    output.counter = 0;
+    output.flags = (uint8_t)(flags | PARENT);
+    return output;
+}
+
+static void output_chaining_value(const Output *output, uint8_t cv[OUT_LEN])
+{
+    uint32_t cv_words[8];
+
+    memcpy(cv_words, output->input_cv, sizeof(cv_words));
+    compress_in_place(cv_words, output->block, output->block_len, output->counter, output->flags);
+    store_cv(cv, cv_words);
+}
+
+/*
+ * Tree hashing of whole subtrees
+ */
+
+static size_t compress_chunks_parallel(const uint8_t *input, size_t input_len, const uint32_t key[8],
+                                       uint64_t chunk_counter, uint8_t flags, uint8_t *out)
+{
+    size_t n_chunks = input_len / CHUNK_LEN;
+
+    hash_many(input, CHUNK_LEN, n_chunks, CHUNK_LEN / BLOCK_LEN, key, chunk_counter, true,
+              flags, CHUNK_START, CHUNK_END, out);
+
+    /* Hash the remaining partial chunk, if there is one */
+    if (input_len > n_chunks * CHUNK_LEN) {
+        CichlidHashBlake3Chunk chunk;
+        Output output;
+
+        chunk_init(&chunk, key, chunk_counter + n_chunks, flags);
+        chunk_update(&chunk, input + n_chunks * CHUNK_LEN, input_len - n_chunks * CHUNK_LEN);
+        output = chunk_output(&chunk);
+        output_chaining_value(&output, out + n_chunks * OUT_LEN);
+        return n_chunks + 1;
+    }
+    return n_chunks;
+}
+
+static size_t compress_parents_parallel(const uint8_t *child_cvs, size_t n_cvs, const uint32_t key[8],
+                                        uint8_t flags, uint8_t *out)
+{
+    size_t n_parents = n_cvs / 2;
+
+    hash_many(child_cvs, BLOCK_LEN, n_parents, 1, key, 0, false, (uint8_t)(flags | PARENT), 0, 0, out);
+
+    /* An odd child is passed up unchanged */
+    if (n_cvs > 2 * n_parents) {
+        memcpy(out + n_parents * OUT_LEN, child_cvs + 2 * n_parents * OUT_LEN, OUT_LEN);
+        return n_parents + 1;
+    }
+    return n_parents;
+}
+
+static size_t compress_subtree_wide(const uint8_t *input, size_t input_len, const uint32_t key[8],
+                                    uint64_t chunk_counter, uint8_t flags, uint8_t *out,
+                                    unsigned int n_threads);
+
+static void subtree_job_run(SubtreeJob *job)
+{
+    job->n_cvs = compress_subtree_wide(job->input, job->input_len, job->key, job->chunk_counter,
+                                       job->flags, job->out, job->n_threads);
+}
+
+static void *pool_worker(void *data)
+{
+    (void)data;
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        SubtreeJob *job;
+
+        while (pool.queue == NULL) {
+            pthread_cond_wait(&pool.work, &pool.lock);
+        }
+        job = pool.queue;
+        pool.queue = job->next;
+        job->state = JOB_RUNNING;
+        pthread_mutex_unlock(&pool.lock);
+
+        subtree_job_run(job);
+
+        pthread_mutex_lock(&pool.lock);
+        job->state = JOB_DONE;
+        pthread_cond_broadcast(&pool.done);
+    }
+    return NULL;
+}
+
+/*!
+ * Queue a job for the pool, starting workers until there are n_workers.
+ */
+static void pool_submit(SubtreeJob *job, unsigned int n_workers)
+{
+    pthread_mutex_lock(&pool.lock);
+    while (pool.n_workers < n_workers) {
+        pthread_t      thread;
+        pthread_attr_t attr;
+        bool           started;
+
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        started = pthread_create(&thread, &attr, pool_worker, NULL) == 0;
+        pthread_attr_destroy(&attr);
+        if (!started) {
+            /* The job is still run, by the submitter if need be */
+            break;
+        }
+        ++pool.n_workers;
+    }
+    job->state = JOB_QUEUED;
+    job->next = pool.queue;
+    pool.queue = job;
+    pthread_cond_signal(&pool.work);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/*!
+ * Wait for a submitted job, running it in this thread if no worker has taken
+ * it yet. Workers may be busy with jobs that wait in turn.
+ */
+static void pool_wait(SubtreeJob *job)
+{
+    pthread_mutex_lock(&pool.lock);
+    if (job->state == JOB_QUEUED) {
+        SubtreeJob **link = &pool.queue;
+
+        while (*link != job) {
+            link = &(*link)->next;
+        }
+        *link = job->next;
+        pthread_mutex_unlock(&pool.lock);
+        subtree_job_run(job);
+        return;
+    }
+    while (job->state != JOB_DONE) {
+        pthread_cond_wait(&pool.done, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/*!
+ * Compress a subtree of whole chunks (possibly with a partial chunk at the
+ * end) down to at most simd_degree chaining values, which are stored in out.
+ * \returns The number of chaining values written to out
+ */
+static size_t compress_subtree_wide(const uint8_t *input, size_t input_len, const uint32_t key[8],
+                                    uint64_t chunk_counter, uint8_t flags, uint8_t *out,
+                                    unsigned int n_threads)
+{
+    uint8_t  cv_array[2 * MAX_SIMD_DEGREE * OUT_LEN];
+    size_t   degree = simd_degree();
+    size_t   left_len, right_len, left_n, right_n;
+    uint8_t *right_cvs;
+
+    if (input_len <= degree * CHUNK_LEN) {
+        return compress_chunks_parallel(input, input_len, key, chunk_counter, flags, out);
+    }
+
+    /* The left subtree is the largest power of two of whole chunks that leaves
+     * at least one byte for the right subtree */
+    left_len = round_down_to_power_of_2((input_len - 1) / CHUNK_LEN) * CHUNK_LEN;
+    right_len = input_len - left_len;
+    if (left_len > CHUNK_LEN && degree == 1) {
+        /* Make sure there are always at least two chaining values to return */
+        degree = 2;
+    }
+    right_cvs = cv_array + degree * OUT_LEN;
+
+    if (n_threads > 1 && right_len >= MT_MIN_SUBTREE_SIZE) {
+        /* The left half goes to the pool, the calling thread is one of the
+         * n_threads */
+        SubtreeJob job = { input, left_len, key, chunk_counter, flags, cv_array, n_threads / 2, 0, JOB_QUEUED,
+                           NULL };
+
+        pool_submit(&job, n_threads - 1);
+        right_n = compress_subtree_wide(input + left_len, right_len, key,
+                                        chunk_counter + left_len / CHUNK_LEN, flags, right_cvs,
+                                        n_threads - n_threads / 2);
+        pool_wait(&job);
+        left_n = job.n_cvs;
+    } else {
+        left_n = compress_subtree_wide(input, left_len, key, chunk_counter, flags, cv_array, n_threads);
+        right_n = compress_subtree_wide(input + left_len, right_len, key,
+                                        chunk_counter + left_len / CHUNK_LEN, flags, right_cvs, n_threads);
+    }
+
+    /* With a single chaining value on the left the right side has one as well,
+     * the caller will combine them */
+    if (left_n == 1) {
+        memcpy(out, cv_array, 2 * OUT_LEN);
+        return 2;
+    }
+
+    return compress_parents_parallel(cv_array, left_n + right_n, key, flags, out);
+}
+
+/*!
+ * Compress a subtree of more than one chunk down to the two chaining values
+ * that form its parent node.
+ */
+static void compress_subtree_to_parent_node(const uint8_t *input, size_t input_len, const uint32_t key[8],
+                                            uint64_t chunk_counter, uint8_t flags, uint8_t out[2 * OUT_LEN],
+                                            unsigned int n_threads)
+{
+    uint8_t cv_array[MAX_SIMD_DEGREE * OUT_LEN];
+    uint8_t out_array[MAX_SIMD_DEGREE * OUT_LEN / 2];
+    size_t  n_cvs;
+
+    n_cvs = compress_subtree_wide(input, input_len, key, chunk_counter, flags, cv_array, n_threads);
+    while (n_cvs > 2) {
+        n_cvs = compress_parents_parallel(cv_array, n_cvs, key, flags, out_array);
+        memcpy(cv_array, out_array, n_cvs * OUT_LEN);
+    }
+    memcpy(out, cv_array, 2 * OUT_LEN);
+}
+
+/*
+ * Chaining value stack
+ */
+
+static void merge_cv_stack(CichlidHashBlake3 *self, uint64_t total_len)
+{
+    /* Merging is deferred until more input arrives, since the last chaining
+     * value on the stack may have to be finalized as the root */
+    size_t post_merge_stack_len = popcount64(total_len);
+
+    while (self->cv_stack_len > post_merge_stack_len) {
+        uint8_t *parent_node = self->cv_stack + (self->cv_stack_len - 2) * OUT_LEN;
+        Output output = parent_output(parent_node, self->key, self->chunk.flags);
+        output_chaining_value(&output, parent_node);
+        --self->cv_stack_len;
+    }
+}
+
+static void push_cv(CichlidHashBlake3 *self, const uint8_t new_cv[OUT_LEN], uint64_t chunk_counter)
+{
+    merge_cv_stack(self, chunk_counter);
+    memcpy(self->cv_stack + self->cv_stack_len * OUT_LEN, new_cv, OUT_LEN);
+    ++self->cv_stack_len;
+}
+
+void cichlid_hash_blake3_init(CichlidHashBlake3 *self)
+{
+    memcpy(self->key, iv, sizeof(self->key));
+    chunk_init(&self->chunk, self->key, 0, 0);
+    self->cv_stack_len = 0;
+    self->n_threads = 1;
+}
+
+void cichlid_hash_blake3_set_threads(CichlidHashBlake3 *self, unsigned int n_threads)
+{
+    self->n_threads = n_threads > 0 ? n_threads : 1;
+}
+
+void cichlid_hash_blake3_update(CichlidHashBlake3 *self, const char *data, size_t data_size)
+{
+    const uint8_t *input = (const uint8_t *)data;
+
+    if (!data_size) {
+        return;
+    }
+
+    /* Finish a partial chunk from the previous update first */
+    if (chunk_len(&self->chunk) > 0) {
+        size_t take = CHUNK_LEN - chunk_len(&self->chunk);
+        if (take > data_size) {
+            take = data_size;
+        }
+        chunk_update(&self->chunk, input, take);
+        input += take;
+        data_size -= take;
+        if (!data_size) {
+            return;
+        }
+
+        uint8_t chunk_cv[OUT_LEN];
+        Output output = chunk_output(&self->chunk);
+        output_chaining_value(&output, chunk_cv);
+        push_cv(self, chunk_cv, self->chunk.chunk_counter);
+        chunk_init(&self->chunk, self->key, self->chunk.chunk_counter + 1, self->chunk.flags);
+    }
+
+    /* Hash as large power-of-two subtrees as possible while keeping them
+     * aligned to the chunk counter. Anything that may be the final chunk is
+     * left in the chunk state. */
+    while (data_size > CHUNK_LEN) {
+        size_t   subtree_len = round_down_to_power_of_2(data_size);
+        uint64_t count_so_far = self->chunk.chunk_counter * CHUNK_LEN;
+        uint64_t subtree_chunks;
+
+        while (((uint64_t)(subtree_len - 1) & count_so_far) != 0) {
+            subtree_len /= 2;
+        }
+        subtree_chunks = subtree_len / CHUNK_LEN;
+
+        if (subtree_len <= CHUNK_LEN) {
+            CichlidHashBlake3Chunk chunk;
+            uint8_t chunk_cv[OUT_LEN];
+            Output output;
+
+            chunk_init(&chunk, self->key, self->chunk.chunk_counter, self->chunk.flags);
+            chunk_update(&chunk, input, subtree_len);
+            output = chunk_output(&chunk);
+            output_chaining_value(&output, chunk_cv);
+            push_cv(self, chunk_cv, chunk.chunk_counter);
+        } else {
+            uint8_t cv_pair[2 * OUT_LEN];
+
+            compress_subtree_to_parent_node(input, subtree_len, self->key, self->chunk.chunk_counter,
+                                            self->chunk.flags, cv_pair, self->n_threads);
+            push_cv(self, cv_pair, self->chunk.chunk_counter);
+            push_cv(self, cv_pair + OUT_LEN, self->chunk.chunk_counter + subtree_chunks / 2);
+        }
+        self->chunk.chunk_counter += subtree_chunks;
+        input += subtree_len;
+        data_size -= subtree_len;
+    }
+
+    if (data_size > 0) {
+        chunk_update(&self->chunk, input, data_size);
+        merge_cv_stack(self, self->chunk.chunk_counter);
+    }
+}
+
+char *cichlid_hash_blake3_get_hash(const CichlidHashBlake3 *self)
+{
+    char     *hash_string;
+    uint8_t   parent_block[BLOCK_LEN];
+    uint32_t  v[16];
+    size_t    cvs_remaining;
+    Output    output;
+
+    if (self->cv_stack_len == 0) {
+        output = chunk_output(&self->chunk);
+    } else {
+        /* Fold the stack from the top down, the last node is the root */
+        if (chunk_len(&self->chunk) > 0) {
+            cvs_remaining = self->cv_stack_len;
+            output = chunk_output(&self->chunk);
+        } else {
+            cvs_remaining = (size_t)self->cv_stack_len - 2;
+            output = parent_output(self->cv_stack + cvs_remaining * OUT_LEN, self->key, self->chunk.flags);
+        }
+        while (cvs_remaining > 0) {
+            --cvs_remaining;
+            memcpy(parent_block, self->cv_stack + cvs_remaining * OUT_LEN, OUT_LEN);
+            output_chaining_value(&output, parent_block + OUT_LEN);
+            output = parent_output(parent_block, self->key, self->chunk.flags);
+        }
+    }
+
+    compress_pre(v, output.input_cv, output.block, output.block_len, 0, (uint8_t)(output.flags | ROOT));
+
+    hash_string = malloc(sizeof(*hash_string) * (2 * OUT_LEN + 1));
+    for (int i = 0; i < 8; ++i) {
+        uint8_t word[4];
+        store32(word, v[i] ^ v[i + 8]);
+        sprintf(hash_string + 8 * i, "%.2x%.2x%.2x%.2x", word[0], word[1], word[2], word[3]);
+    }
+
+    return hash_string;
+}
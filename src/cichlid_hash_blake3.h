@@ -0,0 +1,84 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_blake3.h
+ *
+ * BLAKE3 hash (256-bit output) as defined in the BLAKE3 specification.
+ * Whole chunks are compressed several at a time using AVX2/AVX-512 when the
+ * CPU supports it, and large updates can optionally be split over threads.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CICHLID_HASH_BLAKE3_H
+#define CICHLID_HASH_BLAKE3_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CICHLID_HASH_BLAKE3_OUT_LEN (32)
+#define CICHLID_HASH_BLAKE3_BLOCK_LEN (64)
+#define CICHLID_HASH_BLAKE3_CHUNK_LEN (1024)
+#define CICHLID_HASH_BLAKE3_MAX_DEPTH (54)
+
+typedef struct _CichlidHashBlake3Chunk CichlidHashBlake3Chunk;
+struct _CichlidHashBlake3Chunk
+{
+    uint32_t cv[8];
+    uint64_t chunk_counter;
+    uint8_t  buf[CICHLID_HASH_BLAKE3_BLOCK_LEN];
+    uint8_t  buf_len;
+    uint8_t  blocks_compressed;
+    uint8_t  flags;
+};
+
+typedef struct _CichlidHashBlake3 CichlidHashBlake3;
+struct _CichlidHashBlake3
+{
+    uint32_t               key[8];
+    CichlidHashBlake3Chunk chunk;
+    uint8_t                cv_stack_len;
+    uint8_t                cv_stack[(CICHLID_HASH_BLAKE3_MAX_DEPTH + 1) * CICHLID_HASH_BLAKE3_OUT_LEN];
+    unsigned int           n_threads;
+};
+
+/*!
+ * Initialize or reinitialize a BLAKE3 hash calculator
+ * \param self Hash calculator instance
+ */
+void cichlid_hash_blake3_init(CichlidHashBlake3 *self);
+/*!
+ * Set the number of threads a single update may use. Only updates large
+ * enough to contain several whole subtrees are split, the default is 1. The
+ * threads come from a pool shared by all calculators, which is started on
+ * first use and kept until the process exits.
+ * \param self Hash calculator instance
+ * \param n_threads Maximum number of threads
+ */
+void cichlid_hash_blake3_set_threads(CichlidHashBlake3 *self, unsigned int n_threads);
+/*!
+ * Update the calculator with new data
+ * \param self Hash calculator instance
+ * \param data Pointer to data stream
+ * \param data_size Size of available data
+ */
+void cichlid_hash_blake3_update(CichlidHashBlake3 *self, const char *data, size_t data_size);
+/*!
+ * Retrieve current hash.
+ * \returns A null-terminated string containing the hash
+ */
+char *cichlid_hash_blake3_get_hash(const CichlidHashBlake3 *self);
+
+#endif /* CICHLID_HASH_BLAKE3_H */
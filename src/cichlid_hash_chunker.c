@@ -0,0 +1,188 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_chunker.c
+ *
+ * Content-defined chunking using the FastCDC Gear rolling hash with
+ * normalized chunking (Xia et al., USENIX ATC 2016).
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "cichlid_hash_chunker.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Number of bits by which the masks used before and after the average size
+ * are harder and easier to match respectively */
+#define NORMALIZATION_LEVEL (2)
+
+static uint64_t       gear[256];
+static pthread_once_t gear_once = PTHREAD_ONCE_INIT;
+
+/*!
+ * Fill the Gear table with fixed pseudo-random values (SplitMix64), so that
+ * boundaries are the same between runs.
+ */
+static void init_gear(void)
+{
+    uint64_t state = 0;
+
+    for (int i = 0; i < 256; ++i) {
+        uint64_t z = (state += UINT64_C(0x9e3779b97f4a7c15));
+        z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+        z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+        gear[i] = z ^ (z >> 31);
+    }
+}
+
+/*!
+ * \returns A mask of the n most significant bits, which depend on the last
+ *          n bytes and more of the Gear hash
+ */
+static uint64_t top_bits(unsigned int n)
+{
+    return ~UINT64_C(0) << (64 - n);
+}
+
+/*!
+ * Scan for the end of the current chunk.
+ * \param[out] found Set if the chunk ends within data
+ * \returns The number of bytes of data belonging to the current chunk
+ */
+static size_t find_boundary(CichlidHashChunker *self, const uint8_t *data, size_t data_size, bool *found)
+{
+    uint64_t fp = self->fingerprint;
+    uint64_t pos = self->chunk_size;
+    size_t   i = 0;
+
+    *found = false;
+
+    /* Cut-point skipping, no boundary can be placed before min_size */
+    if (pos < self->min_size) {
+        uint64_t skip = self->min_size - pos;
+        if (skip >= data_size) {
+            return data_size;
+        }
+        i = (size_t)skip;
+        pos += skip;
+    }
+
+    for (; i < data_size && pos < self->avg_size; ++i, ++pos) {
+        fp = (fp << 1) + gear[data[i]];
+        if (!(fp & self->mask_small)) {
+            *found = true;
+            self->fingerprint = 0;
+            return i + 1;
+        }
+    }
+    for (; i < data_size && pos < self->max_size; ++i, ++pos) {
+        fp = (fp << 1) + gear[data[i]];
+        if (!(fp & self->mask_large)) {
+            *found = true;
+            self->fingerprint = 0;
+            return i + 1;
+        }
+    }
+    if (pos == self->max_size) {
+        *found = true;
+        fp = 0;
+    }
+    self->fingerprint = fp;
+    return i;
+}
+
+static void emit_chunk(CichlidHashChunker *self)
+{
+    CichlidHashChunk chunk;
+    char            *hash_string;
+
+    hash_string = self->algorithm->get_hash(self->context);
+    chunk.offset = self->chunk_offset;
+    chunk.size = self->chunk_size;
+    chunk.hash = hash_string;
+    self->callback(self->user_data, &chunk);
+    free(hash_string);
+
+    self->chunk_offset += self->chunk_size;
+    self->chunk_size = 0;
+    self->algorithm->init(self->context);
+}
+
+bool cichlid_hash_chunker_init(CichlidHashChunker *self, const CichlidHashAlgorithm *algorithm,
+                               uint64_t min_size, uint64_t avg_size, uint64_t max_size,
+                               CichlidHashChunkFunc callback, void *user_data)
+{
+    unsigned int avg_bits = 0;
+
+    if (min_size < CICHLID_HASH_CHUNKER_MIN_SIZE || max_size > CICHLID_HASH_CHUNKER_MAX_SIZE ||
+        min_size > avg_size || avg_size > max_size || (avg_size & (avg_size - 1))) {
+        return false;
+    }
+    while ((UINT64_C(1) << avg_bits) < avg_size) {
+        ++avg_bits;
+    }
+
+    pthread_once(&gear_once, init_gear);
+
+    self->algorithm = algorithm;
+    self->context = malloc(algorithm->context_size);
+    algorithm->init(self->context);
+    self->min_size = min_size;
+    self->avg_size = avg_size;
+    self->max_size = max_size;
+    self->mask_small = top_bits(avg_bits + NORMALIZATION_LEVEL);
+    self->mask_large = top_bits(avg_bits > NORMALIZATION_LEVEL ? avg_bits - NORMALIZATION_LEVEL : 1);
+    self->fingerprint = 0;
+    self->chunk_offset = 0;
+    self->chunk_size = 0;
+    self->callback = callback;
+    self->user_data = user_data;
+    return true;
+}
+
+void cichlid_hash_chunker_update(CichlidHashChunker *self, const char *data, size_t data_size)
+{
+    while (data_size > 0) {
+        bool   found;
+        size_t n = find_boundary(self, (const uint8_t *)data, data_size, &found);
+
+        /* Hash the part while it is still in the cache */
+        self->algorithm->update(self->context, data, n);
+        self->chunk_size += n;
+        data += n;
+        data_size -= n;
+        if (found) {
+            emit_chunk(self);
+        }
+    }
+}
+
+void cichlid_hash_chunker_finish(CichlidHashChunker *self)
+{
+    if (self->chunk_size > 0) {
+        emit_chunk(self);
+    }
+    self->fingerprint = 0;
+    self->chunk_offset = 0;
+}
+
+void cichlid_hash_chunker_destroy(CichlidHashChunker *self)
+{
+    free(self->context);
+    self->context = NULL;
+}
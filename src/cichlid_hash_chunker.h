@@ -0,0 +1,97 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_chunker.h
+ *
+ * Content-defined chunking using the FastCDC Gear rolling hash, hashing every
+ * chunk with one of the algorithms in cichlid_hash.h while it is scanned.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CICHLID_HASH_CHUNKER_H
+#define CICHLID_HASH_CHUNKER_H
+
+#include "cichlid_hash.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CICHLID_HASH_CHUNKER_MIN_SIZE (64)
+#define CICHLID_HASH_CHUNKER_MAX_SIZE (1 << 30)
+
+typedef struct
+{
+    uint64_t    offset; /* Offset of the chunk in the stream */
+    uint64_t    size;   /* Size of the chunk in bytes */
+    const char *hash;   /* Hash of the chunk, only valid during the callback */
+} CichlidHashChunk;
+
+/*!
+ * Called for every chunk, in stream order.
+ */
+typedef void (*CichlidHashChunkFunc)(void *user_data, const CichlidHashChunk *chunk);
+
+typedef struct CichlidHashChunker_ CichlidHashChunker;
+struct CichlidHashChunker_
+{
+    const CichlidHashAlgorithm *algorithm;
+    void                       *context;
+    uint64_t                    min_size;
+    uint64_t                    avg_size;
+    uint64_t                    max_size;
+    uint64_t                    mask_small;
+    uint64_t                    mask_large;
+    uint64_t                    fingerprint;
+    uint64_t                    chunk_offset;
+    uint64_t                    chunk_size;
+    CichlidHashChunkFunc        callback;
+    void                       *user_data;
+};
+
+/*!
+ * Initialize a chunker.
+ * \param self Chunker instance
+ * \param algorithm Algorithm used to hash each chunk
+ * \param min_size Minimum chunk size, at least CICHLID_HASH_CHUNKER_MIN_SIZE
+ * \param avg_size Desired average chunk size, a power of two
+ * \param max_size Maximum chunk size, at most CICHLID_HASH_CHUNKER_MAX_SIZE
+ * \param callback Function receiving the chunks
+ * \param user_data Passed to callback
+ * \returns false if the sizes are invalid
+ */
+bool cichlid_hash_chunker_init(CichlidHashChunker *self, const CichlidHashAlgorithm *algorithm,
+                               uint64_t min_size, uint64_t avg_size, uint64_t max_size,
+                               CichlidHashChunkFunc callback, void *user_data);
+/*!
+ * Feed the chunker the next part of the stream. The callback is called for
+ * every chunk that ends within it.
+ * \param self Chunker instance
+ * \param data Pointer to data stream
+ * \param data_size Size of available data
+ */
+void cichlid_hash_chunker_update(CichlidHashChunker *self, const char *data, size_t data_size);
+/*!
+ * End the stream, emitting the last chunk if it is not empty. The chunker
+ * may then be used for a new stream.
+ * \param self Chunker instance
+ */
+void cichlid_hash_chunker_finish(CichlidHashChunker *self);
+/*!
+ * Free the resources held by a chunker.
+ * \param self Chunker instance
+ */
+void cichlid_hash_chunker_destroy(CichlidHashChunker *self);
+
+#endif /* CICHLID_HASH_CHUNKER_H */
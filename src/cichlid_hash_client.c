@@ -0,0 +1,190 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_client.c
+ *
+ * Client of the hashing daemon started with "cichlid --daemon". Files are
+ * passed to the daemon as open file descriptors over a Unix domain socket.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+#include "cichlid_hash_client.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*!
+ * Create a directory only the user can use, or check that an existing one
+ * is such a directory, as anyone can create one by that name in /tmp.
+ */
+static bool make_private_dir(const char *path)
+{
+    struct stat st;
+
+    if (mkdir(path, 0700) != 0 && errno != EEXIST) {
+        return false;
+    }
+    if (lstat(path, &st) != 0) {
+        return false;
+    } else if (!S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 077) != 0) {
+        errno = EPERM;
+        return false;
+    }
+    return true;
+}
+
+char *cichlid_hash_client_default_path(void)
+{
+    const char *value;
+    char       *path;
+
+    if ((value = getenv("CICHLID_SOCKET")) != NULL && *value) {
+        return strdup(value);
+    }
+    if ((value = getenv("XDG_RUNTIME_DIR")) != NULL && *value) {
+        path = malloc(strlen(value) + sizeof("/cichlid.sock"));
+        sprintf(path, "%s/cichlid.sock", value);
+        return path;
+    }
+    path = malloc(64);
+    snprintf(path, 64, "/tmp/cichlid-%u", (unsigned int)getuid());
+    if (!make_private_dir(path)) {
+        free(path);
+        return NULL;
+    }
+    strcat(path, "/cichlid.sock");
+    return path;
+}
+
+int cichlid_hash_client_connect(const char *path)
+{
+    struct sockaddr_un address;
+    char              *default_path = NULL;
+    struct ucred       credentials;
+    socklen_t          credentials_size = sizeof(credentials);
+    int                connection;
+
+    if (path == NULL && (path = default_path = cichlid_hash_client_default_path()) == NULL) {
+        return -1;
+    }
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        free(default_path);
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    free(default_path);
+
+    connection = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (connection < 0) {
+        return -1;
+    }
+    if (connect(connection, (const struct sockaddr *)&address, sizeof(address)) != 0) {
+        int error = errno;
+        close(connection);
+        errno = error;
+        return -1;
+    }
+    /* The daemon receives open files, so it must be the user's own */
+    if (getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &credentials, &credentials_size) != 0 ||
+        credentials.uid != getuid()) {
+        close(connection);
+        errno = EPERM;
+        return -1;
+    }
+    return connection;
+}
+
+static int send_request(int connection, const CichlidHashClientRequest *request, int fd)
+{
+    union
+    {
+        struct cmsghdr header;
+        char           buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct iovec    iov = { (void *)request, sizeof(*request) };
+    struct msghdr   message;
+    struct cmsghdr *cmsg;
+
+    memset(&message, 0, sizeof(message));
+    memset(&control, 0, sizeof(control));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buf;
+    message.msg_controllen = sizeof(control.buf);
+    cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    while (sendmsg(connection, &message, MSG_NOSIGNAL) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int cichlid_hash_client_hash(int connection, const char *algorithms, int fd, uint64_t offset, uint64_t size,
+                             char *hashes[], size_t max_hashes)
+{
+    CichlidHashClientRequest  request;
+    CichlidHashClientResponse response;
+    ssize_t                   n;
+    char                     *save_ptr = NULL;
+    int                       n_hashes = 0;
+
+    if (strlen(algorithms) >= sizeof(request.algorithms)) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(&request, 0, sizeof(request));
+    request.magic = CICHLID_HASH_CLIENT_MAGIC;
+    request.offset = offset;
+    request.size = size;
+    strcpy(request.algorithms, algorithms);
+    if (send_request(connection, &request, fd) != 0) {
+        return -1;
+    }
+
+    while ((n = recv(connection, &response, sizeof(response), 0)) < 0 && errno == EINTR) {
+    }
+    if (n < 0) {
+        return -1;
+    } else if ((size_t)n != sizeof(response)) {
+        errno = EPROTO;
+        return -1;
+    } else if (response.error) {
+        errno = response.error;
+        return -1;
+    }
+
+    response.hashes[sizeof(response.hashes) - 1] = '\0';
+    for (char *hash = strtok_r(response.hashes, " ", &save_ptr); hash && (size_t)n_hashes < max_hashes;
+         hash = strtok_r(NULL, " ", &save_ptr)) {
+        hashes[n_hashes++] = strdup(hash);
+    }
+    return n_hashes;
+}
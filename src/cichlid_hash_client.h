@@ -0,0 +1,81 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_client.h
+ *
+ * Client of the hashing daemon started with "cichlid --daemon". Files are
+ * passed to the daemon as open file descriptors over a Unix domain socket.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CICHLID_HASH_CLIENT_H
+#define CICHLID_HASH_CLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CICHLID_HASH_CLIENT_MAGIC (0x43484431) /* "CHD1" */
+/* Size of a range that extends to the end of the file */
+#define CICHLID_HASH_CLIENT_TO_END (UINT64_MAX)
+#define CICHLID_HASH_CLIENT_ALGORITHMS_SIZE (256)
+#define CICHLID_HASH_CLIENT_HASHES_SIZE (8192)
+
+/* Messages on the socket, the request carries the file descriptor */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+    char     algorithms[CICHLID_HASH_CLIENT_ALGORITHMS_SIZE]; /* Comma separated names */
+} CichlidHashClientRequest;
+
+typedef struct
+{
+    int32_t  error;                                  /* 0 or an errno value */
+    uint32_t reserved;
+    char     hashes[CICHLID_HASH_CLIENT_HASHES_SIZE]; /* Space separated, in request order */
+} CichlidHashClientResponse;
+
+/*!
+ * \returns The socket path from the CICHLID_SOCKET environment variable, or
+ *          else cichlid.sock in XDG_RUNTIME_DIR or else in a per-user
+ *          directory in /tmp, which is created if needed. To be freed by the
+ *          caller. NULL with errno set if that directory is not private to
+ *          the user.
+ */
+char *cichlid_hash_client_default_path(void);
+/*!
+ * Connect to a running daemon of the same user.
+ * \param path Socket path, NULL for the default
+ * \returns The connection or -1 with errno set if no daemon is listening, or
+ *          EPERM if it runs as another user
+ */
+int cichlid_hash_client_connect(const char *path);
+/*!
+ * Hash a range of an open file on the daemon.
+ * \param connection Connection to the daemon
+ * \param algorithms Comma separated algorithm names
+ * \param fd File to read, which the daemon receives a duplicate of
+ * \param offset Start of the range
+ * \param size Size of the range or CICHLID_HASH_CLIENT_TO_END
+ * \param hashes Receives one string per algorithm, to be freed by the caller
+ * \param max_hashes Size of hashes
+ * \returns The number of hashes, or -1 with errno set
+ */
+int cichlid_hash_client_hash(int connection, const char *algorithms, int fd, uint64_t offset, uint64_t size,
+                             char *hashes[], size_t max_hashes);
+
+#endif /* CICHLID_HASH_CLIENT_H */
@@ -64,4 +64,47 @@ static inline uint64_t cichlid_rotate_right_64(uint64_t x, int n)
     return (x >> n) | (x << (64 - n));
 }
 
+/*!
+ * Multiply two bit-reflected polynomials modulo poly, for reflected CRCs of
+ * up to 64 bits.
+ * \param poly Bit-reflected CRC polynomial
+ * \param width Width of the CRC in bits
+ */
+static inline uint64_t cichlid_crc_multmodp(uint64_t poly, int width, uint64_t a, uint64_t b)
+{
+    uint64_t m = (uint64_t)1 << (width - 1);
+    uint64_t p = 0;
+
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ poly : b >> 1;
+    }
+    return p;
+}
+
+/*!
+ * \returns x^n modulo poly, bit-reflected, which shifts a CRC past n zero
+ *          bits when multiplied with it
+ */
+static inline uint64_t cichlid_crc_xnmodp(uint64_t poly, int width, uint64_t n)
+{
+    uint64_t result = (uint64_t)1 << (width - 1); /* x^0 */
+    uint64_t power = (uint64_t)1 << (width - 2);  /* x^1 */
+
+    while (n) {
+        if (n & 1) {
+            result = cichlid_crc_multmodp(poly, width, power, result);
+        }
+        power = cichlid_crc_multmodp(poly, width, power, power);
+        n >>= 1;
+    }
+    return result;
+}
+
 #endif /* CICHLID_HASH_COMMON_H */
@@ -19,12 +19,16 @@
 
 #include "cichlid_hash_crc32.h"
 
+#include "cichlid_hash_common.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+/* Bit-reflected CRC-32 polynomial */
+#define POLY (0xedb88320)
+
 /* CRC32 LUT */
 static const uint32_t crc_lookup_table[256] = {
     0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f, 0xe963a535, 0x9e6495a3,
@@ -79,6 +83,12 @@ void cichlid_hash_crc32_update(CichlidHashCrc32 *self, const char *data, size_t
     }
 }
 
+void cichlid_hash_crc32_update_zeros(CichlidHashCrc32 *self, uint64_t size)
+{
+    /* Shifting zero bytes through the register multiplies it by x^8 each */
+    self->hash = (uint32_t)cichlid_crc_multmodp(POLY, 32, cichlid_crc_xnmodp(POLY, 32, 8 * size), self->hash);
+}
+
 char *cichlid_hash_crc32_get_hash(const CichlidHashCrc32 *self)
 {
     char *hash_string;
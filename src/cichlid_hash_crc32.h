@@ -33,5 +33,12 @@ struct _CichlidHashCrc32
 void cichlid_hash_crc32_init(CichlidHashCrc32 *self);
 void cichlid_hash_crc32_update(CichlidHashCrc32 *self, const char *data, size_t data_size);
 char *cichlid_hash_crc32_get_hash(const CichlidHashCrc32 *self);
+/*!
+ * Update the checksum as if size zero bytes were hashed, in time logarithmic
+ * in size. Used for holes in sparse files.
+ * \param self Checksum calculator instance
+ * \param size Number of zero bytes
+ */
+void cichlid_hash_crc32_update_zeros(CichlidHashCrc32 *self, uint64_t size);
 
 #endif /* CICHLID_HASH_CRC32_H */
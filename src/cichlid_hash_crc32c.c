@@ -0,0 +1,201 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_crc32c.c
+ *
+ * CRC-32C (Castagnoli polynomial) as used by iSCSI, ext4 and btrfs. Uses the
+ * SSE4.2 crc32 instruction when available.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cichlid_hash_crc32c.h"
+
+#include "cichlid_hash_common.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CRC32C_X86_HW
+#include <immintrin.h>
+#define TARGET_SSE42_PCLMUL __attribute__((target("sse4.2,pclmul")))
+#endif
+
+/* Bit-reflected Castagnoli polynomial */
+#define POLY (0x82f63b78)
+
+/* Bytes per stream in the three-way interleaved loops */
+#define LONG_LEN  (8192)
+#define SHORT_LEN (256)
+
+/* Slicing-by-8 tables, table[0] is the ordinary byte-wise table */
+static uint32_t crc_table[8][256];
+#ifdef CRC32C_X86_HW
+/* Multipliers for shifting a CRC past one and two streams */
+static uint64_t shift_long[2];
+static uint64_t shift_short[2];
+#endif
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void init_tables(void)
+{
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int j = 0; j < 8; ++j) {
+            crc = crc & 1 ? (crc >> 1) ^ POLY : crc >> 1;
+        }
+        crc_table[0][i] = crc;
+    }
+    for (int i = 0; i < 256; ++i) {
+        for (int j = 1; j < 8; ++j) {
+            crc_table[j][i] = (crc_table[j - 1][i] >> 8) ^ crc_table[0][crc_table[j - 1][i] & 0xFF];
+        }
+    }
+
+#ifdef CRC32C_X86_HW
+    /* The carry-less product is one bit short and the crc32 instruction used
+     * for the reduction multiplies by x^32, hence the 33 */
+    shift_long[0] = cichlid_crc_xnmodp(POLY, 32, 8 * LONG_LEN - 33);
+    shift_long[1] = cichlid_crc_xnmodp(POLY, 32, 2 * 8 * LONG_LEN - 33);
+    shift_short[0] = cichlid_crc_xnmodp(POLY, 32, 8 * SHORT_LEN - 33);
+    shift_short[1] = cichlid_crc_xnmodp(POLY, 32, 2 * 8 * SHORT_LEN - 33);
+#endif
+}
+
+static uint32_t update_table(uint32_t crc, const uint8_t *data, size_t data_size)
+{
+    while (data_size >= 8) {
+        uint32_t lo = crc ^ ((uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+                             ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+        crc = crc_table[7][lo & 0xFF] ^ crc_table[6][(lo >> 8) & 0xFF] ^
+              crc_table[5][(lo >> 16) & 0xFF] ^ crc_table[4][lo >> 24] ^
+              crc_table[3][data[4]] ^ crc_table[2][data[5]] ^
+              crc_table[1][data[6]] ^ crc_table[0][data[7]];
+        data += 8;
+        data_size -= 8;
+    }
+    while (data_size--) {
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *data++) & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef CRC32C_X86_HW
+
+TARGET_SSE42_PCLMUL static inline uint32_t shift_crc(uint32_t crc, uint64_t k)
+{
+    __m128i product = _mm_clmulepi64_si128(_mm_cvtsi32_si128((int)crc), _mm_cvtsi64_si128((long long)k), 0);
+    return (uint32_t)_mm_crc32_u64(0, (uint64_t)_mm_cvtsi128_si64(product));
+}
+
+TARGET_SSE42_PCLMUL static inline uint64_t load64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/*!
+ * Run three independent crc32 streams over consecutive ranges of len bytes,
+ * as long as there are at least 3 * len bytes left, and merge them.
+ */
+TARGET_SSE42_PCLMUL static uint32_t update_interleaved(uint32_t crc, const uint8_t **data, size_t *data_size,
+                                                       size_t len, const uint64_t shift[2])
+{
+    const uint8_t *p = *data;
+
+    while (*data_size >= 3 * len) {
+        uint64_t crc0 = crc, crc1 = 0, crc2 = 0;
+
+        for (size_t i = 0; i < len; i += 8) {
+            crc0 = _mm_crc32_u64(crc0, load64(p + i));
+            crc1 = _mm_crc32_u64(crc1, load64(p + len + i));
+            crc2 = _mm_crc32_u64(crc2, load64(p + 2 * len + i));
+        }
+        crc = shift_crc((uint32_t)crc0, shift[1]) ^ shift_crc((uint32_t)crc1, shift[0]) ^ (uint32_t)crc2;
+        p += 3 * len;
+        *data_size -= 3 * len;
+    }
+    *data = p;
+    return crc;
+}
+
+TARGET_SSE42_PCLMUL static uint32_t update_hw(uint32_t crc, const uint8_t *data, size_t data_size)
+{
+    uint64_t crc64;
+
+    crc = update_interleaved(crc, &data, &data_size, LONG_LEN, shift_long);
+    crc = update_interleaved(crc, &data, &data_size, SHORT_LEN, shift_short);
+
+    crc64 = crc;
+    for (; data_size >= 8; data += 8, data_size -= 8) {
+        crc64 = _mm_crc32_u64(crc64, load64(data));
+    }
+    crc = (uint32_t)crc64;
+    for (; data_size > 0; ++data, --data_size) {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+    return crc;
+}
+
+#endif /* CRC32C_X86_HW */
+
+void cichlid_hash_crc32c_init(CichlidHashCrc32c *self)
+{
+    pthread_once(&tables_once, init_tables);
+    self->hash = 0xFFFFFFFF;
+}
+
+void cichlid_hash_crc32c_update(CichlidHashCrc32c *self, const char *data, size_t data_size)
+{
+    if (!data_size) {
+        return;
+    }
+
+#ifdef CRC32C_X86_HW
+    if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("pclmul")) {
+        self->hash = update_hw(self->hash, (const uint8_t *)data, data_size);
+        return;
+    }
+#endif
+    self->hash = update_table(self->hash, (const uint8_t *)data, data_size);
+}
+
+void cichlid_hash_crc32c_update_zeros(CichlidHashCrc32c *self, uint64_t size)
+{
+    /* Shifting zero bytes through the register multiplies it by x^8 each */
+    self->hash = (uint32_t)cichlid_crc_multmodp(POLY, 32, cichlid_crc_xnmodp(POLY, 32, 8 * size), self->hash);
+}
+
+void cichlid_hash_crc32c_combine(CichlidHashCrc32c *self, const CichlidHashCrc32c *next, uint64_t next_size)
+{
+    uint64_t shift = cichlid_crc_xnmodp(POLY, 32, 8 * next_size);
+
+    self->hash = (uint32_t)cichlid_crc_multmodp(POLY, 32, shift, ~self->hash) ^ next->hash;
+}
+
+char *cichlid_hash_crc32c_get_hash(const CichlidHashCrc32c *self)
+{
+    char *hash_string;
+
+    hash_string = malloc(sizeof(char) * 9);
+    sprintf(hash_string, "%.8x", ~(self->hash));
+
+    return hash_string;
+}
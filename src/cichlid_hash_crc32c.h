@@ -0,0 +1,55 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_crc32c.h
+ *
+ * CRC-32C (Castagnoli polynomial) as used by iSCSI, ext4 and btrfs. Uses the
+ * SSE4.2 crc32 instruction when available.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CICHLID_HASH_CRC32C_H
+#define CICHLID_HASH_CRC32C_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct _CichlidHashCrc32c CichlidHashCrc32c;
+struct _CichlidHashCrc32c
+{
+    uint32_t hash;
+};
+
+void cichlid_hash_crc32c_init(CichlidHashCrc32c *self);
+void cichlid_hash_crc32c_update(CichlidHashCrc32c *self, const char *data, size_t data_size);
+char *cichlid_hash_crc32c_get_hash(const CichlidHashCrc32c *self);
+/*!
+ * Update the checksum as if size zero bytes were hashed, in time logarithmic
+ * in size. Used for holes in sparse files.
+ * \param self Checksum calculator instance
+ * \param size Number of zero bytes
+ */
+void cichlid_hash_crc32c_update_zeros(CichlidHashCrc32c *self, uint64_t size);
+/*!
+ * Combine the checksums of two consecutive ranges hashed separately, so that
+ * self holds the checksum of both.
+ * \param self Checksum of the first range, is updated
+ * \param next Checksum of the range following it
+ * \param next_size Size of the second range in bytes
+ */
+void cichlid_hash_crc32c_combine(CichlidHashCrc32c *self, const CichlidHashCrc32c *next, uint64_t next_size);
+
+#endif /* CICHLID_HASH_CRC32C_H */
@@ -0,0 +1,232 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_crc64.c
+ *
+ * Calculation of bit-reflected 64-bit CRCs (CRC-64/XZ as defined in ECMA-182
+ * and CRC-64/NVME) using slicing-by-8 tables, or carry-less multiplication
+ * (PCLMULQDQ) folding when available.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cichlid_hash_crc64.h"
+
+#include "cichlid_hash_common.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CRC64_X86_CLMUL
+#include <immintrin.h>
+#define TARGET_PCLMUL __attribute__((target("sse4.1,pclmul")))
+#endif
+
+/* Updates shorter than this are not worth setting up the folding for */
+#define FOLD_MIN_SIZE (128)
+
+typedef struct
+{
+    uint64_t       poly;            /* Bit-reflected polynomial */
+    uint64_t       table[8][256];   /* Slicing-by-8 tables */
+    uint64_t       fold_16[2];      /* Multipliers for folding 16 bytes forward */
+    uint64_t       fold_64[2];      /* Multipliers for folding 64 bytes forward */
+    pthread_once_t once;
+} Tables;
+
+static void init_xz(void);
+static void init_nvme(void);
+
+static Tables tables_xz = { 0xc96c5795d7870f42, { { 0 } }, { 0 }, { 0 }, PTHREAD_ONCE_INIT };
+static Tables tables_nvme = { 0x9a6c9329ac4bc9b5, { { 0 } }, { 0 }, { 0 }, PTHREAD_ONCE_INIT };
+
+static void init_tables(Tables *tables)
+{
+    for (uint64_t i = 0; i < 256; ++i) {
+        uint64_t crc = i;
+        for (int j = 0; j < 8; ++j) {
+            crc = crc & 1 ? (crc >> 1) ^ tables->poly : crc >> 1;
+        }
+        tables->table[0][i] = crc;
+    }
+    for (int i = 0; i < 256; ++i) {
+        for (int j = 1; j < 8; ++j) {
+            uint64_t prev = tables->table[j - 1][i];
+            tables->table[j][i] = (prev >> 8) ^ tables->table[0][prev & 0xFF];
+        }
+    }
+
+    /* A 128-bit block is folded n bits forward by multiplying its first
+     * (low) half by x^(n+64) and its second half by x^n. The carry-less
+     * product of two reflected values is one bit short, hence the -1. */
+    tables->fold_16[0] = cichlid_crc_xnmodp(tables->poly, 64, 128 + 64 - 1);
+    tables->fold_16[1] = cichlid_crc_xnmodp(tables->poly, 64, 128 - 1);
+    tables->fold_64[0] = cichlid_crc_xnmodp(tables->poly, 64, 512 + 64 - 1);
+    tables->fold_64[1] = cichlid_crc_xnmodp(tables->poly, 64, 512 - 1);
+}
+
+static void init_xz(void)
+{
+    init_tables(&tables_xz);
+}
+
+static void init_nvme(void)
+{
+    init_tables(&tables_nvme);
+}
+
+static const Tables *get_tables(CichlidHashCrc64Polynomial polynomial)
+{
+    if (polynomial == CICHLID_HASH_CRC64_NVME) {
+        pthread_once(&tables_nvme.once, init_nvme);
+        return &tables_nvme;
+    }
+    pthread_once(&tables_xz.once, init_xz);
+    return &tables_xz;
+}
+
+static uint64_t update_table(const Tables *tables, uint64_t crc, const uint8_t *data, size_t data_size)
+{
+    const uint64_t (*t)[256] = tables->table;
+
+    while (data_size >= 8) {
+        uint64_t word = 0;
+        for (int i = 0; i < 8; ++i) {
+            word |= (uint64_t)data[i] << (8 * i);
+        }
+        crc ^= word;
+        crc = t[7][crc & 0xFF] ^ t[6][(crc >> 8) & 0xFF] ^
+              t[5][(crc >> 16) & 0xFF] ^ t[4][(crc >> 24) & 0xFF] ^
+              t[3][(crc >> 32) & 0xFF] ^ t[2][(crc >> 40) & 0xFF] ^
+              t[1][(crc >> 48) & 0xFF] ^ t[0][crc >> 56];
+        data += 8;
+        data_size -= 8;
+    }
+    while (data_size--) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef CRC64_X86_CLMUL
+
+TARGET_PCLMUL static inline __m128i fold(__m128i x, __m128i k, __m128i next)
+{
+    return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11)),
+                         next);
+}
+
+TARGET_PCLMUL static inline __m128i load128(const uint8_t *p)
+{
+    return _mm_loadu_si128((const __m128i *)(const void *)p);
+}
+
+/*!
+ * Fold the data four 16-byte lanes at a time, then into a single lane, and
+ * let the table reduce the final 128 bits.
+ */
+TARGET_PCLMUL static uint64_t update_clmul(const Tables *tables, uint64_t crc, const uint8_t *data, size_t data_size)
+{
+    const __m128i k16 = _mm_set_epi64x((long long)tables->fold_16[1], (long long)tables->fold_16[0]);
+    const __m128i k64 = _mm_set_epi64x((long long)tables->fold_64[1], (long long)tables->fold_64[0]);
+    uint8_t       remainder[16];
+    __m128i       x0, x1, x2, x3;
+
+    /* The initial CRC is added to the first eight bytes of the message */
+    x0 = _mm_xor_si128(load128(data), _mm_cvtsi64_si128((long long)crc));
+    x1 = load128(data + 16);
+    x2 = load128(data + 32);
+    x3 = load128(data + 48);
+    data += 64;
+    data_size -= 64;
+
+    while (data_size >= 64) {
+        x0 = fold(x0, k64, load128(data));
+        x1 = fold(x1, k64, load128(data + 16));
+        x2 = fold(x2, k64, load128(data + 32));
+        x3 = fold(x3, k64, load128(data + 48));
+        data += 64;
+        data_size -= 64;
+    }
+
+    x1 = fold(x0, k16, x1);
+    x2 = fold(x1, k16, x2);
+    x3 = fold(x2, k16, x3);
+    for (; data_size >= 16; data += 16, data_size -= 16) {
+        x3 = fold(x3, k16, load128(data));
+    }
+
+    _mm_storeu_si128((__m128i *)(void *)remainder, x3);
+    crc = update_table(tables, 0, remainder, sizeof(remainder));
+    return update_table(tables, crc, data, data_size);
+}
+
+#endif /* CRC64_X86_CLMUL */
+
+void cichlid_hash_crc64_init(CichlidHashCrc64 *self, CichlidHashCrc64Polynomial polynomial)
+{
+    get_tables(polynomial);
+    self->hash = UINT64_C(0xFFFFFFFFFFFFFFFF);
+    self->polynomial = polynomial;
+}
+
+void cichlid_hash_crc64_update(CichlidHashCrc64 *self, const char *data, size_t data_size)
+{
+    const Tables *tables = get_tables(self->polynomial);
+
+    if (!data_size) {
+        return;
+    }
+
+#ifdef CRC64_X86_CLMUL
+    if (data_size >= FOLD_MIN_SIZE && __builtin_cpu_supports("pclmul")) {
+        self->hash = update_clmul(tables, self->hash, (const uint8_t *)data, data_size);
+        return;
+    }
+#endif
+    self->hash = update_table(tables, self->hash, (const uint8_t *)data, data_size);
+}
+
+void cichlid_hash_crc64_update_zeros(CichlidHashCrc64 *self, uint64_t size)
+{
+    const Tables *tables = get_tables(self->polynomial);
+    uint64_t      shift = cichlid_crc_xnmodp(tables->poly, 64, 8 * size);
+
+    /* Shifting zero bytes through the register multiplies it by x^8 each */
+    self->hash = cichlid_crc_multmodp(tables->poly, 64, shift, self->hash);
+}
+
+void cichlid_hash_crc64_combine(CichlidHashCrc64 *self, const CichlidHashCrc64 *next, uint64_t next_size)
+{
+    const Tables *tables = get_tables(self->polynomial);
+    uint64_t      shift = cichlid_crc_xnmodp(tables->poly, 64, 8 * next_size);
+
+    self->hash = cichlid_crc_multmodp(tables->poly, 64, shift, ~self->hash) ^ next->hash;
+}
+
+char *cichlid_hash_crc64_get_hash(const CichlidHashCrc64 *self)
+{
+    char *hash_string;
+
+    hash_string = malloc(sizeof(char) * 17);
+    sprintf(hash_string, "%.16" PRIx64, ~(self->hash));
+
+    return hash_string;
+}
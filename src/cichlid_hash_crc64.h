@@ -0,0 +1,63 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_crc64.h
+ *
+ * Calculation of bit-reflected 64-bit CRCs (CRC-64/XZ as defined in ECMA-182
+ * and CRC-64/NVME) using slicing-by-8 tables, or carry-less multiplication
+ * (PCLMULQDQ) folding when available.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CICHLID_HASH_CRC64_H
+#define CICHLID_HASH_CRC64_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum
+{
+    CICHLID_HASH_CRC64_XZ,
+    CICHLID_HASH_CRC64_NVME
+} CichlidHashCrc64Polynomial;
+
+typedef struct _CichlidHashCrc64 CichlidHashCrc64;
+struct _CichlidHashCrc64
+{
+    uint64_t                   hash;
+    CichlidHashCrc64Polynomial polynomial;
+};
+
+void cichlid_hash_crc64_init(CichlidHashCrc64 *self, CichlidHashCrc64Polynomial polynomial);
+void cichlid_hash_crc64_update(CichlidHashCrc64 *self, const char *data, size_t data_size);
+char *cichlid_hash_crc64_get_hash(const CichlidHashCrc64 *self);
+/*!
+ * Update the checksum as if size zero bytes were hashed, in time logarithmic
+ * in size. Used for holes in sparse files.
+ * \param self Checksum calculator instance
+ * \param size Number of zero bytes
+ */
+void cichlid_hash_crc64_update_zeros(CichlidHashCrc64 *self, uint64_t size);
+/*!
+ * Combine the checksums of two consecutive ranges hashed separately, so that
+ * self holds the checksum of both.
+ * \param self Checksum of the first range, is updated
+ * \param next Checksum of the range following it, using the same polynomial
+ * \param next_size Size of the second range in bytes
+ */
+void cichlid_hash_crc64_combine(CichlidHashCrc64 *self, const CichlidHashCrc64 *next, uint64_t next_size);
+
+#endif /* CICHLID_HASH_CRC64_H */
@@ -0,0 +1,49 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_crc64_nvme.c
+ *
+ * CRC-64/NVME as used for NVMe end-to-end data protection
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "cichlid_hash_crc64_nvme.h"
+#include "cichlid_hash_crc64.h"
+
+#include <stdint.h>
+
+void cichlid_hash_crc64_nvme_init(CichlidHashCrc64Nvme *self)
+{
+    cichlid_hash_crc64_init(self, CICHLID_HASH_CRC64_NVME);
+}
+
+void cichlid_hash_crc64_nvme_update(CichlidHashCrc64Nvme *self, const char *data, size_t data_size)
+{
+    cichlid_hash_crc64_update(self, data, data_size);
+}
+
+char *cichlid_hash_crc64_nvme_get_hash(CichlidHashCrc64Nvme *self)
+{
+    return cichlid_hash_crc64_get_hash(self);
+}
+
+void cichlid_hash_crc64_nvme_update_zeros(CichlidHashCrc64Nvme *self, uint64_t size)
+{
+    cichlid_hash_crc64_update_zeros(self, size);
+}
+
+void cichlid_hash_crc64_nvme_combine(CichlidHashCrc64Nvme *self, const CichlidHashCrc64Nvme *next, uint64_t next_size)
+{
+    cichlid_hash_crc64_combine(self, next, next_size);
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_crc64_nvme.h
+ *
+ * CRC-64/NVME as used for NVMe end-to-end data protection
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CICHLID_HASH_CRC64_NVME_H
+#define CICHLID_HASH_CRC64_NVME_H
+
+#include "cichlid_hash_crc64.h"
+#include <stddef.h>
+#include <stdint.h>
+
+typedef CichlidHashCrc64 CichlidHashCrc64Nvme;
+
+/*!
+ * Initialize or reinitialize a CRC-64/NVME checksum calculator
+ * \param self Checksum calculator instance
+ */
+void cichlid_hash_crc64_nvme_init(CichlidHashCrc64Nvme *self);
+/*!
+ * Update the calculator with new data
+ * \param self Checksum calculator instance
+ * \param data Pointer to data stream
+ * \param data_size Size of available data
+ */
+void cichlid_hash_crc64_nvme_update(CichlidHashCrc64Nvme *self, const char *data, size_t data_size);
+/*!
+ * Retrieve current checksum.
+ * \returns A null-terminated string containing the checksum
+ */
+char *cichlid_hash_crc64_nvme_get_hash(CichlidHashCrc64Nvme *self);
+/*!
+ * Update the checksum as if size zero bytes were hashed, see
+ * cichlid_hash_crc64_update_zeros.
+ */
+void cichlid_hash_crc64_nvme_update_zeros(CichlidHashCrc64Nvme *self, uint64_t size);
+/*!
+ * Combine the checksums of two consecutive ranges hashed separately.
+ * \param self Checksum of the first range, is updated
+ * \param next Checksum of the range following it
+ * \param next_size Size of the second range in bytes
+ */
+void cichlid_hash_crc64_nvme_combine(CichlidHashCrc64Nvme *self, const CichlidHashCrc64Nvme *next, uint64_t next_size);
+
+#endif /* CICHLID_HASH_CRC64_NVME_H */
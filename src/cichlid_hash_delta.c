@@ -0,0 +1,406 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_delta.c
+ *
+ * rsync-style block signatures and delta detection.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "cichlid_hash_delta.h"
+#include "cichlid_hash_md5.h"
+#include "cichlid_hash_sha256.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_CAPACITY (64)
+
+static size_t strong_size(CichlidHashDeltaStrong strong)
+{
+    return strong == CICHLID_HASH_DELTA_SHA256 ? 32 : 16;
+}
+
+/*!
+ * Calculate the strong hash of a block stored in up to two parts.
+ */
+static void strong_hash(CichlidHashDeltaStrong strong, const uint8_t *data0, size_t size0,
+                        const uint8_t *data1, size_t size1, uint8_t *digest)
+{
+    if (strong == CICHLID_HASH_DELTA_SHA256) {
+        CichlidHashSha256 sha256;
+        cichlid_hash_sha256_init(&sha256);
+        cichlid_hash_sha256_update(&sha256, (const char *)data0, size0);
+        cichlid_hash_sha256_update(&sha256, (const char *)data1, size1);
+        cichlid_hash_sha2_32_get_digest(&sha256, digest);
+    } else {
+        CichlidHashMd5 md5;
+        cichlid_hash_md5_init(&md5);
+        cichlid_hash_md5_update(&md5, (const char *)data0, size0);
+        cichlid_hash_md5_update(&md5, (const char *)data1, size1);
+        cichlid_hash_md5_get_digest(&md5, digest);
+    }
+}
+
+/*!
+ * Mix a weak checksum before it is used as an index, since its low half, the
+ * plain byte sum, is poorly distributed.
+ */
+static inline uint32_t mix(uint32_t weak)
+{
+    weak ^= weak >> 15;
+    weak *= 0x2c1b3c6d;
+    weak ^= weak >> 12;
+    return weak;
+}
+
+/*!
+ * \returns false if no block has the weak checksum. The filter is finer than
+ *          the index, so this also rules out empty buckets.
+ */
+static inline bool filter_test(const uint64_t *filter, size_t filter_mask, uint32_t mixed)
+{
+    size_t bit = mixed & filter_mask;
+    return (filter[bit / 64] >> (bit % 64)) & 1;
+}
+
+uint32_t cichlid_hash_delta_weak(const char *data, size_t data_size)
+{
+    uint32_t a = 0, b = 0;
+
+    for (size_t i = 0; i < data_size; ++i) {
+        a += (uint8_t)data[i];
+        b += a;
+    }
+    return (a & 0xFFFF) | (b << 16);
+}
+
+static void add_block(CichlidHashSignature *self, const uint8_t *data0, uint32_t size0,
+                      const uint8_t *data1, uint32_t size1)
+{
+    CichlidHashBlockSignature *block;
+    uint32_t                   a = 0, b = 0;
+
+    if (self->n_blocks == self->capacity) {
+        self->capacity *= 2;
+        self->blocks = realloc(self->blocks, sizeof(*self->blocks) * self->capacity);
+    }
+    block = &self->blocks[self->n_blocks++];
+
+    for (uint32_t i = 0; i < size0; ++i) {
+        a += data0[i];
+        b += a;
+    }
+    for (uint32_t i = 0; i < size1; ++i) {
+        a += data1[i];
+        b += a;
+    }
+    block->weak = (a & 0xFFFF) | (b << 16);
+    block->size = size0 + size1;
+    memset(block->strong, 0, sizeof(block->strong));
+    strong_hash(self->strong, data0, size0, data1, size1, block->strong);
+}
+
+void cichlid_hash_signature_init(CichlidHashSignature *self, uint32_t block_size, CichlidHashDeltaStrong strong)
+{
+    self->block_size = block_size;
+    self->strong = strong;
+    self->file_size = 0;
+    self->capacity = INITIAL_CAPACITY;
+    self->blocks = malloc(sizeof(*self->blocks) * self->capacity);
+    self->n_blocks = 0;
+    self->pending = malloc(block_size);
+    self->pending_size = 0;
+    self->buckets = NULL;
+    self->next = NULL;
+    self->bucket_mask = 0;
+    self->filter = NULL;
+    self->filter_mask = 0;
+}
+
+void cichlid_hash_signature_update(CichlidHashSignature *self, const char *data, size_t data_size)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t       block_size = self->block_size;
+
+    self->file_size += data_size;
+
+    if (self->pending_size) {
+        uint32_t fill_size = block_size - self->pending_size;
+        if (data_size < fill_size) {
+            memcpy(self->pending + self->pending_size, p, data_size);
+            self->pending_size += (uint32_t)data_size;
+            return;
+        }
+        add_block(self, self->pending, self->pending_size, p, fill_size);
+        self->pending_size = 0;
+        p += fill_size;
+        data_size -= fill_size;
+    }
+    for (; data_size >= block_size; p += block_size, data_size -= block_size) {
+        add_block(self, p, block_size, NULL, 0);
+    }
+    memcpy(self->pending, p, data_size);
+    self->pending_size = (uint32_t)data_size;
+}
+
+void cichlid_hash_signature_finish(CichlidHashSignature *self)
+{
+    size_t n_buckets = 16;
+    size_t filter_size = 1 << 16;
+
+    if (self->pending_size) {
+        add_block(self, self->pending, self->pending_size, NULL, 0);
+        self->pending_size = 0;
+    }
+
+    while (n_buckets < 2 * self->n_blocks) {
+        n_buckets *= 2;
+    }
+    free(self->buckets);
+    free(self->next);
+    self->buckets = calloc(n_buckets, sizeof(*self->buckets));
+    self->next = malloc(sizeof(*self->next) * (self->n_blocks ? self->n_blocks : 1));
+    self->bucket_mask = n_buckets - 1;
+
+    /* Sparse enough for the scan to rarely have to look further */
+    while (filter_size < 16 * self->n_blocks) {
+        filter_size *= 2;
+    }
+    free(self->filter);
+    self->filter = calloc(filter_size / 64, sizeof(*self->filter));
+    self->filter_mask = filter_size - 1;
+
+    /* Insert in reverse so that every chain lists its blocks in file order */
+    for (size_t i = self->n_blocks; i-- > 0;) {
+        uint32_t mixed = mix(self->blocks[i].weak);
+        size_t   b = mixed & self->bucket_mask;
+        size_t   bit = mixed & self->filter_mask;
+        self->next[i] = self->buckets[b];
+        self->buckets[b] = (uint32_t)(i + 1);
+        self->filter[bit / 64] |= UINT64_C(1) << (bit % 64);
+    }
+}
+
+void cichlid_hash_signature_destroy(CichlidHashSignature *self)
+{
+    free(self->blocks);
+    free(self->pending);
+    free(self->buckets);
+    free(self->next);
+    free(self->filter);
+    self->blocks = NULL;
+    self->pending = NULL;
+    self->buckets = NULL;
+    self->next = NULL;
+    self->filter = NULL;
+}
+
+/*!
+ * Report a range, merging it with the previous one when possible.
+ */
+static inline void emit(CichlidHashDelta *self, CichlidHashDeltaOpType type, uint64_t offset, uint64_t size,
+                        uint64_t block)
+{
+    CichlidHashDeltaOp *op = &self->op;
+    uint32_t            block_size = self->signature->block_size;
+
+    if (op->size && op->type == type && op->offset + op->size == offset &&
+        (type == CICHLID_HASH_DELTA_LITERAL ||
+         (op->size % block_size == 0 && op->block + op->size / block_size == block))) {
+        op->size += size;
+        return;
+    }
+    if (op->size) {
+        self->callback(self->user_data, op);
+    }
+    op->type = type;
+    op->offset = offset;
+    op->size = size;
+    op->block = block;
+}
+
+/*!
+ * Look up the window in the signature.
+ * \param[out] block The matching block, preferably the one following the
+ *                   previous match
+ * \returns true if a block with the same contents was found
+ */
+static bool find_block(CichlidHashDelta *self, uint32_t weak, uint64_t *block)
+{
+    const CichlidHashSignature *signature = self->signature;
+    uint8_t                     digest[CICHLID_HASH_DELTA_MAX_STRONG_SIZE];
+    bool                        have_digest = false;
+    bool                        found = false;
+
+    for (uint32_t i = signature->buckets[mix(weak) & signature->bucket_mask]; i; i = signature->next[i - 1]) {
+        const CichlidHashBlockSignature *candidate = &signature->blocks[i - 1];
+
+        if (candidate->weak != weak || candidate->size != self->window_size) {
+            continue;
+        }
+        if (!have_digest) {
+            uint32_t first_size = self->window_size - self->window_start;
+            if (self->window_size < signature->block_size) {
+                first_size = self->window_size;
+            }
+            strong_hash(signature->strong, self->window + self->window_start, first_size,
+                        self->window, self->window_size - first_size, digest);
+            have_digest = true;
+        }
+        if (!memcmp(candidate->strong, digest, strong_size(signature->strong))) {
+            if (!found || i - 1 == self->last_block) {
+                *block = i - 1;
+                found = true;
+            }
+            if (i - 1 == self->last_block) {
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+void cichlid_hash_delta_init(CichlidHashDelta *self, const CichlidHashSignature *signature,
+                             CichlidHashDeltaFunc callback, void *user_data)
+{
+    self->signature = signature;
+    self->window = malloc(signature->block_size);
+    self->window_start = 0;
+    self->window_size = 0;
+    self->a = 0;
+    self->b = 0;
+    self->offset = 0;
+    self->literal_start = 0;
+    self->last_block = 0;
+    self->op.size = 0;
+    self->callback = callback;
+    self->user_data = user_data;
+}
+
+/*!
+ * Report the unmatched bytes before the window and the block matching it.
+ */
+static void emit_match(CichlidHashDelta *self, uint64_t block, uint32_t size)
+{
+    if (self->offset > self->literal_start) {
+        emit(self, CICHLID_HASH_DELTA_LITERAL, self->literal_start, self->offset - self->literal_start, 0);
+    }
+    emit(self, CICHLID_HASH_DELTA_COPY, self->offset, size, block);
+    self->offset += size;
+    self->literal_start = self->offset;
+    self->last_block = block + 1;
+}
+
+void cichlid_hash_delta_update(CichlidHashDelta *self, const char *data, size_t data_size)
+{
+    const CichlidHashSignature *signature = self->signature;
+    const uint8_t              *p = (const uint8_t *)data;
+    const uint8_t              *end = p + data_size;
+    const uint64_t             *filter = signature->filter;
+    size_t                      filter_mask = signature->filter_mask;
+    uint8_t                    *window = self->window;
+    uint32_t                    block_size = signature->block_size;
+    uint32_t                    window_start = self->window_start;
+    uint32_t                    window_size = self->window_size;
+    uint32_t                    a = self->a, b = self->b;
+    uint64_t                    offset = self->offset;
+
+    /* The state is kept in locals, which the stores to window can not alias,
+     * and only written back around lookups */
+    for (; p < end; ++p) {
+        uint8_t  in = *p;
+        uint32_t weak;
+        uint64_t block;
+
+        if (window_size < block_size) {
+            window[window_size++] = in;
+            a += in;
+            b += a;
+            if (window_size < block_size) {
+                continue;
+            }
+        } else {
+            /* Roll the window one byte, the byte leaving it has no match */
+            uint8_t out = window[window_start];
+            window[window_start] = in;
+            if (++window_start == block_size) {
+                window_start = 0;
+            }
+            a += (uint32_t)in - out;
+            b += a - block_size * (uint32_t)out;
+            ++offset;
+        }
+
+        weak = (a & 0xFFFF) | (b << 16);
+        if (!filter_test(filter, filter_mask, mix(weak))) {
+            continue;
+        }
+        self->window_start = window_start;
+        self->window_size = window_size;
+        self->offset = offset;
+        if (find_block(self, weak, &block)) {
+            emit_match(self, block, block_size);
+            offset = self->offset;
+            window_start = 0;
+            window_size = 0;
+            a = 0;
+            b = 0;
+        }
+    }
+
+    self->window_start = window_start;
+    self->window_size = window_size;
+    self->a = a;
+    self->b = b;
+    self->offset = offset;
+}
+
+void cichlid_hash_delta_finish(CichlidHashDelta *self)
+{
+    uint32_t weak = (self->a & 0xFFFF) | (self->b << 16);
+    uint64_t block;
+
+    /* The tail may match the short last block of the old file */
+    if (self->window_size && self->window_size < self->signature->block_size &&
+        find_block(self, weak, &block)) {
+        emit_match(self, block, self->window_size);
+    } else {
+        self->offset += self->window_size;
+    }
+    if (self->offset > self->literal_start) {
+        emit(self, CICHLID_HASH_DELTA_LITERAL, self->literal_start, self->offset - self->literal_start, 0);
+    }
+
+    if (self->op.size) {
+        self->callback(self->user_data, &self->op);
+    }
+    self->op.size = 0;
+    self->window_start = 0;
+    self->window_size = 0;
+    self->a = 0;
+    self->b = 0;
+    self->offset = 0;
+    self->literal_start = 0;
+    self->last_block = 0;
+}
+
+void cichlid_hash_delta_destroy(CichlidHashDelta *self)
+{
+    free(self->window);
+    self->window = NULL;
+}
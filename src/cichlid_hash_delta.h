@@ -0,0 +1,158 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_delta.h
+ *
+ * rsync-style block signatures and delta detection. A signature holds a weak
+ * rolling checksum and a strong hash (MD5 or SHA-256) of every block of the
+ * old version of a file, and the new version is scanned byte by byte for
+ * blocks matching it.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CICHLID_HASH_DELTA_H
+#define CICHLID_HASH_DELTA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CICHLID_HASH_DELTA_MAX_STRONG_SIZE (32)
+
+typedef enum
+{
+    CICHLID_HASH_DELTA_MD5,
+    CICHLID_HASH_DELTA_SHA256
+} CichlidHashDeltaStrong;
+
+typedef struct
+{
+    uint32_t weak;
+    uint32_t size;
+    uint8_t  strong[CICHLID_HASH_DELTA_MAX_STRONG_SIZE];
+} CichlidHashBlockSignature;
+
+typedef struct CichlidHashSignature_ CichlidHashSignature;
+struct CichlidHashSignature_
+{
+    uint32_t                   block_size;
+    CichlidHashDeltaStrong     strong;
+    uint64_t                   file_size;
+    CichlidHashBlockSignature *blocks;
+    size_t                     n_blocks;
+    size_t                     capacity;
+    uint8_t                   *pending;      /* Start of a block split between updates */
+    uint32_t                   pending_size;
+    uint32_t                  *buckets;      /* Index by weak checksum, first block + 1 */
+    uint32_t                  *next;         /* Next block + 1 with the same bucket */
+    size_t                     bucket_mask;
+    uint64_t                  *filter;       /* Bitmap of the weak checksums present */
+    size_t                     filter_mask;
+};
+
+typedef enum
+{
+    CICHLID_HASH_DELTA_COPY,   /* Range found in the old file */
+    CICHLID_HASH_DELTA_LITERAL /* Range that has to be transferred */
+} CichlidHashDeltaOpType;
+
+typedef struct
+{
+    CichlidHashDeltaOpType type;
+    uint64_t               offset; /* Offset in the new file */
+    uint64_t               size;   /* Size in bytes */
+    uint64_t               block;  /* First block of the old file, for copies */
+} CichlidHashDeltaOp;
+
+/*!
+ * Called for every range of the new file, in order. Adjacent ranges of the
+ * same kind are merged.
+ */
+typedef void (*CichlidHashDeltaFunc)(void *user_data, const CichlidHashDeltaOp *op);
+
+typedef struct CichlidHashDelta_ CichlidHashDelta;
+struct CichlidHashDelta_
+{
+    const CichlidHashSignature *signature;
+    uint8_t                    *window;       /* Ring buffer of the last block_size bytes */
+    uint32_t                    window_start; /* Index of the oldest byte in window */
+    uint32_t                    window_size;
+    uint32_t                    a, b;         /* Weak checksum of the window */
+    uint64_t                    offset;       /* Offset of the window in the new file */
+    uint64_t                    literal_start; /* Offset of the first unmatched byte */
+    uint64_t                    last_block;   /* Block after the last match, preferred next */
+    CichlidHashDeltaOp          op;           /* Range not yet reported */
+    CichlidHashDeltaFunc        callback;
+    void                       *user_data;
+};
+
+/*!
+ * Initialize a signature of the old version of a file.
+ * \param self Signature instance
+ * \param block_size Size of the blocks compared
+ * \param strong Strong hash used to confirm weak checksum matches
+ */
+void cichlid_hash_signature_init(CichlidHashSignature *self, uint32_t block_size, CichlidHashDeltaStrong strong);
+/*!
+ * Add the next part of the old file to the signature.
+ * \param self Signature instance
+ * \param data Pointer to data stream
+ * \param data_size Size of available data
+ */
+void cichlid_hash_signature_update(CichlidHashSignature *self, const char *data, size_t data_size);
+/*!
+ * Add the final short block, if any, and build the index used for lookups.
+ * \param self Signature instance
+ */
+void cichlid_hash_signature_finish(CichlidHashSignature *self);
+/*!
+ * Free the resources held by a signature.
+ * \param self Signature instance
+ */
+void cichlid_hash_signature_destroy(CichlidHashSignature *self);
+
+/*!
+ * Calculate the weak checksum of a block as used by the signatures.
+ */
+uint32_t cichlid_hash_delta_weak(const char *data, size_t data_size);
+
+/*!
+ * Initialize a scan of the new version of a file.
+ * \param self Delta instance
+ * \param signature Finished signature of the old version, must outlive self
+ * \param callback Function receiving the delta map
+ * \param user_data Passed to callback
+ */
+void cichlid_hash_delta_init(CichlidHashDelta *self, const CichlidHashSignature *signature,
+                             CichlidHashDeltaFunc callback, void *user_data);
+/*!
+ * Scan the next part of the new file.
+ * \param self Delta instance
+ * \param data Pointer to data stream
+ * \param data_size Size of available data
+ */
+void cichlid_hash_delta_update(CichlidHashDelta *self, const char *data, size_t data_size);
+/*!
+ * End the scan and report the remaining ranges.
+ * \param self Delta instance
+ */
+void cichlid_hash_delta_finish(CichlidHashDelta *self);
+/*!
+ * Free the resources held by a delta scan.
+ * \param self Delta instance
+ */
+void cichlid_hash_delta_destroy(CichlidHashDelta *self);
+
+#endif /* CICHLID_HASH_DELTA_H */
@@ -0,0 +1,218 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_fingerprint.c
+ *
+ * Sampled fingerprints of files, the file size together with a BLAKE3 hash
+ * of a fixed number of blocks at offsets given by the size.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cichlid_hash_fingerprint.h"
+#include "cichlid_hash_blake3.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define READ_BUFFER_SIZE (1024 * 1024)
+/* Hex digest of each sample */
+#define SAMPLE_HASH_SIZE (2 * CICHLID_HASH_BLAKE3_OUT_LEN)
+
+typedef struct
+{
+    int          fd;
+    uint64_t    *offsets;
+    char        *hashes;      /* Hash of sample i at i * SAMPLE_HASH_SIZE */
+    uint64_t     sample_size;
+    unsigned int n_samples;
+    unsigned int next_sample; /* Atomic */
+    int          error;       /* Atomic, first errno */
+} Sampler;
+
+static void set_error(Sampler *self, int error)
+{
+    int expected = 0;
+
+    __atomic_compare_exchange_n(&self->error, &expected, error, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static void update_u64(CichlidHashBlake3 *blake3, uint64_t value)
+{
+    char bytes[8];
+
+    for (int i = 0; i < 8; ++i) {
+        bytes[i] = (char)(value >> (8 * i));
+    }
+    cichlid_hash_blake3_update(blake3, bytes, sizeof(bytes));
+}
+
+/*!
+ * Hash one sample a buffer at a time, prefixed by its offset.
+ * \returns false with the error set if it could not be read
+ */
+static bool hash_sample(Sampler *self, unsigned int index, char *buf)
+{
+    CichlidHashBlake3 blake3;
+    uint64_t          offset = self->offsets[index];
+    uint64_t          left = self->sample_size;
+    char             *hash;
+
+    cichlid_hash_blake3_init(&blake3);
+    update_u64(&blake3, offset);
+    while (left > 0) {
+        size_t  size = left < READ_BUFFER_SIZE ? (size_t)left : READ_BUFFER_SIZE;
+        ssize_t n = pread(self->fd, buf, size, (off_t)offset);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            /* The file shrank since its size was read */
+            set_error(self, n < 0 ? errno : EIO);
+            return false;
+        }
+        cichlid_hash_blake3_update(&blake3, buf, (size_t)n);
+        offset += (uint64_t)n;
+        left -= (uint64_t)n;
+    }
+    if ((hash = cichlid_hash_blake3_get_hash(&blake3)) == NULL) {
+        set_error(self, ENOMEM);
+        return false;
+    }
+    memcpy(self->hashes + (size_t)index * SAMPLE_HASH_SIZE, hash, SAMPLE_HASH_SIZE);
+    free(hash);
+    return true;
+}
+
+static void *hash_samples(void *arg)
+{
+    Sampler *self = arg;
+    char    *buf = malloc(READ_BUFFER_SIZE);
+
+    if (buf == NULL) {
+        set_error(self, ENOMEM);
+        return NULL;
+    }
+    for (;;) {
+        unsigned int i = __atomic_fetch_add(&self->next_sample, 1, __ATOMIC_RELAXED);
+
+        if (i >= self->n_samples || __atomic_load_n(&self->error, __ATOMIC_RELAXED) ||
+            !hash_sample(self, i, buf)) {
+            break;
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+char *cichlid_hash_fingerprint_fd(int fd, unsigned int n_samples, size_t sample_size, unsigned int n_threads)
+{
+    Sampler           self;
+    CichlidHashBlake3 blake3;
+    struct stat       st;
+    uint64_t          file_size;
+    pthread_t        *threads;
+    unsigned int      n_started = 0;
+    char             *hash;
+    char             *fingerprint = NULL;
+
+    if (n_samples < 2 || sample_size == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0) {
+        return NULL;
+    } else if (!S_ISREG(st.st_mode)) {
+        /* Only regular files have a size and offsets to sample at */
+        errno = EINVAL;
+        return NULL;
+    }
+    file_size = (uint64_t)st.st_size;
+
+    self.fd = fd;
+    self.next_sample = 0;
+    self.error = 0;
+    if (file_size <= (uint64_t)n_samples * sample_size) {
+        /* Small files are read whole, as a single sample */
+        self.n_samples = 1;
+        self.sample_size = file_size;
+    } else {
+        self.n_samples = n_samples;
+        self.sample_size = sample_size;
+    }
+    self.offsets = malloc(sizeof(*self.offsets) * self.n_samples);
+    self.hashes = malloc((size_t)self.n_samples * SAMPLE_HASH_SIZE);
+    if (n_threads > self.n_samples) {
+        n_threads = self.n_samples;
+    }
+    threads = malloc(sizeof(*threads) * (n_threads ? n_threads : 1));
+    if (self.offsets == NULL || self.hashes == NULL || threads == NULL) {
+        free(threads);
+        free(self.hashes);
+        free(self.offsets);
+        errno = ENOMEM;
+        return NULL;
+    }
+    for (unsigned int i = 0; i < self.n_samples; ++i) {
+        /* Spread from the head to the tail, without overflowing for any
+         * file size that fits an off_t */
+        uint64_t span = file_size - self.sample_size;
+        uint64_t last = self.n_samples - 1;
+        self.offsets[i] = last ? span / last * i + span % last * i / last : 0;
+    }
+
+    for (unsigned int i = 0; i < n_threads; ++i) {
+        if (pthread_create(&threads[n_started], NULL, hash_samples, &self) == 0) {
+            ++n_started;
+        }
+    }
+    if (n_started == 0) {
+        hash_samples(&self);
+    }
+    for (unsigned int i = 0; i < n_started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    if (self.error) {
+        errno = self.error;
+    } else {
+        /* The layout of the samples is hashed along with them */
+        cichlid_hash_blake3_init(&blake3);
+        update_u64(&blake3, file_size);
+        update_u64(&blake3, self.n_samples);
+        update_u64(&blake3, self.sample_size);
+        cichlid_hash_blake3_update(&blake3, self.hashes, (size_t)self.n_samples * SAMPLE_HASH_SIZE);
+        hash = cichlid_hash_blake3_get_hash(&blake3);
+        fingerprint = hash ? malloc(strlen(hash) + 22) : NULL;
+        if (fingerprint) {
+            sprintf(fingerprint, "%" PRIu64 ":%s", file_size, hash);
+        } else {
+            errno = ENOMEM;
+        }
+        free(hash);
+    }
+
+    free(self.hashes);
+    free(self.offsets);
+    return fingerprint;
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_fingerprint.h
+ *
+ * Sampled fingerprints of files, the file size together with a BLAKE3 hash
+ * of a fixed number of blocks at offsets given by the size. Reading them
+ * costs the same for any file larger than the samples, which makes them a
+ * cheap first check of whether a file has changed. Changes that fall
+ * between the samples are not detected.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CICHLID_HASH_FINGERPRINT_H
+#define CICHLID_HASH_FINGERPRINT_H
+
+#include <stddef.h>
+
+#define CICHLID_HASH_FINGERPRINT_SAMPLES (16)
+#define CICHLID_HASH_FINGERPRINT_SAMPLE_SIZE (64 * 1024)
+
+/*!
+ * Compute the fingerprint of an open file. The samples are the first and
+ * last blocks and n_samples - 2 blocks evenly spaced between them, read in
+ * parallel. Files no larger than the samples together are hashed whole.
+ * \param fd File to read, the file position is not used
+ * \param n_samples Number of samples, at least 2
+ * \param sample_size Size of each sample in bytes
+ * \param n_threads Number of samples read at once
+ * \returns The fingerprint as "size:hash", to be freed by the caller, or
+ *          NULL with errno set if the file could not be read or is not a
+ *          regular file
+ */
+char *cichlid_hash_fingerprint_fd(int fd, unsigned int n_samples, size_t sample_size, unsigned int n_threads);
+
+#endif /* CICHLID_HASH_FINGERPRINT_H */
@@ -0,0 +1,205 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_hmac.c
+ *
+ * HMAC (RFC 2104) over SHA-256, SHA-384 and SHA-512.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "cichlid_hash_hmac.h"
+#include "cichlid_hash_sha256.h"
+#include "cichlid_hash_sha384.h"
+#include "cichlid_hash_sha512.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_BLOCK_SIZE (128)
+#define IPAD (0x36)
+#define OPAD (0x5c)
+
+static bool is_sha2_64(CichlidHashHmacAlgorithm algorithm)
+{
+    return algorithm != CICHLID_HASH_HMAC_SHA256;
+}
+
+static void state_init(CichlidHashHmacState *state, CichlidHashHmacAlgorithm algorithm)
+{
+    switch (algorithm) {
+    case CICHLID_HASH_HMAC_SHA384:
+        cichlid_hash_sha384_init(&state->sha2_64);
+        break;
+    case CICHLID_HASH_HMAC_SHA512:
+        cichlid_hash_sha512_init(&state->sha2_64);
+        break;
+    default:
+        cichlid_hash_sha256_init(&state->sha2_32);
+        break;
+    }
+}
+
+static void state_update(CichlidHashHmacState *state, CichlidHashHmacAlgorithm algorithm,
+                         const char *data, size_t data_size)
+{
+    if (is_sha2_64(algorithm)) {
+        cichlid_hash_sha2_64_update(&state->sha2_64, data, data_size);
+    } else {
+        cichlid_hash_sha2_32_update(&state->sha2_32, data, data_size);
+    }
+}
+
+static void state_get_digest(const CichlidHashHmacState *state, CichlidHashHmacAlgorithm algorithm,
+                             uint8_t *digest)
+{
+    if (is_sha2_64(algorithm)) {
+        cichlid_hash_sha2_64_get_digest(&state->sha2_64, digest);
+    } else {
+        cichlid_hash_sha2_32_get_digest(&state->sha2_32, digest);
+    }
+}
+
+static size_t block_size(CichlidHashHmacAlgorithm algorithm)
+{
+    return is_sha2_64(algorithm) ? 128 : 64;
+}
+
+static size_t digest_size(CichlidHashHmacAlgorithm algorithm)
+{
+    switch (algorithm) {
+    case CICHLID_HASH_HMAC_SHA384:
+        return 48;
+    case CICHLID_HASH_HMAC_SHA512:
+        return 64;
+    default:
+        return 32;
+    }
+}
+
+/*!
+ * Overwrite memory in a way the compiler may not optimize away.
+ */
+static void clear_memory(void *p, size_t size)
+{
+    volatile uint8_t *v = p;
+
+    while (size--) {
+        *v++ = 0;
+    }
+}
+
+void cichlid_hash_hmac_key_init(CichlidHashHmacKey *key, CichlidHashHmacAlgorithm algorithm,
+                                const char *key_data, size_t key_size)
+{
+    uint8_t block[MAX_BLOCK_SIZE] = { 0 };
+    size_t  n = block_size(algorithm);
+
+    key->algorithm = algorithm;
+
+    if (key_size > n) {
+        state_init(&key->inner, algorithm);
+        state_update(&key->inner, algorithm, key_data, key_size);
+        state_get_digest(&key->inner, algorithm, block);
+    } else {
+        memcpy(block, key_data, key_size);
+    }
+
+    /* Both pads fill exactly one block, so the states hold no buffered data
+     * and continue directly from the compressed key */
+    for (size_t i = 0; i < n; ++i) {
+        block[i] ^= IPAD;
+    }
+    state_init(&key->inner, algorithm);
+    state_update(&key->inner, algorithm, (const char *)block, n);
+
+    for (size_t i = 0; i < n; ++i) {
+        block[i] ^= IPAD ^ OPAD;
+    }
+    state_init(&key->outer, algorithm);
+    state_update(&key->outer, algorithm, (const char *)block, n);
+
+    clear_memory(block, sizeof(block));
+}
+
+void cichlid_hash_hmac_key_clear(CichlidHashHmacKey *key)
+{
+    clear_memory(key, sizeof(*key));
+}
+
+size_t cichlid_hash_hmac_key_digest_size(const CichlidHashHmacKey *key)
+{
+    return digest_size(key->algorithm);
+}
+
+void cichlid_hash_hmac_init(CichlidHashHmac *self, const CichlidHashHmacKey *key)
+{
+    self->key = key;
+    self->inner = key->inner;
+}
+
+void cichlid_hash_hmac_update(CichlidHashHmac *self, const char *data, size_t data_size)
+{
+    state_update(&self->inner, self->key->algorithm, data, data_size);
+}
+
+size_t cichlid_hash_hmac_get_digest(const CichlidHashHmac *self, uint8_t *digest)
+{
+    CichlidHashHmacAlgorithm algorithm = self->key->algorithm;
+    CichlidHashHmacState     outer = self->key->outer;
+    uint8_t                  inner_digest[CICHLID_HASH_HMAC_MAX_DIGEST_SIZE];
+    size_t                   n = digest_size(algorithm);
+
+    state_get_digest(&self->inner, algorithm, inner_digest);
+    state_update(&outer, algorithm, (const char *)inner_digest, n);
+    state_get_digest(&outer, algorithm, digest);
+
+    return n;
+}
+
+char *cichlid_hash_hmac_get_hash(const CichlidHashHmac *self)
+{
+    char    *hash_string;
+    uint8_t  digest[CICHLID_HASH_HMAC_MAX_DIGEST_SIZE];
+    size_t   n = cichlid_hash_hmac_get_digest(self, digest);
+
+    hash_string = malloc(sizeof(*hash_string) * (2 * n + 1));
+    for (size_t i = 0; i < n; ++i) {
+        sprintf(hash_string + 2 * i, "%.2x", digest[i]);
+    }
+
+    return hash_string;
+}
+
+size_t cichlid_hash_hmac_compute(const CichlidHashHmacKey *key, const char *data, size_t data_size,
+                                 uint8_t *digest)
+{
+    CichlidHashHmac hmac;
+
+    cichlid_hash_hmac_init(&hmac, key);
+    cichlid_hash_hmac_update(&hmac, data, data_size);
+    return cichlid_hash_hmac_get_digest(&hmac, digest);
+}
+
+bool cichlid_hash_hmac_equal(const uint8_t *a, const uint8_t *b, size_t size)
+{
+    volatile uint8_t diff = 0;
+
+    for (size_t i = 0; i < size; ++i) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_hmac.h
+ *
+ * HMAC (RFC 2104) over SHA-256, SHA-384 and SHA-512. A key is processed once
+ * into the compression states following the ipad and opad blocks, which are
+ * then copied for every message.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CICHLID_HASH_HMAC_H
+#define CICHLID_HASH_HMAC_H
+
+#include "cichlid_hash_sha2_32.h"
+#include "cichlid_hash_sha2_64.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CICHLID_HASH_HMAC_MAX_DIGEST_SIZE (64)
+
+typedef enum
+{
+    CICHLID_HASH_HMAC_SHA256,
+    CICHLID_HASH_HMAC_SHA384,
+    CICHLID_HASH_HMAC_SHA512
+} CichlidHashHmacAlgorithm;
+
+typedef union
+{
+    CichlidHashSha2_32 sha2_32;
+    CichlidHashSha2_64 sha2_64;
+} CichlidHashHmacState;
+
+typedef struct CichlidHashHmacKey_ CichlidHashHmacKey;
+struct CichlidHashHmacKey_
+{
+    CichlidHashHmacAlgorithm algorithm;
+    CichlidHashHmacState     inner;
+    CichlidHashHmacState     outer;
+};
+
+typedef struct CichlidHashHmac_ CichlidHashHmac;
+struct CichlidHashHmac_
+{
+    const CichlidHashHmacKey *key;
+    CichlidHashHmacState      inner;
+};
+
+/*!
+ * Precompute the keyed inner and outer states. The key may be reused for any
+ * number of messages and from several threads at once.
+ * \param key Key instance to initialize
+ * \param algorithm Underlying hash function
+ * \param key_data Secret key, hashed first if longer than the block size
+ * \param key_size Size of the secret key in bytes
+ */
+void cichlid_hash_hmac_key_init(CichlidHashHmacKey *key, CichlidHashHmacAlgorithm algorithm,
+                                const char *key_data, size_t key_size);
+/*!
+ * Clear the secret key material from a key instance.
+ * \param key Key instance
+ */
+void cichlid_hash_hmac_key_clear(CichlidHashHmacKey *key);
+/*!
+ * \returns The size in bytes of the MACs produced with the key
+ */
+size_t cichlid_hash_hmac_key_digest_size(const CichlidHashHmacKey *key);
+/*!
+ * Initialize or reinitialize a MAC calculation for a new message.
+ * \param self MAC calculator instance
+ * \param key Precomputed key, must outlive the calculator
+ */
+void cichlid_hash_hmac_init(CichlidHashHmac *self, const CichlidHashHmacKey *key);
+/*!
+ * Update the calculator with new data
+ * \param self MAC calculator instance
+ * \param data Pointer to data stream
+ * \param data_size Size of available data
+ */
+void cichlid_hash_hmac_update(CichlidHashHmac *self, const char *data, size_t data_size);
+/*!
+ * Retrieve the current MAC as raw bytes.
+ * \param self MAC calculator instance
+ * \param digest Buffer of at least cichlid_hash_hmac_key_digest_size() bytes
+ * \returns The number of bytes written
+ */
+size_t cichlid_hash_hmac_get_digest(const CichlidHashHmac *self, uint8_t *digest);
+/*!
+ * Retrieve current MAC.
+ * \returns A null-terminated string containing the MAC
+ */
+char *cichlid_hash_hmac_get_hash(const CichlidHashHmac *self);
+/*!
+ * Calculate the MAC of a complete message.
+ * \returns The number of bytes written to digest
+ */
+size_t cichlid_hash_hmac_compute(const CichlidHashHmacKey *key, const char *data, size_t data_size,
+                                 uint8_t *digest);
+/*!
+ * Compare two digests in time independent of their contents.
+ * \returns true if the digests are equal
+ */
+bool cichlid_hash_hmac_equal(const uint8_t *a, const uint8_t *b, size_t size);
+
+#endif /* CICHLID_HASH_HMAC_H */
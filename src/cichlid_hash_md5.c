@@ -84,15 +84,19 @@ void cichlid_hash_md5_update(CichlidHashMd5 *self, const char *data, size_t data
         memcpy(self->data_left + self->data_left_size, data, data_size);
         self->data_left_size += data_size;
     } else {
-        /* If there is data left since the previous update */
-        char buf[64];
-        size_t new_data_left_size = (data_size + self->data_left_size) % 64;
+        /* If there is data left since the previous update, complete its block
+         * and continue with the rest of the new data */
+        char   buf[64];
+        size_t fill_size = 64 - self->data_left_size;
         memcpy(buf, self->data_left, self->data_left_size);
-        memcpy(buf + self->data_left_size, data, data_size - new_data_left_size);
-        memcpy(self->data_left, data + data_size - new_data_left_size, new_data_left_size);
+        memcpy(buf + self->data_left_size, data, fill_size);
+        calculate(self->h, buf, 64);
 
-        calculate(self->h, buf, data_size + self->data_left_size - new_data_left_size);
-        self->data_left_size = (uint8_t)new_data_left_size;
+        data += fill_size;
+        data_size -= fill_size;
+        self->data_left_size = (uint8_t)(data_size % 64);
+        memcpy(self->data_left, data + data_size - self->data_left_size, self->data_left_size);
+        calculate(self->h, data, data_size - self->data_left_size);
     }
 }
 
@@ -108,6 +112,16 @@ char *cichlid_hash_md5_get_hash(const CichlidHashMd5 *self)
     return hash_string;
 }
 
+void cichlid_hash_md5_get_digest(const CichlidHashMd5 *self, uint8_t *digest)
+{
+    uint32_t hash[4];
+
+    finalize(self, hash);
+    for (int i = 0; i < 16; ++i) {
+        digest[i] = (uint8_t)(hash[i / 4] >> (8 * (i % 4)));
+    }
+}
+
 static void calculate(uint32_t hash[4], const char *buf, size_t bytes_read)
 {
     uint32_t a, b, c, d, f, g, tmp, *w;
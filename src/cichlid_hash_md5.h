@@ -39,5 +39,11 @@ struct _CichlidHashMd5
 void cichlid_hash_md5_init(CichlidHashMd5 *self);
 void cichlid_hash_md5_update(CichlidHashMd5 *self, const char *data, size_t data_size);
 char *cichlid_hash_md5_get_hash(const CichlidHashMd5 *self);
+/*!
+ * Retrieve the current hash as raw bytes.
+ * \param self Hash calculator instance
+ * \param digest Buffer of at least 16 bytes
+ */
+void cichlid_hash_md5_get_digest(const CichlidHashMd5 *self, uint8_t *digest);
 
 #endif /* CICHLID_HASH_MD5_H */
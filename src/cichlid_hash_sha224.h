@@ -31,5 +31,14 @@ typedef CichlidHashSha2_32 CichlidHashSha224;
 void cichlid_hash_sha224_init(CichlidHashSha224 *self);
 void cichlid_hash_sha224_update(CichlidHashSha224 *self, const char *data, size_t data_size);
 char *cichlid_hash_sha224_get_hash(CichlidHashSha224 *self);
+/*!
+ * Calculate the SHA-224 hash of a complete message.
+ * \param digest Receives the 28 byte hash
+ */
+void cichlid_sha224(const char *data, size_t data_size, uint8_t *digest);
+/*!
+ * Calculate the SHA-224 hashes of a number of complete messages.
+ */
+void cichlid_sha224_batch(const CichlidHashBatchItem *items, size_t n_items);
 
 #endif /* CICHLID_HASH_SHA224_H */
@@ -46,3 +46,12 @@ char *cichlid_hash_sha256_get_hash(CichlidHashSha256 *self)
     return cichlid_hash_sha2_32_get_hash(self);
 }
 
+void cichlid_sha256(const char *data, size_t data_size, uint8_t *digest)
+{
+    cichlid_hash_sha2_32_digest(h0, SHA256_HASH_LENGTH, data, data_size, digest);
+}
+
+void cichlid_sha256_batch(const CichlidHashBatchItem *items, size_t n_items)
+{
+    cichlid_hash_sha2_32_digest_batch(h0, SHA256_HASH_LENGTH, items, n_items);
+}
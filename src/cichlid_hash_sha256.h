@@ -31,5 +31,14 @@ typedef CichlidHashSha2_32 CichlidHashSha256;
 void cichlid_hash_sha256_init(CichlidHashSha256 *self);
 void cichlid_hash_sha256_update(CichlidHashSha256 *self, const char *data, size_t data_size);
 char *cichlid_hash_sha256_get_hash(CichlidHashSha256 *self);
+/*!
+ * Calculate the SHA-256 hash of a complete message.
+ * \param digest Receives the 32 byte hash
+ */
+void cichlid_sha256(const char *data, size_t data_size, uint8_t *digest);
+/*!
+ * Calculate the SHA-256 hashes of a number of complete messages.
+ */
+void cichlid_sha256_batch(const CichlidHashBatchItem *items, size_t n_items);
 
 #endif /* CICHLID_HASH_SHA256_H */
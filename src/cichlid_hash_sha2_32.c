@@ -27,6 +27,17 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SHA2_32_X86_SIMD
+#include <immintrin.h>
+#define TARGET_SHA __attribute__((target("sha,sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#define BLOCK_SIZE (64)
+/* Messages hashed side by side by the AVX2 batch implementation */
+#define N_LANES (8)
+
 /*!
  * \param[in,out] hash Current hash state, is updated by the function.
  * \param         data New date to process.
@@ -56,6 +67,43 @@ static const uint32_t k[64] = {
     0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
 };
 
+static inline uint32_t read_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline void write_be32(uint8_t *p, uint32_t x)
+{
+    p[0] = (uint8_t)(x >> 24);
+    p[1] = (uint8_t)(x >> 16);
+    p[2] = (uint8_t)(x >> 8);
+    p[3] = (uint8_t)x;
+}
+
+/*!
+ * Write the padding of a message, i.e. the bytes left after its last complete
+ * block, the trailing 1 and the size in bits.
+ * \param buf Buffer of two blocks, must be zeroed
+ * \returns The number of bytes of padded data, one or two blocks
+ */
+static size_t pad(uint8_t buf[2 * BLOCK_SIZE], const uint8_t *data_left, size_t data_left_size, uint64_t total_size)
+{
+    size_t size_offset = data_left_size < 56 ? 56 : 64 + 56;
+
+    memcpy(buf, data_left, data_left_size);
+    buf[data_left_size] = 0x80;
+    write_be32(buf + size_offset, (uint32_t)(total_size >> 29));
+    write_be32(buf + size_offset + 4, (uint32_t)(total_size << 3));
+    return size_offset + 8;
+}
+
+static void write_digest(uint8_t *digest, const uint32_t hash[8], uint32_t hash_length)
+{
+    for (size_t i = 0; i < hash_length / 8; ++i) {
+        write_be32(digest + 4 * i, hash[i]);
+    }
+}
+
 void cichlid_hash_sha2_32_init(CichlidHashSha2_32 *self, const uint32_t *h0, uint32_t hash_length)
 {
     self->total_size = 0;
@@ -80,6 +128,14 @@ char *cichlid_hash_sha2_32_get_hash(const CichlidHashSha2_32 *self)
     return hash_string;
 }
 
+void cichlid_hash_sha2_32_get_digest(const CichlidHashSha2_32 *self, uint8_t *digest)
+{
+    uint32_t hash[8];
+
+    finalize(self, hash);
+    write_digest(digest, hash, self->hash_size);
+}
+
 void cichlid_hash_sha2_32_update(CichlidHashSha2_32 *self, const char *data, size_t data_size)
 {
     char    *buf = NULL;
@@ -115,14 +171,30 @@ void cichlid_hash_sha2_32_update(CichlidHashSha2_32 *self, const char *data, siz
     }
 }
 
-static void calculate(uint32_t *hash, const char *data, size_t bytes_read)
+void cichlid_hash_sha2_32_digest(const uint32_t *h0, uint32_t hash_length, const char *data, size_t data_size,
+                                 uint8_t *digest)
+{
+    uint8_t  buf[2 * BLOCK_SIZE] = { 0 };
+    size_t   full_size = data_size - data_size % BLOCK_SIZE;
+    uint32_t hash[8];
+
+    memcpy(hash, h0, sizeof(hash));
+    calculate(hash, data, full_size);
+    calculate(hash, (const char *)buf,
+              pad(buf, (const uint8_t *)data + full_size, data_size - full_size, data_size));
+    write_digest(digest, hash, hash_length);
+}
+
+static void calculate_portable(uint32_t *hash, const uint8_t *data, size_t n_blocks)
 {
     uint32_t a, b, c, d, e, f, g, h, t1, t2;
     uint32_t w[64];
 
     /* Process data in 512-bit chunks */
-    for (int j = 0; j < bytes_read/64; j++) {
-        cichlid_change_endianness_32(w, (uint32_t *)&data[j * 64], 16);
+    for (size_t j = 0; j < n_blocks; j++) {
+        for (int i = 0; i < 16; i++) {
+            w[i] = read_be32(data + j * 64 + i * 4);
+        }
 
         /* Extend w to contain 64 uint32_t */
         for (int i = 16; i < 64; i++) {
@@ -166,31 +238,225 @@ static void calculate(uint32_t *hash, const char *data, size_t bytes_read)
     }
 }
 
-static void finalize(const CichlidHashSha2_32 *self, uint32_t hash[8])
+#ifdef SHA2_32_X86_SIMD
+
+/*!
+ * Compression using the SHA extensions, which keep the state as the word
+ * pairs ABEF and CDGH and perform two rounds per sha256rnds2.
+ */
+TARGET_SHA static void calculate_sha_ni(uint32_t *hash, const uint8_t *data, size_t n_blocks)
 {
-    char      buf[sizeof(char) * 64 * 2] = { 0,};
-    size_t    size_offset;
-    char     *total_size_p;
-    uint64_t  total_size;
+    const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+    __m128i       state0, state1, tmp;
+
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(const void *)hash), 0xB1);
+    state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(const void *)(hash + 4)), 0x1B);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; n_blocks > 0; --n_blocks, data += BLOCK_SIZE) {
+        const __m128i abef = state0;
+        const __m128i cdgh = state1;
+        __m128i       w[4];
+
+        for (int i = 0; i < 16; ++i) {
+            __m128i msg;
+
+            if (i < 4) {
+                w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(const void *)(data + 16 * i)), byte_swap);
+            } else {
+                /* w[i & 3] holds the words 16 rounds back, the others follow */
+                msg = _mm_add_epi32(_mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]),
+                                    _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4));
+                w[i & 3] = _mm_sha256msg2_epu32(msg, w[(i + 3) & 3]);
+            }
+            msg = _mm_add_epi32(w[i & 3], _mm_loadu_si128((const __m128i *)(const void *)(k + 4 * i)));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+        }
 
-    /* Populate hash with the current state */
-    memcpy(hash, self->h, sizeof(*hash) * 8);
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
 
-    if (self->data_left_size < 56) {
-        size_offset = 56;
-    } else {
-        size_offset = 64 + 56;
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128((__m128i *)(void *)hash, state0);
+    _mm_storeu_si128((__m128i *)(void *)(hash + 4), state1);
+}
+
+TARGET_AVX2 static inline __m256i ror_avx2(__m256i x, int n)
+{
+    return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+/*!
+ * Compress one block of each of N_LANES messages, lane l of every state word
+ * belonging to the message whose current block is blocks[l].
+ */
+TARGET_AVX2 static void calculate_avx2_x8(uint32_t state[8][N_LANES], const uint8_t *const blocks[N_LANES])
+{
+    const __m256i byte_swap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                               3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    __m256i       w[16];
+    __m256i       s[8], v[8];
+
+    for (int i = 0; i < 8; ++i) {
+        s[i] = v[i] = _mm256_loadu_si256((const __m256i *)(const void *)state[i]);
+    }
+
+    for (int i = 0; i < 64; ++i) {
+        __m256i t1, t2, wi;
+
+        if (i < 16) {
+            uint32_t words[N_LANES];
+            for (int l = 0; l < N_LANES; ++l) {
+                memcpy(&words[l], blocks[l] + 4 * i, sizeof(words[l]));
+            }
+            wi = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(const void *)words), byte_swap);
+        } else {
+            __m256i w15 = w[(i - 15) & 15], w2 = w[(i - 2) & 15];
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(ror_avx2(w15, 7), ror_avx2(w15, 18)),
+                                          _mm256_srli_epi32(w15, 3));
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(ror_avx2(w2, 17), ror_avx2(w2, 19)),
+                                          _mm256_srli_epi32(w2, 10));
+            wi = _mm256_add_epi32(_mm256_add_epi32(w[i & 15], s0), _mm256_add_epi32(w[(i - 7) & 15], s1));
+        }
+        w[i & 15] = wi;
+
+        /* v[0..7] = a..h */
+        t1 = _mm256_add_epi32(v[7], _mm256_xor_si256(_mm256_xor_si256(ror_avx2(v[4], 6), ror_avx2(v[4], 11)),
+                                                     ror_avx2(v[4], 25)));
+        t1 = _mm256_add_epi32(t1, _mm256_xor_si256(_mm256_and_si256(v[4], v[5]), _mm256_andnot_si256(v[4], v[6])));
+        t1 = _mm256_add_epi32(t1, _mm256_add_epi32(_mm256_set1_epi32((int)k[i]), wi));
+        t2 = _mm256_xor_si256(_mm256_xor_si256(ror_avx2(v[0], 2), ror_avx2(v[0], 13)), ror_avx2(v[0], 22));
+        t2 = _mm256_add_epi32(t2, _mm256_or_si256(_mm256_and_si256(v[0], v[1]),
+                                                  _mm256_and_si256(v[2], _mm256_or_si256(v[0], v[1]))));
+        v[7] = v[6];
+        v[6] = v[5];
+        v[5] = v[4];
+        v[4] = _mm256_add_epi32(v[3], t1);
+        v[3] = v[2];
+        v[2] = v[1];
+        v[1] = v[0];
+        v[0] = _mm256_add_epi32(t1, t2);
+    }
+
+    for (int i = 0; i < 8; ++i) {
+        _mm256_storeu_si256((__m256i *)(void *)state[i], _mm256_add_epi32(s[i], v[i]));
+    }
+}
+
+/*!
+ * Hash the messages N_LANES at a time. Every lane walks through the complete
+ * blocks of its message followed by the padded tail, and takes the next
+ * message as soon as it is done, so messages of different sizes share lanes
+ * well. Idle lanes compress a dummy block whose result is ignored.
+ */
+TARGET_AVX2 static void digest_batch_avx2(const uint32_t *h0, uint32_t hash_length,
+                                          const CichlidHashBatchItem *items, size_t n_items)
+{
+    static const uint8_t dummy[BLOCK_SIZE];
+    uint32_t             state[8][N_LANES];
+    uint8_t              tails[N_LANES][2 * BLOCK_SIZE];
+    const uint8_t       *blocks[N_LANES];
+    size_t               lane_item[N_LANES];
+    size_t               n_full[N_LANES];
+    size_t               n_blocks[N_LANES];
+    size_t               block[N_LANES];
+    size_t               next_item = 0;
+    size_t               n_active = 0;
+
+    for (int l = 0; l < N_LANES; ++l) {
+        lane_item[l] = n_items;
+    }
+
+    for (;;) {
+        /* Assign messages to idle lanes */
+        for (int l = 0; l < N_LANES; ++l) {
+            if (lane_item[l] == n_items && next_item < n_items) {
+                const CichlidHashBatchItem *item = &items[next_item];
+                size_t                      full_size = item->data_size - item->data_size % BLOCK_SIZE;
+
+                memset(tails[l], 0, sizeof(tails[l]));
+                n_full[l] = full_size / BLOCK_SIZE;
+                n_blocks[l] = n_full[l] + pad(tails[l], (const uint8_t *)item->data + full_size,
+                                              item->data_size - full_size, item->data_size) / BLOCK_SIZE;
+                block[l] = 0;
+                for (int i = 0; i < 8; ++i) {
+                    state[i][l] = h0[i];
+                }
+                lane_item[l] = next_item++;
+                ++n_active;
+            }
+        }
+        if (!n_active) {
+            break;
+        }
+
+        for (int l = 0; l < N_LANES; ++l) {
+            if (lane_item[l] == n_items) {
+                blocks[l] = dummy;
+            } else if (block[l] < n_full[l]) {
+                blocks[l] = (const uint8_t *)items[lane_item[l]].data + block[l] * BLOCK_SIZE;
+            } else {
+                blocks[l] = tails[l] + (block[l] - n_full[l]) * BLOCK_SIZE;
+            }
+        }
+        calculate_avx2_x8(state, blocks);
+
+        /* Retire finished messages */
+        for (int l = 0; l < N_LANES; ++l) {
+            if (lane_item[l] != n_items && ++block[l] == n_blocks[l]) {
+                uint32_t hash[8];
+                for (int i = 0; i < 8; ++i) {
+                    hash[i] = state[i][l];
+                }
+                write_digest(items[lane_item[l]].digest, hash, hash_length);
+                lane_item[l] = n_items;
+                --n_active;
+            }
+        }
+    }
+}
+
+#endif /* SHA2_32_X86_SIMD */
+
+void cichlid_hash_sha2_32_digest_batch(const uint32_t *h0, uint32_t hash_length,
+                                       const CichlidHashBatchItem *items, size_t n_items)
+{
+#ifdef SHA2_32_X86_SIMD
+    /* A single SHA-NI stream is faster than eight AVX2 lanes */
+    if (!__builtin_cpu_supports("sha") && __builtin_cpu_supports("avx2")) {
+        digest_batch_avx2(h0, hash_length, items, n_items);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n_items; ++i) {
+        cichlid_hash_sha2_32_digest(h0, hash_length, items[i].data, items[i].data_size, items[i].digest);
     }
+}
+
+static void calculate(uint32_t hash[8], const char *data, size_t bytes_read)
+{
+#ifdef SHA2_32_X86_SIMD
+    if (__builtin_cpu_supports("sha")) {
+        calculate_sha_ni(hash, (const uint8_t *)data, bytes_read / BLOCK_SIZE);
+        return;
+    }
+#endif
+    calculate_portable(hash, (const uint8_t *)data, bytes_read / BLOCK_SIZE);
+}
 
-    /* Copy the data that is left, the ending 1 and the size to the buffer */
-    memcpy(buf, self->data_left, self->data_left_size);
-    buf[self->data_left_size] = -0x80;       /* Signed char          */
-    total_size = self->total_size * 8; /* Convert size to bits */
+static void finalize(const CichlidHashSha2_32 *self, uint32_t hash[8])
+{
+    uint8_t buf[2 * BLOCK_SIZE] = { 0 };
 
-    total_size_p = (char *)&total_size;
-    cichlid_change_endianness_32((uint32_t *)&buf[size_offset], (uint32_t *)(total_size_p + 4), 1);
-    cichlid_change_endianness_32((uint32_t *)&buf[size_offset + 4], (uint32_t *)(total_size_p), 1);
-    calculate(hash, buf, size_offset + 8);
+    /* Populate hash with the current state */
+    memcpy(hash, self->h, sizeof(*hash) * 8);
+    calculate(hash, (const char *)buf, pad(buf, self->data_left, self->data_left_size, self->total_size));
 }
 
 /**
@@ -23,6 +23,7 @@
 #ifndef CICHLID_HASH_SHA2_32_H
 #define CICHLID_HASH_SHA2_32_H
 
+#include "cichlid_hash_batch.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -44,5 +45,25 @@ struct CichlidHashSha2_32_
 void cichlid_hash_sha2_32_init(CichlidHashSha2_32 *self, const uint32_t *h0, uint32_t hash_length);
 void cichlid_hash_sha2_32_update(CichlidHashSha2_32 *self, const char *data, size_t data_size);
 char *cichlid_hash_sha2_32_get_hash(const CichlidHashSha2_32 *self);
+/*!
+ * Retrieve the current hash as raw big-endian bytes.
+ * \param self Hash calculator instance
+ * \param digest Buffer of at least hash_size / 2 bytes
+ */
+void cichlid_hash_sha2_32_get_digest(const CichlidHashSha2_32 *self, uint8_t *digest);
+/*!
+ * Hash a complete message in one call, building the padding directly from the
+ * end of the message.
+ * \param h0 Initial hash value
+ * \param hash_length Length of the hash in hexadecimal digits
+ * \param digest Receives hash_length / 2 bytes
+ */
+void cichlid_hash_sha2_32_digest(const uint32_t *h0, uint32_t hash_length, const char *data, size_t data_size,
+                                 uint8_t *digest);
+/*!
+ * Hash a number of complete messages in one call.
+ */
+void cichlid_hash_sha2_32_digest_batch(const uint32_t *h0, uint32_t hash_length,
+                                       const CichlidHashBatchItem *items, size_t n_items);
 
 #endif /* CICHLID_HASH_SHA2_32_H */
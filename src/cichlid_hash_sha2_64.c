@@ -3,9 +3,9 @@
  *
  * cichlid - cichlid_hash_sha2_64.c
  *
- * Implementation of the calculation of 64-bit SHA-2 hashes (SHA384 and SHA512)
- * as defined in FIPS 180-2, with the limitation that the message can at most be
- * 2^64-1 bit (instead of the standard's 2^128-1 bit).
+ * Implementation of the calculation of 64-bit SHA-2 hashes (SHA384, SHA512,
+ * SHA512/224 and SHA512/256) as defined in FIPS 180-4, with the limitation that
+ * the message can at most be 2^64-1 bit (instead of the standard's 2^128-1 bit).
  *
  * cichlid is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -22,11 +22,14 @@
  */
 #include "cichlid_hash_sha2_64.h"
 #include "cichlid_hash_common.h"
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define BLOCK_SIZE (128)
+
 /*!
  * \param[in,out] hash Current hash state, is updated by the function.
  * \param         data New date to process.
@@ -68,6 +71,50 @@ static const uint64_t k[80] = {
     0x4cc5d4becb3e42b6, 0x597f299cfc657e2a, 0x5fcb6fab3ad6faec, 0x6c44198c4a475817
 };
 
+static inline uint64_t read_be64(const uint8_t *p)
+{
+    uint64_t x = 0;
+    for (int i = 0; i < 8; ++i) {
+        x = (x << 8) | p[i];
+    }
+    return x;
+}
+
+static inline void write_be64(uint8_t *p, uint64_t x)
+{
+    for (int i = 7; i >= 0; --i) {
+        p[i] = (uint8_t)x;
+        x >>= 8;
+    }
+}
+
+/*!
+ * Write the padding of a message, i.e. the bytes left after its last complete
+ * block, the trailing 1 and the size in bits.
+ * \param buf Buffer of two blocks, must be zeroed
+ * \returns The number of bytes of padded data, one or two blocks
+ */
+static size_t pad(uint8_t buf[2 * BLOCK_SIZE], const uint8_t *data_left, size_t data_left_size, uint64_t total_size)
+{
+    size_t size_offset = data_left_size < 112 ? 112 : 128 + 112;
+
+    memcpy(buf, data_left, data_left_size);
+    buf[data_left_size] = 0x80;
+    /* FIXME: Will overflow for sizes larger than 2^64-1 bits but the algorithm
+     *        supports sizes up to 2^128-1 bits */
+    write_be64(buf + size_offset, total_size >> 61);
+    write_be64(buf + size_offset + 8, total_size << 3);
+    return size_offset + 16;
+}
+
+static void write_digest(uint8_t *digest, const uint64_t hash[8], uint64_t hash_length)
+{
+    /* SHA-512/224 does not end on a word boundary */
+    for (size_t i = 0; i < hash_length / 2; ++i) {
+        digest[i] = (uint8_t)(hash[i / 8] >> (56 - 8 * (i % 8)));
+    }
+}
+
 void cichlid_hash_sha2_64_init(CichlidHashSha2_64 *self, const uint64_t *h0, uint64_t hash_length)
 {
     self->total_size = 0;
@@ -81,15 +128,27 @@ void cichlid_hash_sha2_64_init(CichlidHashSha2_64 *self, const uint64_t *h0, uin
 char *cichlid_hash_sha2_64_get_hash(CichlidHashSha2_64 *self)
 {
     char *hash_string;
+    char full_hash_string[CICHLID_HASH_SHA2_64_HASH_SIZE + 1];
     uint64_t hash[8];
     finalize(self, hash);
-    hash_string = malloc(sizeof(*hash_string) * (self->hash_size + 1));
-    for (int i = 0; i < self->hash_size / 16; ++i) {
-        sprintf(hash_string + 16 * i, "%.16llx", hash[i]);
+    for (int i = 0; i < CICHLID_HASH_SHA2_64_N_WORDS; ++i) {
+        sprintf(full_hash_string + 16 * i, "%.16" PRIx64, hash[i]);
     }
+    /* Truncate, SHA-512/224 does not end on a word boundary */
+    hash_string = malloc(sizeof(*hash_string) * (self->hash_size + 1));
+    memcpy(hash_string, full_hash_string, self->hash_size);
+    hash_string[self->hash_size] = '\0';
     return hash_string;
 }
 
+void cichlid_hash_sha2_64_get_digest(const CichlidHashSha2_64 *self, uint8_t *digest)
+{
+    uint64_t hash[8];
+
+    finalize(self, hash);
+    write_digest(digest, hash, self->hash_size);
+}
+
 void cichlid_hash_sha2_64_update(CichlidHashSha2_64 *self, const char *data, size_t data_size)
 {
     if (data_size == 0) {
@@ -123,6 +182,28 @@ void cichlid_hash_sha2_64_update(CichlidHashSha2_64 *self, const char *data, siz
     }
 }
 
+void cichlid_hash_sha2_64_digest(const uint64_t *h0, uint64_t hash_length, const char *data, size_t data_size,
+                                 uint8_t *digest)
+{
+    uint8_t  buf[2 * BLOCK_SIZE] = { 0 };
+    size_t   full_size = data_size - data_size % BLOCK_SIZE;
+    uint64_t hash[8];
+
+    memcpy(hash, h0, sizeof(hash));
+    calculate(hash, data, full_size);
+    calculate(hash, (const char *)buf,
+              pad(buf, (const uint8_t *)data + full_size, data_size - full_size, data_size));
+    write_digest(digest, hash, hash_length);
+}
+
+void cichlid_hash_sha2_64_digest_batch(const uint64_t *h0, uint64_t hash_length,
+                                       const CichlidHashBatchItem *items, size_t n_items)
+{
+    for (size_t i = 0; i < n_items; ++i) {
+        cichlid_hash_sha2_64_digest(h0, hash_length, items[i].data, items[i].data_size, items[i].digest);
+    }
+}
+
 static void calculate(uint64_t hash[8], const char *data, size_t bytes_read)
 {
     uint64_t a, b, c, d, e, f, g, h, t1, t2;
@@ -130,7 +211,9 @@ static void calculate(uint64_t hash[8], const char *data, size_t bytes_read)
 
     /* Process data in 1024-bit chunks */
     for (int j = 0; j < bytes_read/128; j++) {
-        cichlid_change_endianness_64(w, (uint64_t*)(data+j*128), 16);
+        for (int i = 0; i < 16; i++) {
+            w[i] = read_be64((const uint8_t *)data + j * 128 + i * 8);
+        }
 
         /* Extend w to contain 80 uint64_t */
         for (int i = 16; i < 80; i++) {
@@ -176,27 +259,11 @@ static void calculate(uint64_t hash[8], const char *data, size_t bytes_read)
 
 static void finalize(const CichlidHashSha2_64 *self, uint64_t hash[8])
 {
-    char     buf[sizeof(char) * 64 * 4] = { 0,};
-    size_t   size_offset;
-    uint64_t total_size_bits;
+    uint8_t buf[2 * BLOCK_SIZE] = { 0 };
 
     /* Populate hash with the current state */
     memcpy(hash, self->h, sizeof(*hash) * 8);
-
-    if (self->data_left_size < 112) {
-        size_offset = 112;
-    } else {
-        size_offset = 128 + 112;
-    }
-
-    /* Copy the data that is left, the ending 1 and the size to the buffer */
-    memcpy(buf, self->data_left, self->data_left_size);
-    buf[self->data_left_size] = -0x80; /* Trailing '1'-bit */
-    /* FIXME: Will overflow for sizes larger than 2^64-1 bits but the algorithm
-     *        supports sizes up to 2^128-1 bits */
-    total_size_bits = self->total_size * 8; /* Convert size to bits */
-    cichlid_change_endianness_64((uint64_t *)&buf[size_offset + 8], &total_size_bits, 1);
-    calculate(hash, buf, size_offset + 16);
+    calculate(hash, (const char *)buf, pad(buf, self->data_left, self->data_left_size, self->total_size));
 }
 
 static inline uint64_t Ch(uint64_t x, uint64_t y, uint64_t z)
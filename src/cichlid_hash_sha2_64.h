@@ -3,9 +3,9 @@
  *
  * cichlid - cichlid_hash_sha2_64.h
  *
- * Implementation of the calculation of 64-bit SHA-2 hashes (SHA384 and SHA512)
- * as defined in FIPS 180-2, with the limitation that the message can at most be
- * 2^64-1 bit (instead of the standard's 2^128-1 bit).
+ * Implementation of the calculation of 64-bit SHA-2 hashes (SHA384, SHA512,
+ * SHA512/224 and SHA512/256) as defined in FIPS 180-4, with the limitation that
+ * the message can at most be 2^64-1 bit (instead of the standard's 2^128-1 bit).
  *
  * cichlid is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -24,6 +24,7 @@
 #ifndef CICHLID_HASH_SHA2_64_H
 #define CICHLID_HASH_SHA2_64_H
 
+#include "cichlid_hash_batch.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -45,6 +46,26 @@ struct CichlidHashSha2_64_
 void cichlid_hash_sha2_64_init(CichlidHashSha2_64 *self, const uint64_t *h0, uint64_t hash_length);
 void cichlid_hash_sha2_64_update(CichlidHashSha2_64 *self, const char *data, size_t data_size);
 char *cichlid_hash_sha2_64_get_hash(CichlidHashSha2_64 *self);
+/*!
+ * Retrieve the current hash as raw big-endian bytes.
+ * \param self Hash calculator instance
+ * \param digest Buffer of at least hash_size / 2 bytes
+ */
+void cichlid_hash_sha2_64_get_digest(const CichlidHashSha2_64 *self, uint8_t *digest);
+/*!
+ * Hash a complete message in one call, building the padding directly from the
+ * end of the message.
+ * \param h0 Initial hash value
+ * \param hash_length Length of the hash in hexadecimal digits
+ * \param digest Receives hash_length / 2 bytes
+ */
+void cichlid_hash_sha2_64_digest(const uint64_t *h0, uint64_t hash_length, const char *data, size_t data_size,
+                                 uint8_t *digest);
+/*!
+ * Hash a number of complete messages in one call.
+ */
+void cichlid_hash_sha2_64_digest_batch(const uint64_t *h0, uint64_t hash_length,
+                                       const CichlidHashBatchItem *items, size_t n_items);
 
 #endif /* CICHLID_HASH_SHA2_64_H */
 
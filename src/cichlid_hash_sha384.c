@@ -47,3 +47,12 @@ char *cichlid_hash_sha384_get_hash(CichlidHashSha384 *self)
     return cichlid_hash_sha2_64_get_hash(self);
 }
 
+void cichlid_sha384(const char *data, size_t data_size, uint8_t *digest)
+{
+    cichlid_hash_sha2_64_digest(h0, SHA384_HASH_LENGTH, data, data_size, digest);
+}
+
+void cichlid_sha384_batch(const CichlidHashBatchItem *items, size_t n_items)
+{
+    cichlid_hash_sha2_64_digest_batch(h0, SHA384_HASH_LENGTH, items, n_items);
+}
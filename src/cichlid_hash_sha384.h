@@ -45,5 +45,14 @@ void cichlid_hash_sha384_update(CichlidHashSha384 *self, const char *data, size_
  * \returns A null-terminated string containing the hash
  */
 char *cichlid_hash_sha384_get_hash(CichlidHashSha384 *self);
+/*!
+ * Calculate the SHA-384 hash of a complete message.
+ * \param digest Receives the 48 byte hash
+ */
+void cichlid_sha384(const char *data, size_t data_size, uint8_t *digest);
+/*!
+ * Calculate the SHA-384 hashes of a number of complete messages.
+ */
+void cichlid_sha384_batch(const CichlidHashBatchItem *items, size_t n_items);
 
 #endif /* CICHLID_HASH_SHA384_H */
@@ -45,5 +45,14 @@ void cichlid_hash_sha512_update(CichlidHashSha512 *self, const char *data, size_
  * \returns A null-terminated string containing the hash
  */
 char *cichlid_hash_sha512_get_hash(CichlidHashSha512 *self);
+/*!
+ * Calculate the SHA-512 hash of a complete message.
+ * \param digest Receives the 64 byte hash
+ */
+void cichlid_sha512(const char *data, size_t data_size, uint8_t *digest);
+/*!
+ * Calculate the SHA-512 hashes of a number of complete messages.
+ */
+void cichlid_sha512_batch(const CichlidHashBatchItem *items, size_t n_items);
 
 #endif /* CICHLID_HASH_SHA512_H */
@@ -0,0 +1,58 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_sha512_224.c
+ *
+ * SHA512/224 algorithm implemented according to FIPS 180-4
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "cichlid_hash_sha512_224.h"
+#include "cichlid_hash_sha2_64.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SHA512_224_HASH_LENGTH 56
+
+static uint64_t h0[8] = {
+    0x8c3d37c819544da2, 0x73e1996689dcd4d6, 0x1dfab7ae32ff9c82, 0x679dd514582f9fcf,
+    0x0f6d2b697bd44da8, 0x77e36f7304c48942, 0x3f9d85a86a1d36c8, 0x1112e6ad91d692a1
+};
+
+void cichlid_hash_sha512_224_init(CichlidHashSha512_224 *self)
+{
+    cichlid_hash_sha2_64_init(self, h0, SHA512_224_HASH_LENGTH);
+}
+
+void cichlid_hash_sha512_224_update(CichlidHashSha512_224 *self, const char *data, size_t data_size)
+{
+    cichlid_hash_sha2_64_update(self, data, data_size);
+}
+
+char *cichlid_hash_sha512_224_get_hash(CichlidHashSha512_224 *self)
+{
+    return cichlid_hash_sha2_64_get_hash(self);
+}
+
+void cichlid_sha512_224(const char *data, size_t data_size, uint8_t *digest)
+{
+    cichlid_hash_sha2_64_digest(h0, SHA512_224_HASH_LENGTH, data, data_size, digest);
+}
+
+void cichlid_sha512_224_batch(const CichlidHashBatchItem *items, size_t n_items)
+{
+    cichlid_hash_sha2_64_digest_batch(h0, SHA512_224_HASH_LENGTH, items, n_items);
+}
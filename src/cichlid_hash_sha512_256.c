@@ -0,0 +1,58 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_sha512_256.c
+ *
+ * SHA512/256 algorithm implemented according to FIPS 180-4
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "cichlid_hash_sha512_256.h"
+#include "cichlid_hash_sha2_64.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SHA512_256_HASH_LENGTH 64
+
+static uint64_t h0[8] = {
+    0x22312194fc2bf72c, 0x9f555fa3c84c64c2, 0x2393b86b6f53b151, 0x963877195940eabd,
+    0x96283ee2a88effe3, 0xbe5e1e2553863992, 0x2b0199fc2c85b8aa, 0x0eb72ddc81c52ca2
+};
+
+void cichlid_hash_sha512_256_init(CichlidHashSha512_256 *self)
+{
+    cichlid_hash_sha2_64_init(self, h0, SHA512_256_HASH_LENGTH);
+}
+
+void cichlid_hash_sha512_256_update(CichlidHashSha512_256 *self, const char *data, size_t data_size)
+{
+    cichlid_hash_sha2_64_update(self, data, data_size);
+}
+
+char *cichlid_hash_sha512_256_get_hash(CichlidHashSha512_256 *self)
+{
+    return cichlid_hash_sha2_64_get_hash(self);
+}
+
+void cichlid_sha512_256(const char *data, size_t data_size, uint8_t *digest)
+{
+    cichlid_hash_sha2_64_digest(h0, SHA512_256_HASH_LENGTH, data, data_size, digest);
+}
+
+void cichlid_sha512_256_batch(const CichlidHashBatchItem *items, size_t n_items)
+{
+    cichlid_hash_sha2_64_digest_batch(h0, SHA512_256_HASH_LENGTH, items, n_items);
+}
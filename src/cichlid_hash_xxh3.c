@@ -0,0 +1,604 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_xxh3.c
+ *
+ * Implementation of the non-cryptographic XXH3 hashes (XXH3-64 and XXH3-128)
+ * from xxHash 0.8, using the default secret and seed 0.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "cichlid_hash_xxh3.h"
+
+#include <stdint.h>
+#include "cichlid_hash_common.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define XXH3_X86_SIMD
+#include <immintrin.h>
+#define TARGET_AVX2   __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+#define STRIPE_LEN          CICHLID_HASH_XXH3_STRIPE_LEN
+#define BUFFER_SIZE         CICHLID_HASH_XXH3_BUFFER_SIZE
+#define SECRET_SIZE         (192)
+#define SECRET_SIZE_MIN     (136)
+#define SECRET_CONSUME_RATE (8)
+#define SECRET_LIMIT        (SECRET_SIZE - STRIPE_LEN)
+#define STRIPES_PER_BLOCK   ((SECRET_SIZE - STRIPE_LEN) / SECRET_CONSUME_RATE)
+#define BLOCK_LEN           (STRIPE_LEN * STRIPES_PER_BLOCK)
+#define MIDSIZE_MAX         (240)
+#define MIDSIZE_STARTOFFSET (3)
+#define MIDSIZE_LASTOFFSET  (17)
+#define LAST_STRIPE_OFFSET  (7)
+#define MERGEACCS_START     (11)
+
+#define PRIME32_1 UINT32_C(0x9E3779B1)
+#define PRIME32_2 UINT32_C(0x85EBCA77)
+#define PRIME32_3 UINT32_C(0xC2B2AE3D)
+#define PRIME64_1 UINT64_C(0x9E3779B185EBCA87)
+#define PRIME64_2 UINT64_C(0xC2B2AE3D27D4EB4F)
+#define PRIME64_3 UINT64_C(0x165667B19E3779F9)
+#define PRIME64_4 UINT64_C(0x85EBCA77C2B2AE63)
+#define PRIME64_5 UINT64_C(0x27D4EB2F165667C5)
+#define PRIME_MX1 UINT64_C(0x165667919E3779F9)
+#define PRIME_MX2 UINT64_C(0x9FB21C651E98DF25)
+
+typedef struct
+{
+    uint64_t low;
+    uint64_t high;
+} Hash128;
+
+typedef void (*AccumulateFunc)(uint64_t acc[8], const uint8_t *input, const uint8_t *secret, size_t n_stripes);
+typedef void (*ScrambleFunc)(uint64_t acc[8], const uint8_t *secret);
+
+static const uint8_t secret[SECRET_SIZE] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static const uint64_t init_acc[8] = {
+    PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3, PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1
+};
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t read64(const uint8_t *p)
+{
+    return (uint64_t)read32(p) | ((uint64_t)read32(p + 4) << 32);
+}
+
+static inline uint32_t swap32(uint32_t x)
+{
+    uint32_t y;
+    cichlid_change_endianness_32(&y, &x, 1);
+    return y;
+}
+
+static inline uint64_t swap64(uint64_t x)
+{
+    uint64_t y;
+    cichlid_change_endianness_64(&y, &x, 1);
+    return y;
+}
+
+static inline Hash128 mult64to128(uint64_t a, uint64_t b)
+{
+    Hash128 r;
+#if defined(__SIZEOF_INT128__)
+    __extension__ typedef unsigned __int128 uint128;
+    uint128 product = (uint128)a * b;
+    r.low = (uint64_t)product;
+    r.high = (uint64_t)(product >> 64);
+#else
+    uint64_t lo_lo = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+    uint64_t hi_lo = (a >> 32) * (b & 0xFFFFFFFF);
+    uint64_t lo_hi = (a & 0xFFFFFFFF) * (b >> 32);
+    uint64_t hi_hi = (a >> 32) * (b >> 32);
+    uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+    r.low = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+    r.high = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+#endif
+    return r;
+}
+
+static inline uint64_t mul128_fold64(uint64_t a, uint64_t b)
+{
+    Hash128 product = mult64to128(a, b);
+    return product.low ^ product.high;
+}
+
+static inline uint64_t xorshift64(uint64_t x, int shift)
+{
+    return x ^ (x >> shift);
+}
+
+static inline uint64_t xxh64_avalanche(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static inline uint64_t avalanche(uint64_t h)
+{
+    h = xorshift64(h, 37);
+    h *= PRIME_MX1;
+    h = xorshift64(h, 32);
+    return h;
+}
+
+static inline uint64_t rrmxmx(uint64_t h, uint64_t len)
+{
+    h ^= cichlid_rotate_left_64(h, 49) ^ cichlid_rotate_left_64(h, 24);
+    h *= PRIME_MX2;
+    h ^= (h >> 35) + len;
+    h *= PRIME_MX2;
+    return xorshift64(h, 28);
+}
+
+static inline uint64_t mix16(const uint8_t *input, const uint8_t *key)
+{
+    return mul128_fold64(read64(input) ^ read64(key), read64(input + 8) ^ read64(key + 8));
+}
+
+static inline Hash128 mix32(Hash128 acc, const uint8_t *input_1, const uint8_t *input_2, const uint8_t *key)
+{
+    acc.low += mix16(input_1, key);
+    acc.low ^= read64(input_2) + read64(input_2 + 8);
+    acc.high += mix16(input_2, key + 16);
+    acc.high ^= read64(input_1) + read64(input_1 + 8);
+    return acc;
+}
+
+/*
+ * Short inputs (at most 240 bytes), always hashed from a single buffer
+ */
+
+static uint64_t hash_short_64(const uint8_t *input, size_t len)
+{
+    uint64_t acc = len * PRIME64_1;
+
+    if (len == 0) {
+        return xxh64_avalanche(read64(secret + 56) ^ read64(secret + 64));
+    } else if (len <= 3) {
+        uint32_t combined = ((uint32_t)input[0] << 16) | ((uint32_t)input[len >> 1] << 24) |
+                            (uint32_t)input[len - 1] | ((uint32_t)len << 8);
+        return xxh64_avalanche(combined ^ (uint64_t)(read32(secret) ^ read32(secret + 4)));
+    } else if (len <= 8) {
+        uint64_t input64 = read32(input + len - 4) + ((uint64_t)read32(input) << 32);
+        return rrmxmx(input64 ^ (read64(secret + 8) ^ read64(secret + 16)), len);
+    } else if (len <= 16) {
+        uint64_t input_lo = read64(input) ^ (read64(secret + 24) ^ read64(secret + 32));
+        uint64_t input_hi = read64(input + len - 8) ^ (read64(secret + 40) ^ read64(secret + 48));
+        return avalanche(len + swap64(input_lo) + input_hi + mul128_fold64(input_lo, input_hi));
+    } else if (len <= 128) {
+        if (len > 32) {
+            if (len > 64) {
+                if (len > 96) {
+                    acc += mix16(input + 48, secret + 96);
+                    acc += mix16(input + len - 64, secret + 112);
+                }
+                acc += mix16(input + 32, secret + 64);
+                acc += mix16(input + len - 48, secret + 80);
+            }
+            acc += mix16(input + 16, secret + 32);
+            acc += mix16(input + len - 32, secret + 48);
+        }
+        acc += mix16(input, secret);
+        acc += mix16(input + len - 16, secret + 16);
+        return avalanche(acc);
+    } else {
+        uint64_t acc_end = mix16(input + len - 16, secret + SECRET_SIZE_MIN - MIDSIZE_LASTOFFSET);
+
+        for (size_t i = 0; i < 8; ++i) {
+            acc += mix16(input + 16 * i, secret + 16 * i);
+        }
+        acc = avalanche(acc);
+        for (size_t i = 8; i < len / 16; ++i) {
+            acc_end += mix16(input + 16 * i, secret + 16 * (i - 8) + MIDSIZE_STARTOFFSET);
+        }
+        return avalanche(acc + acc_end);
+    }
+}
+
+static Hash128 hash_short_128(const uint8_t *input, size_t len)
+{
+    Hash128 h;
+
+    if (len == 0) {
+        h.low = xxh64_avalanche(read64(secret + 64) ^ read64(secret + 72));
+        h.high = xxh64_avalanche(read64(secret + 80) ^ read64(secret + 88));
+    } else if (len <= 3) {
+        uint32_t combined_low = ((uint32_t)input[0] << 16) | ((uint32_t)input[len >> 1] << 24) |
+                                (uint32_t)input[len - 1] | ((uint32_t)len << 8);
+        uint32_t combined_high = cichlid_rotate_left_32(swap32(combined_low), 13);
+        h.low = xxh64_avalanche(combined_low ^ (uint64_t)(read32(secret) ^ read32(secret + 4)));
+        h.high = xxh64_avalanche(combined_high ^ (uint64_t)(read32(secret + 8) ^ read32(secret + 12)));
+    } else if (len <= 8) {
+        uint64_t input64 = read32(input) + ((uint64_t)read32(input + len - 4) << 32);
+        Hash128 m = mult64to128(input64 ^ (read64(secret + 16) ^ read64(secret + 24)), PRIME64_1 + (len << 2));
+        m.high += m.low << 1;
+        m.low ^= m.high >> 3;
+        m.low = xorshift64(m.low, 35);
+        m.low *= PRIME_MX2;
+        h.low = xorshift64(m.low, 28);
+        h.high = avalanche(m.high);
+    } else if (len <= 16) {
+        uint64_t input_lo = read64(input);
+        uint64_t input_hi = read64(input + len - 8);
+        Hash128 m = mult64to128(input_lo ^ input_hi ^ (read64(secret + 32) ^ read64(secret + 40)), PRIME64_1);
+
+        m.low += (uint64_t)(len - 1) << 54;
+        input_hi ^= read64(secret + 48) ^ read64(secret + 56);
+        m.high += input_hi + (uint64_t)(uint32_t)input_hi * (PRIME32_2 - 1);
+        m.low ^= swap64(m.high);
+        h = mult64to128(m.low, PRIME64_2);
+        h.high += m.high * PRIME64_2;
+        h.low = avalanche(h.low);
+        h.high = avalanche(h.high);
+    } else {
+        Hash128 acc = { len * PRIME64_1, 0 };
+
+        if (len <= 128) {
+            if (len > 32) {
+                if (len > 64) {
+                    if (len > 96) {
+                        acc = mix32(acc, input + 48, input + len - 64, secret + 96);
+                    }
+                    acc = mix32(acc, input + 32, input + len - 48, secret + 64);
+                }
+                acc = mix32(acc, input + 16, input + len - 32, secret + 32);
+            }
+            acc = mix32(acc, input, input + len - 16, secret);
+        } else {
+            for (size_t i = 0; i < 4; ++i) {
+                acc = mix32(acc, input + 32 * i, input + 32 * i + 16, secret + 32 * i);
+            }
+            acc.low = avalanche(acc.low);
+            acc.high = avalanche(acc.high);
+            for (size_t i = 4; i < len / 32; ++i) {
+                acc = mix32(acc, input + 32 * i, input + 32 * i + 16,
+                            secret + MIDSIZE_STARTOFFSET + 32 * (i - 4));
+            }
+            acc = mix32(acc, input + len - 16, input + len - 32,
+                        secret + SECRET_SIZE_MIN - MIDSIZE_LASTOFFSET - 16);
+        }
+        h.low = avalanche(acc.low + acc.high);
+        h.high = 0 - avalanche(acc.low * PRIME64_1 + acc.high * PRIME64_4 + len * PRIME64_2);
+    }
+
+    return h;
+}
+
+/*
+ * Long inputs, stripes of 64 bytes are accumulated into eight 64-bit lanes
+ * and the lanes are scrambled after every block of 16 stripes.
+ */
+
+#ifndef XXH3_X86_SIMD
+
+static void accumulate_scalar(uint64_t acc[8], const uint8_t *input, const uint8_t *key, size_t n_stripes)
+{
+    for (size_t n = 0; n < n_stripes; ++n) {
+        const uint8_t *stripe = input + n * STRIPE_LEN;
+        const uint8_t *stripe_key = key + n * SECRET_CONSUME_RATE;
+
+        for (int i = 0; i < 8; ++i) {
+            uint64_t data_val = read64(stripe + 8 * i);
+            uint64_t data_key = data_val ^ read64(stripe_key + 8 * i);
+            acc[i ^ 1] += data_val;
+            acc[i] += (data_key & 0xFFFFFFFF) * (data_key >> 32);
+        }
+    }
+}
+
+static void scramble_scalar(uint64_t acc[8], const uint8_t *key)
+{
+    for (int i = 0; i < 8; ++i) {
+        uint64_t acc64 = xorshift64(acc[i], 47) ^ read64(key + 8 * i);
+        acc[i] = acc64 * PRIME32_1;
+    }
+}
+
+#else
+
+/* SSE2 is always available on x86-64 */
+static void accumulate_sse2(uint64_t acc[8], const uint8_t *input, const uint8_t *key, size_t n_stripes)
+{
+    __m128i a[4];
+
+    for (int i = 0; i < 4; ++i) {
+        a[i] = _mm_loadu_si128((const __m128i *)(const void *)(acc + 2 * i));
+    }
+    for (size_t n = 0; n < n_stripes; ++n) {
+        const uint8_t *stripe = input + n * STRIPE_LEN;
+        const uint8_t *stripe_key = key + n * SECRET_CONSUME_RATE;
+
+        for (int i = 0; i < 4; ++i) {
+            __m128i data_vec = _mm_loadu_si128((const __m128i *)(const void *)(stripe + 16 * i));
+            __m128i key_vec = _mm_loadu_si128((const __m128i *)(const void *)(stripe_key + 16 * i));
+            __m128i data_key = _mm_xor_si128(data_vec, key_vec);
+            __m128i data_key_lo = _mm_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1));
+            __m128i product = _mm_mul_epu32(data_key, data_key_lo);
+            __m128i data_swap = _mm_shuffle_epi32(data_vec, _MM_SHUFFLE(1, 0, 3, 2));
+            a[i] = _mm_add_epi64(a[i], _mm_add_epi64(product, data_swap));
+        }
+    }
+    for (int i = 0; i < 4; ++i) {
+        _mm_storeu_si128((__m128i *)(void *)(acc + 2 * i), a[i]);
+    }
+}
+
+static void scramble_sse2(uint64_t acc[8], const uint8_t *key)
+{
+    const __m128i prime32 = _mm_set1_epi32((int)PRIME32_1);
+
+    for (int i = 0; i < 4; ++i) {
+        __m128i acc_vec = _mm_loadu_si128((const __m128i *)(const void *)(acc + 2 * i));
+        __m128i key_vec = _mm_loadu_si128((const __m128i *)(const void *)(key + 16 * i));
+        __m128i data_key = _mm_xor_si128(_mm_xor_si128(acc_vec, _mm_srli_epi64(acc_vec, 47)), key_vec);
+        __m128i data_key_hi = _mm_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1));
+        __m128i product_lo = _mm_mul_epu32(data_key, prime32);
+        __m128i product_hi = _mm_mul_epu32(data_key_hi, prime32);
+        _mm_storeu_si128((__m128i *)(void *)(acc + 2 * i),
+                         _mm_add_epi64(product_lo, _mm_slli_epi64(product_hi, 32)));
+    }
+}
+
+TARGET_AVX2 static void accumulate_avx2(uint64_t acc[8], const uint8_t *input, const uint8_t *key, size_t n_stripes)
+{
+    __m256i a[2];
+
+    for (int i = 0; i < 2; ++i) {
+        a[i] = _mm256_loadu_si256((const __m256i *)(const void *)(acc + 4 * i));
+    }
+    for (size_t n = 0; n < n_stripes; ++n) {
+        const uint8_t *stripe = input + n * STRIPE_LEN;
+        const uint8_t *stripe_key = key + n * SECRET_CONSUME_RATE;
+
+        for (int i = 0; i < 2; ++i) {
+            __m256i data_vec = _mm256_loadu_si256((const __m256i *)(const void *)(stripe + 32 * i));
+            __m256i key_vec = _mm256_loadu_si256((const __m256i *)(const void *)(stripe_key + 32 * i));
+            __m256i data_key = _mm256_xor_si256(data_vec, key_vec);
+            __m256i data_key_lo = _mm256_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1));
+            __m256i product = _mm256_mul_epu32(data_key, data_key_lo);
+            __m256i data_swap = _mm256_shuffle_epi32(data_vec, _MM_SHUFFLE(1, 0, 3, 2));
+            a[i] = _mm256_add_epi64(a[i], _mm256_add_epi64(product, data_swap));
+        }
+    }
+    for (int i = 0; i < 2; ++i) {
+        _mm256_storeu_si256((__m256i *)(void *)(acc + 4 * i), a[i]);
+    }
+}
+
+TARGET_AVX2 static void scramble_avx2(uint64_t acc[8], const uint8_t *key)
+{
+    const __m256i prime32 = _mm256_set1_epi32((int)PRIME32_1);
+
+    for (int i = 0; i < 2; ++i) {
+        __m256i acc_vec = _mm256_loadu_si256((const __m256i *)(const void *)(acc + 4 * i));
+        __m256i key_vec = _mm256_loadu_si256((const __m256i *)(const void *)(key + 32 * i));
+        __m256i data_key = _mm256_xor_si256(_mm256_xor_si256(acc_vec, _mm256_srli_epi64(acc_vec, 47)), key_vec);
+        __m256i data_key_hi = _mm256_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1));
+        __m256i product_lo = _mm256_mul_epu32(data_key, prime32);
+        __m256i product_hi = _mm256_mul_epu32(data_key_hi, prime32);
+        _mm256_storeu_si256((__m256i *)(void *)(acc + 4 * i),
+                            _mm256_add_epi64(product_lo, _mm256_slli_epi64(product_hi, 32)));
+    }
+}
+
+TARGET_AVX512 static void accumulate_avx512(uint64_t acc[8], const uint8_t *input, const uint8_t *key, size_t n_stripes)
+{
+    __m512i a = _mm512_loadu_si512((const void *)acc);
+
+    for (size_t n = 0; n < n_stripes; ++n) {
+        __m512i data_vec = _mm512_loadu_si512((const void *)(input + n * STRIPE_LEN));
+        __m512i key_vec = _mm512_loadu_si512((const void *)(key + n * SECRET_CONSUME_RATE));
+        __m512i data_key = _mm512_xor_si512(data_vec, key_vec);
+        __m512i data_key_lo = _mm512_shuffle_epi32(data_key, (_MM_PERM_ENUM)_MM_SHUFFLE(0, 3, 0, 1));
+        __m512i product = _mm512_mul_epu32(data_key, data_key_lo);
+        __m512i data_swap = _mm512_shuffle_epi32(data_vec, (_MM_PERM_ENUM)_MM_SHUFFLE(1, 0, 3, 2));
+        a = _mm512_add_epi64(a, _mm512_add_epi64(product, data_swap));
+    }
+    _mm512_storeu_si512((void *)acc, a);
+}
+
+TARGET_AVX512 static void scramble_avx512(uint64_t acc[8], const uint8_t *key)
+{
+    const __m512i prime32 = _mm512_set1_epi32((int)PRIME32_1);
+    __m512i acc_vec = _mm512_loadu_si512((const void *)acc);
+    __m512i key_vec = _mm512_loadu_si512((const void *)key);
+    __m512i data_key = _mm512_xor_si512(_mm512_xor_si512(acc_vec, _mm512_srli_epi64(acc_vec, 47)), key_vec);
+    __m512i data_key_hi = _mm512_shuffle_epi32(data_key, (_MM_PERM_ENUM)_MM_SHUFFLE(0, 3, 0, 1));
+    __m512i product_lo = _mm512_mul_epu32(data_key, prime32);
+    __m512i product_hi = _mm512_mul_epu32(data_key_hi, prime32);
+    _mm512_storeu_si512((void *)acc, _mm512_add_epi64(product_lo, _mm512_slli_epi64(product_hi, 32)));
+}
+
+#endif /* XXH3_X86_SIMD */
+
+static void select_implementation(AccumulateFunc *accumulate, ScrambleFunc *scramble)
+{
+#ifdef XXH3_X86_SIMD
+    if (__builtin_cpu_supports("avx512f")) {
+        *accumulate = accumulate_avx512;
+        *scramble = scramble_avx512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        *accumulate = accumulate_avx2;
+        *scramble = scramble_avx2;
+    } else {
+        *accumulate = accumulate_sse2;
+        *scramble = scramble_sse2;
+    }
+#else
+    *accumulate = accumulate_scalar;
+    *scramble = scramble_scalar;
+#endif
+}
+
+/*!
+ * Accumulate n_stripes stripes, scrambling every time a block is completed.
+ * \param[in,out] n_stripes_so_far Number of stripes in the current block
+ */
+static void consume_stripes(uint64_t acc[8], uint32_t *n_stripes_so_far, const uint8_t *input, size_t n_stripes)
+{
+    AccumulateFunc accumulate;
+    ScrambleFunc   scramble;
+
+    select_implementation(&accumulate, &scramble);
+    while (n_stripes > 0) {
+        size_t n = STRIPES_PER_BLOCK - *n_stripes_so_far;
+        if (n > n_stripes) {
+            n = n_stripes;
+        }
+        accumulate(acc, input, secret + *n_stripes_so_far * SECRET_CONSUME_RATE, n);
+        *n_stripes_so_far += (uint32_t)n;
+        if (*n_stripes_so_far == STRIPES_PER_BLOCK) {
+            scramble(acc, secret + SECRET_LIMIT);
+            *n_stripes_so_far = 0;
+        }
+        input += n * STRIPE_LEN;
+        n_stripes -= n;
+    }
+}
+
+static uint64_t merge_accs(const uint64_t acc[8], const uint8_t *key, uint64_t start)
+{
+    uint64_t result = start;
+
+    for (int i = 0; i < 4; ++i) {
+        result += mul128_fold64(acc[2 * i] ^ read64(key + 16 * i), acc[2 * i + 1] ^ read64(key + 16 * i + 8));
+    }
+    return avalanche(result);
+}
+
+void cichlid_hash_xxh3_init(CichlidHashXxh3 *self, uint32_t hash_length)
+{
+    memcpy(self->acc, init_acc, sizeof(self->acc));
+    self->buffer_size = 0;
+    self->n_stripes_so_far = 0;
+    self->hash_size = hash_length;
+    self->total_size = 0;
+}
+
+void cichlid_hash_xxh3_update(CichlidHashXxh3 *self, const char *data, size_t data_size)
+{
+    const uint8_t *input = (const uint8_t *)data;
+    size_t n_stripes;
+
+    if (!data_size) {
+        return;
+    }
+
+    self->total_size += data_size;
+
+    /* Everything fits in the buffer, wait for more data */
+    if (self->buffer_size + data_size <= BUFFER_SIZE) {
+        memcpy(self->buffer + self->buffer_size, input, data_size);
+        self->buffer_size += (uint32_t)data_size;
+        return;
+    }
+
+    /* Fill the buffer and consume it, there is data after it */
+    if (self->buffer_size) {
+        size_t load_size = BUFFER_SIZE - self->buffer_size;
+        memcpy(self->buffer + self->buffer_size, input, load_size);
+        input += load_size;
+        data_size -= load_size;
+        consume_stripes(self->acc, &self->n_stripes_so_far, self->buffer, BUFFER_SIZE / STRIPE_LEN);
+        self->buffer_size = 0;
+    }
+
+    /* Consume all whole stripes directly from the input, except for the one
+     * containing the last byte, which the final hash may need */
+    if (data_size > BUFFER_SIZE) {
+        n_stripes = (data_size - 1) / STRIPE_LEN;
+        consume_stripes(self->acc, &self->n_stripes_so_far, input, n_stripes);
+        input += n_stripes * STRIPE_LEN;
+        data_size -= n_stripes * STRIPE_LEN;
+        /* Keep the last consumed stripe for the final partial stripe */
+        memcpy(self->buffer + BUFFER_SIZE - STRIPE_LEN, input - STRIPE_LEN, STRIPE_LEN);
+    }
+
+    memcpy(self->buffer, input, data_size);
+    self->buffer_size = (uint32_t)data_size;
+}
+
+char *cichlid_hash_xxh3_get_hash(const CichlidHashXxh3 *self)
+{
+    char    *hash_string;
+    Hash128  hash;
+
+    if (self->total_size > MIDSIZE_MAX) {
+        uint64_t       acc[8];
+        uint32_t       n_stripes_so_far = self->n_stripes_so_far;
+        uint8_t        last_stripe[STRIPE_LEN];
+        const uint8_t *last_stripe_p;
+        AccumulateFunc accumulate;
+        ScrambleFunc   scramble;
+
+        memcpy(acc, self->acc, sizeof(acc));
+        if (self->buffer_size >= STRIPE_LEN) {
+            consume_stripes(acc, &n_stripes_so_far, self->buffer, (self->buffer_size - 1) / STRIPE_LEN);
+            last_stripe_p = self->buffer + self->buffer_size - STRIPE_LEN;
+        } else {
+            /* The last stripe overlaps the previously consumed data */
+            size_t catchup_size = STRIPE_LEN - self->buffer_size;
+            memcpy(last_stripe, self->buffer + BUFFER_SIZE - catchup_size, catchup_size);
+            memcpy(last_stripe + catchup_size, self->buffer, self->buffer_size);
+            last_stripe_p = last_stripe;
+        }
+        select_implementation(&accumulate, &scramble);
+        accumulate(acc, last_stripe_p, secret + SECRET_LIMIT - LAST_STRIPE_OFFSET, 1);
+
+        hash.low = merge_accs(acc, secret + MERGEACCS_START, self->total_size * PRIME64_1);
+        hash.high = merge_accs(acc, secret + SECRET_SIZE - STRIPE_LEN - MERGEACCS_START,
+                               ~(self->total_size * PRIME64_2));
+    } else if (self->hash_size == 16) {
+        hash.low = hash_short_64(self->buffer, self->buffer_size);
+    } else {
+        hash = hash_short_128(self->buffer, self->buffer_size);
+    }
+
+    hash_string = malloc(sizeof(*hash_string) * (self->hash_size + 1));
+    if (self->hash_size == 16) {
+        sprintf(hash_string, "%.16" PRIx64, hash.low);
+    } else {
+        sprintf(hash_string, "%.16" PRIx64 "%.16" PRIx64, hash.high, hash.low);
+    }
+    return hash_string;
+}
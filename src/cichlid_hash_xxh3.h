@@ -0,0 +1,48 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_xxh3.h
+ *
+ * Implementation of the non-cryptographic XXH3 hashes (XXH3-64 and XXH3-128)
+ * from xxHash 0.8, using the default secret and seed 0.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CICHLID_HASH_XXH3_H
+#define CICHLID_HASH_XXH3_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CICHLID_HASH_XXH3_STRIPE_LEN (64)
+#define CICHLID_HASH_XXH3_BUFFER_SIZE (256)
+
+typedef struct CichlidHashXxh3_ CichlidHashXxh3;
+struct CichlidHashXxh3_
+{
+    uint64_t acc[8];
+    uint8_t  buffer[CICHLID_HASH_XXH3_BUFFER_SIZE];
+    uint32_t buffer_size;
+    uint32_t n_stripes_so_far;
+    uint32_t hash_size;
+    uint64_t total_size;
+};
+
+void cichlid_hash_xxh3_init(CichlidHashXxh3 *self, uint32_t hash_length);
+void cichlid_hash_xxh3_update(CichlidHashXxh3 *self, const char *data, size_t data_size);
+char *cichlid_hash_xxh3_get_hash(const CichlidHashXxh3 *self);
+
+#endif /* CICHLID_HASH_XXH3_H */
@@ -0,0 +1,42 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_xxh3_128.c
+ *
+ * XXH3-128 non-cryptographic hash from xxHash 0.8
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "cichlid_hash_xxh3_128.h"
+#include "cichlid_hash_xxh3.h"
+
+#include <stdint.h>
+
+#define XXH3_128_HASH_LENGTH (32)
+
+void cichlid_hash_xxh3_128_init(CichlidHashXxh3_128 *self)
+{
+    cichlid_hash_xxh3_init(self, XXH3_128_HASH_LENGTH);
+}
+
+void cichlid_hash_xxh3_128_update(CichlidHashXxh3_128 *self, const char *data, size_t data_size)
+{
+    cichlid_hash_xxh3_update(self, data, data_size);
+}
+
+char *cichlid_hash_xxh3_128_get_hash(CichlidHashXxh3_128 *self)
+{
+    return cichlid_hash_xxh3_get_hash(self);
+}
+
@@ -0,0 +1,49 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - cichlid_hash_xxh3_64.h
+ *
+ * XXH3-64 non-cryptographic hash from xxHash 0.8
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CICHLID_HASH_XXH3_64_H
+#define CICHLID_HASH_XXH3_64_H
+
+#include "cichlid_hash_xxh3.h"
+#include <stddef.h>
+#include <stdint.h>
+
+typedef CichlidHashXxh3 CichlidHashXxh3_64;
+
+/*!
+ * Initialize or reinitialize a XXH3-64 hash calculator
+ * \param self Hash calculator instance
+ */
+void cichlid_hash_xxh3_64_init(CichlidHashXxh3_64 *self);
+/*!
+ * Update the calculator with new data
+ * \param self Hash calculator instance
+ * \param data Pointer to data stream
+ * \param data_size Size of available data
+ */
+void cichlid_hash_xxh3_64_update(CichlidHashXxh3_64 *self, const char *data, size_t data_size);
+/*!
+ * Retrieve current hash.
+ * \returns A null-terminated string containing the hash
+ */
+char *cichlid_hash_xxh3_64_get_hash(CichlidHashXxh3_64 *self);
+
+#endif /* CICHLID_HASH_XXH3_64_H */
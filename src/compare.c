@@ -0,0 +1,274 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - compare.c
+ *
+ * Parallel comparison of two files for the command line tool.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "compare.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define READ_BUFFER_SIZE (1024 * 1024)
+/* Large enough to keep reads sequential on rotational disks */
+#define RANGE_SIZE (8 * READ_BUFFER_SIZE)
+
+typedef struct
+{
+    int      fd[2];
+    uint64_t size;       /* Compared size, the smaller of the file sizes */
+    uint64_t next_range; /* Atomic */
+    uint64_t difference; /* Atomic, lowest differing offset found so far */
+    int      error;      /* Atomic, first errno */
+    int      error_file; /* Index of the file that failed, set with error */
+} Compare;
+
+static bool read_fully(Compare *self, int file, char *buf, size_t size, uint64_t offset)
+{
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t n = pread(self->fd[file], buf + done, size - done, (off_t)(offset + done));
+        if (n <= 0) {
+            int expected = 0;
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            /* A file that shrinks while being read is an error too */
+            if (__atomic_compare_exchange_n(&self->error, &expected, n < 0 ? errno : EIO, false, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                self->error_file = file;
+            }
+            return false;
+        }
+        done += (size_t)n;
+    }
+    return true;
+}
+
+/*!
+ * Lower the shared difference to offset unless a lower one was found.
+ */
+static void set_difference(Compare *self, uint64_t offset)
+{
+    uint64_t current = __atomic_load_n(&self->difference, __ATOMIC_RELAXED);
+
+    while (offset < current && !__atomic_compare_exchange_n(&self->difference, &current, offset, true,
+                                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void *worker(void *arg)
+{
+    Compare *self = arg;
+    char    *buf[2] = { malloc(READ_BUFFER_SIZE), malloc(READ_BUFFER_SIZE) };
+
+    for (;;) {
+        uint64_t offset = __atomic_fetch_add(&self->next_range, 1, __ATOMIC_RELAXED) * RANGE_SIZE;
+        uint64_t end = self->size - offset < RANGE_SIZE ? self->size : offset + RANGE_SIZE;
+
+        /* Ranges are claimed in order, so once one starts past a difference
+         * all later ones do too */
+        if (offset >= self->size || offset >= __atomic_load_n(&self->difference, __ATOMIC_RELAXED) ||
+            __atomic_load_n(&self->error, __ATOMIC_RELAXED)) {
+            break;
+        }
+        while (offset < end && offset < __atomic_load_n(&self->difference, __ATOMIC_RELAXED)) {
+            size_t size = end - offset < READ_BUFFER_SIZE ? (size_t)(end - offset) : READ_BUFFER_SIZE;
+
+            if (!read_fully(self, 0, buf[0], size, offset) || !read_fully(self, 1, buf[1], size, offset)) {
+                break;
+            }
+            if (memcmp(buf[0], buf[1], size) != 0) {
+                size_t i = 0;
+                while (buf[0][i] == buf[1][i]) {
+                    ++i;
+                }
+                set_difference(self, offset + i);
+                break;
+            }
+            offset += size;
+        }
+    }
+
+    free(buf[1]);
+    free(buf[0]);
+    return NULL;
+}
+
+/*!
+ * Read up to size bytes, stopping early only at the end of the file.
+ * \returns The number of bytes read or -1 on errors
+ */
+static ssize_t read_stream(int fd, char *buf, size_t size)
+{
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t n = read(fd, buf + done, size - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        } else if (n == 0) {
+            break;
+        }
+        done += (size_t)n;
+    }
+    return (ssize_t)done;
+}
+
+/*!
+ * Compare files that are not regular files, such as pipes, by reading both
+ * from start to end.
+ * \returns 0 if they are identical, 1 if they differ and 2 on errors
+ */
+static int compare_streams(const Compare *self, const char *const paths[2])
+{
+    char    *buf[2] = { malloc(READ_BUFFER_SIZE), malloc(READ_BUFFER_SIZE) };
+    uint64_t offset = 0;
+    int      rv = -1;
+
+    while (rv < 0) {
+        ssize_t n[2];
+        size_t  common;
+
+        for (int i = 0; i < 2; ++i) {
+            if ((n[i] = read_stream(self->fd[i], buf[i], READ_BUFFER_SIZE)) < 0) {
+                fprintf(stderr, "Could not read \"%s\": %s\n", paths[i], strerror(errno));
+                rv = 2;
+                break;
+            }
+        }
+        if (rv >= 0) {
+            break;
+        }
+
+        common = (size_t)(n[0] < n[1] ? n[0] : n[1]);
+        if (memcmp(buf[0], buf[1], common) != 0) {
+            size_t i = 0;
+            while (buf[0][i] == buf[1][i]) {
+                ++i;
+            }
+            printf("\"%s\" and \"%s\" differ at offset %" PRIu64 "\n", paths[0], paths[1], offset + i);
+            rv = 1;
+        } else if (n[0] != n[1]) {
+            printf("\"%s\" and \"%s\" differ at offset %" PRIu64 ", where \"%s\" ends\n", paths[0], paths[1],
+                   offset + common, paths[n[0] < n[1] ? 0 : 1]);
+            rv = 1;
+        } else if (n[0] == 0) {
+            printf("\"%s\" and \"%s\" are identical\n", paths[0], paths[1]);
+            rv = 0;
+        }
+        offset += common;
+    }
+
+    free(buf[1]);
+    free(buf[0]);
+    return rv;
+}
+
+/*!
+ * Compare the open files on a pool of threads.
+ * \returns 0 if they are identical, 1 if they differ and 2 on errors
+ */
+static int compare_files(Compare *self, const char *const paths[2], const struct stat st[2], unsigned int n_threads)
+{
+    pthread_t *threads;
+    uint64_t   n_ranges;
+    size_t     n_started = 0;
+
+    if (st[0].st_dev == st[1].st_dev && st[0].st_ino == st[1].st_ino) {
+        printf("\"%s\" and \"%s\" are the same file\n", paths[0], paths[1]);
+        return 0;
+    } else if (!S_ISREG(st[0].st_mode) || !S_ISREG(st[1].st_mode)) {
+        return compare_streams(self, paths);
+    }
+    self->size = (uint64_t)(st[0].st_size < st[1].st_size ? st[0].st_size : st[1].st_size);
+
+    n_ranges = (self->size + RANGE_SIZE - 1) / RANGE_SIZE;
+    if (n_threads > n_ranges) {
+        n_threads = (unsigned int)n_ranges;
+    }
+    threads = malloc(sizeof(*threads) * (n_threads ? n_threads : 1));
+    for (unsigned int i = 0; i < n_threads; ++i) {
+        if (pthread_create(&threads[n_started], NULL, worker, self) == 0) {
+            ++n_started;
+        }
+    }
+    if (n_started == 0) {
+        worker(self);
+    }
+    for (size_t i = 0; i < n_started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    /* A read error may hide an earlier difference */
+    if (self->error) {
+        fprintf(stderr, "Could not read \"%s\": %s\n", paths[self->error_file], strerror(self->error));
+        return 2;
+    } else if (self->difference != UINT64_MAX) {
+        printf("\"%s\" and \"%s\" differ at offset %" PRIu64 "\n", paths[0], paths[1], self->difference);
+    } else if (st[0].st_size != st[1].st_size) {
+        printf("\"%s\" and \"%s\" differ at offset %" PRIu64 ", where \"%s\" ends\n", paths[0], paths[1],
+               self->size, paths[st[0].st_size < st[1].st_size ? 0 : 1]);
+    } else {
+        printf("\"%s\" and \"%s\" are identical\n", paths[0], paths[1]);
+        return 0;
+    }
+    return 1;
+}
+
+int compare_run(const char *path_a, const char *path_b, unsigned int n_threads)
+{
+    const char *const paths[2] = { path_a, path_b };
+    Compare           self = { { -1, -1 }, 0, 0, UINT64_MAX, 0, 0 };
+    struct stat       st[2];
+    int               rv = 0;
+
+    for (int i = 0; i < 2 && rv == 0; ++i) {
+        self.fd[i] = open(paths[i], O_RDONLY | O_CLOEXEC);
+        if (self.fd[i] < 0 || fstat(self.fd[i], &st[i]) != 0) {
+            fprintf(stderr, "Could not read \"%s\": %s\n", paths[i], strerror(errno));
+            rv = 2;
+        } else {
+            posix_fadvise(self.fd[i], 0, 0, POSIX_FADV_SEQUENTIAL);
+        }
+    }
+    if (rv == 0) {
+        rv = compare_files(&self, paths, st, n_threads);
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        if (self.fd[i] >= 0) {
+            close(self.fd[i]);
+        }
+    }
+    return rv;
+}
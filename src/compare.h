@@ -0,0 +1,38 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - compare.h
+ *
+ * Parallel comparison of two files for the command line tool.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMPARE_H
+#define COMPARE_H
+
+/*!
+ * Compare two files range by range on a pool of threads and print whether
+ * they are identical or else the offset of the first byte that differs.
+ * Ranges past a found difference are not read. Files other than regular
+ * files, such as pipes, are read from start to end instead.
+ * \param path_a First file
+ * \param path_b Second file
+ * \param n_threads Number of ranges compared at once
+ * \returns 0 if the files are identical, 1 if they differ and 2 if they could
+ *          not be read
+ */
+int compare_run(const char *path_a, const char *path_b, unsigned int n_threads);
+
+#endif /* COMPARE_H */
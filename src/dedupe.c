@@ -0,0 +1,600 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - dedupe.c
+ *
+ * Duplicate file detection for the command line tool.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+#include "dedupe.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <inttypes.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+/* Bytes hashed at each end of a file by the partial stage */
+#define PARTIAL_SIZE (4 * 1024)
+/* Read size of the full stage, per thread */
+#define READ_BUFFER_SIZE (1024 * 1024)
+#define MAX_OPEN_DIRECTORIES (64)
+/* Files read at once from a rotational device by each stage. The partial
+ * stage's small reads leave the drive some room for reordering, the full
+ * stage reads one file after another. */
+#define ROTATIONAL_PARTIAL_DEPTH (2)
+#define ROTATIONAL_FULL_DEPTH (1)
+
+typedef struct
+{
+    char    *path;
+    uint64_t size;
+    dev_t    dev;
+    ino_t    ino;
+    uint64_t physical;       /* Disk offset of the first extent, if known */
+    bool     physical_known;
+    char    *hash;           /* Partial hash, then full hash */
+    bool     error;
+} File;
+
+typedef struct
+{
+    File  *files;
+    size_t n_files;
+    size_t capacity;
+} FileList;
+
+/*!
+ * Queue of the files of a stage on one device.
+ */
+typedef struct
+{
+    dev_t        dev;
+    bool         rotational;
+    File       **tasks;
+    size_t       n_tasks;
+    size_t       next_task;
+    unsigned int n_running;
+    unsigned int max_running;
+} Device;
+
+typedef struct
+{
+    File                      **tasks;
+    size_t                      n_tasks;
+    bool                        partial;
+    const CichlidHashAlgorithm *algorithm;
+    /* Per device queues, guarded by lock */
+    Device                     *devices;
+    size_t                      n_devices;
+    size_t                      next_device;
+    size_t                      n_waiting;
+    pthread_mutex_t             lock;
+    pthread_cond_t              idle;
+} Stage;
+
+/* nftw offers no user data pointer */
+static FileList *walk_list;
+
+static int add_file(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    File *file;
+
+    (void)ftw;
+    if (type == FTW_DNR || type == FTW_NS) {
+        fprintf(stderr, "Could not read \"%s\": %s\n", path, strerror(errno));
+        return 0;
+    }
+    /* Empty files are trivially equal and not worth reporting */
+    if (type != FTW_F || !S_ISREG(st->st_mode) || st->st_size == 0) {
+        return 0;
+    }
+
+    if (walk_list->n_files == walk_list->capacity) {
+        walk_list->capacity = walk_list->capacity ? 2 * walk_list->capacity : 1024;
+        walk_list->files = realloc(walk_list->files, sizeof(*walk_list->files) * walk_list->capacity);
+    }
+    file = &walk_list->files[walk_list->n_files++];
+    file->path = strdup(path);
+    file->size = (uint64_t)st->st_size;
+    file->dev = st->st_dev;
+    file->ino = st->st_ino;
+    file->physical = 0;
+    file->physical_known = false;
+    file->hash = NULL;
+    file->error = false;
+    return 0;
+}
+
+static int compare_size(const void *a, const void *b)
+{
+    const File *fa = *(File *const *)a;
+    const File *fb = *(File *const *)b;
+
+    if (fa->size != fb->size) {
+        return fa->size < fb->size ? -1 : 1;
+    }
+    if (fa->dev != fb->dev) {
+        return fa->dev < fb->dev ? -1 : 1;
+    }
+    if (fa->ino != fb->ino) {
+        return fa->ino < fb->ino ? -1 : 1;
+    }
+    return strcmp(fa->path, fb->path);
+}
+
+static int compare_hash(const void *a, const void *b)
+{
+    const File *fa = *(File *const *)a;
+    const File *fb = *(File *const *)b;
+    int         rv;
+
+    if (fa->size != fb->size) {
+        return fa->size < fb->size ? -1 : 1;
+    }
+    rv = strcmp(fa->hash, fb->hash);
+    return rv ? rv : strcmp(fa->path, fb->path);
+}
+
+static bool same_size(const File *a, const File *b)
+{
+    return a->size == b->size;
+}
+
+static bool same_hash(const File *a, const File *b)
+{
+    return a->size == b->size && !strcmp(a->hash, b->hash);
+}
+
+/*!
+ * Keep only the files that are equal to at least one other file according to
+ * equal, which must agree with the order the files are sorted in.
+ * \returns The number of files kept at the start of files
+ */
+static size_t keep_collisions(File **files, size_t n_files, bool (*equal)(const File *, const File *))
+{
+    size_t n_kept = 0;
+
+    for (size_t i = 0; i < n_files;) {
+        size_t j = i + 1;
+        while (j < n_files && equal(files[i], files[j])) {
+            ++j;
+        }
+        if (j - i > 1) {
+            memmove(files + n_kept, files + i, sizeof(*files) * (j - i));
+            n_kept += j - i;
+        }
+        i = j;
+    }
+    return n_kept;
+}
+
+/*!
+ * Remove failed files from the list.
+ * \returns The number of files left
+ */
+static size_t remove_errors(File **files, size_t n_files)
+{
+    size_t n_kept = 0;
+
+    for (size_t i = 0; i < n_files; ++i) {
+        if (!files[i]->error) {
+            files[n_kept++] = files[i];
+        }
+    }
+    return n_kept;
+}
+
+/*!
+ * Read exactly size bytes at offset.
+ * \returns false with errno set, or 0 if the file ended first
+ */
+static bool read_range(int fd, char *buf, size_t size, uint64_t offset)
+{
+    while (size > 0) {
+        ssize_t n = pread(fd, buf, size, (off_t)offset);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            } else if (n == 0) {
+                errno = 0;
+            }
+            return false;
+        }
+        buf += n;
+        size -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return true;
+}
+
+/*!
+ * Hash the first and last PARTIAL_SIZE bytes of a file, or the whole file if
+ * it is smaller than twice that. The ranges never overlap.
+ */
+static bool hash_partial(int fd, const File *file, const CichlidHashAlgorithm *algorithm, void *context,
+                         char *buf)
+{
+    size_t   head_size = file->size < PARTIAL_SIZE ? (size_t)file->size : PARTIAL_SIZE;
+    uint64_t tail_offset = file->size > 2 * PARTIAL_SIZE ? file->size - PARTIAL_SIZE : PARTIAL_SIZE;
+
+    if (!read_range(fd, buf, head_size, 0)) {
+        return false;
+    }
+    algorithm->update(context, buf, head_size);
+    if (file->size > PARTIAL_SIZE) {
+        size_t tail_size = (size_t)(file->size - tail_offset);
+        if (!read_range(fd, buf, tail_size, tail_offset)) {
+            return false;
+        }
+        algorithm->update(context, buf, tail_size);
+    }
+    return true;
+}
+
+static bool hash_full(int fd, const File *file, const CichlidHashAlgorithm *algorithm, void *context, char *buf)
+{
+    uint64_t offset = 0;
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    while (offset < file->size) {
+        size_t size = file->size - offset < READ_BUFFER_SIZE ? (size_t)(file->size - offset) : READ_BUFFER_SIZE;
+        if (!read_range(fd, buf, size, offset)) {
+            return false;
+        }
+        algorithm->update(context, buf, size);
+        offset += size;
+    }
+    return true;
+}
+
+/*!
+ * Look up whether a device is rotational in sysfs, checking the parent of a
+ * partition. Devices without a block device, such as network and virtual
+ * file systems, are treated as non-rotational.
+ */
+static bool is_rotational(dev_t dev)
+{
+    static const char *const formats[] = {
+        "/sys/dev/block/%u:%u/queue/rotational",
+        "/sys/dev/block/%u:%u/../queue/rotational"
+    };
+
+    for (size_t i = 0; i < sizeof(formats) / sizeof(*formats); ++i) {
+        char  path[64];
+        FILE *fid;
+        int   c;
+
+        snprintf(path, sizeof(path), formats[i], major(dev), minor(dev));
+        fid = fopen(path, "r");
+        if (fid) {
+            c = fgetc(fid);
+            fclose(fid);
+            return c == '1';
+        }
+    }
+    return false;
+}
+
+/*!
+ * Find the disk offset of the first extent of a file with FIEMAP, so that
+ * files on rotational devices can be read in disk order.
+ */
+static void find_physical(File *file)
+{
+    union
+    {
+        struct fiemap map;
+        char          bytes[sizeof(struct fiemap) + sizeof(struct fiemap_extent)];
+    } request;
+    int fd;
+
+    file->physical_known = true;
+    fd = open(file->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    memset(&request, 0, sizeof(request));
+    request.map.fm_length = FIEMAP_MAX_OFFSET;
+    request.map.fm_extent_count = 1;
+    if (ioctl(fd, FS_IOC_FIEMAP, &request.map) == 0 && request.map.fm_mapped_extents > 0) {
+        file->physical = request.map.fm_extents[0].fe_physical;
+    }
+    close(fd);
+}
+
+static int compare_location(const void *a, const void *b)
+{
+    const File *fa = *(File *const *)a;
+    const File *fb = *(File *const *)b;
+
+    if (fa->dev != fb->dev) {
+        return fa->dev < fb->dev ? -1 : 1;
+    }
+    if (fa->physical != fb->physical) {
+        return fa->physical < fb->physical ? -1 : 1;
+    }
+    return 0;
+}
+
+/*!
+ * Split the tasks of a stage into one queue per device, sorting the files of
+ * rotational devices by their position on disk.
+ */
+static void create_devices(Stage *stage, unsigned int n_threads)
+{
+    stage->devices = malloc(sizeof(*stage->devices) * (stage->n_tasks ? stage->n_tasks : 1));
+    stage->n_devices = 0;
+
+    qsort(stage->tasks, stage->n_tasks, sizeof(*stage->tasks), compare_location);
+    for (size_t i = 0; i < stage->n_tasks;) {
+        Device *device = &stage->devices[stage->n_devices++];
+        size_t  j = i + 1;
+
+        while (j < stage->n_tasks && stage->tasks[j]->dev == stage->tasks[i]->dev) {
+            ++j;
+        }
+        device->dev = stage->tasks[i]->dev;
+        device->rotational = is_rotational(device->dev);
+        device->tasks = stage->tasks + i;
+        device->n_tasks = j - i;
+        device->next_task = 0;
+        device->n_running = 0;
+        device->max_running = n_threads;
+        if (device->rotational) {
+            device->max_running = stage->partial ? ROTATIONAL_PARTIAL_DEPTH : ROTATIONAL_FULL_DEPTH;
+            for (size_t k = 0; k < device->n_tasks; ++k) {
+                if (!device->tasks[k]->physical_known) {
+                    find_physical(device->tasks[k]);
+                }
+            }
+            qsort(device->tasks, device->n_tasks, sizeof(*device->tasks), compare_location);
+        }
+        i = j;
+    }
+}
+
+/*!
+ * Take the next file from the devices in turn, skipping devices that are
+ * already read by as many threads as they are allowed.
+ * \returns The device to read from, or NULL if all files have been taken
+ */
+static Device *next_device(Stage *stage)
+{
+    for (;;) {
+        bool left = false;
+
+        for (size_t i = 0; i < stage->n_devices; ++i) {
+            Device *device = &stage->devices[(stage->next_device + i) % stage->n_devices];
+            if (device->next_task == device->n_tasks) {
+                continue;
+            }
+            left = true;
+            if (device->n_running < device->max_running) {
+                stage->next_device = (stage->next_device + i + 1) % stage->n_devices;
+                return device;
+            }
+        }
+        if (!left) {
+            return NULL;
+        }
+        ++stage->n_waiting;
+        pthread_cond_wait(&stage->idle, &stage->lock);
+        --stage->n_waiting;
+    }
+}
+
+static void *stage_worker(void *arg)
+{
+    Stage  *stage = arg;
+    char   *buf = malloc(stage->partial ? PARTIAL_SIZE : READ_BUFFER_SIZE);
+    void   *context = malloc(stage->algorithm->context_size);
+    Device *device;
+
+    pthread_mutex_lock(&stage->lock);
+    while ((device = next_device(stage)) != NULL) {
+        File *file = device->tasks[device->next_task++];
+        int   fd;
+        int   error = 0;
+        bool  ok;
+
+        ++device->n_running;
+        pthread_mutex_unlock(&stage->lock);
+
+        fd = open(file->path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            ok = false;
+            error = errno;
+        } else {
+            stage->algorithm->init(context);
+            ok = stage->partial ? hash_partial(fd, file, stage->algorithm, context, buf)
+                                : hash_full(fd, file, stage->algorithm, context, buf);
+            error = errno;
+            close(fd);
+        }
+        free(file->hash);
+        file->hash = NULL;
+        if (ok) {
+            file->hash = stage->algorithm->get_hash(context);
+        } else {
+            /* Files that shrank since they were listed end early */
+            fprintf(stderr, "Could not read \"%s\": %s\n", file->path, error ? strerror(error) : "short read");
+            file->error = true;
+        }
+
+        pthread_mutex_lock(&stage->lock);
+        --device->n_running;
+        if (stage->n_waiting) {
+            pthread_cond_broadcast(&stage->idle);
+        }
+    }
+    pthread_mutex_unlock(&stage->lock);
+
+    free(context);
+    free(buf);
+    return NULL;
+}
+
+/*!
+ * Hash the files of a stage using up to n_threads threads, each with a fixed
+ * size buffer. The threads are shared by all devices, but each device has its
+ * own queue and a limit on how many of them read from it at once.
+ */
+static void run_stage(Stage *stage, unsigned int n_threads)
+{
+    pthread_t *threads;
+    size_t     n_started = 0;
+
+    if (n_threads > stage->n_tasks) {
+        n_threads = (unsigned int)stage->n_tasks;
+    }
+    create_devices(stage, n_threads);
+    stage->next_device = 0;
+    stage->n_waiting = 0;
+    pthread_mutex_init(&stage->lock, NULL);
+    pthread_cond_init(&stage->idle, NULL);
+
+    threads = malloc(sizeof(*threads) * (n_threads ? n_threads : 1));
+    for (unsigned int i = 1; i < n_threads; ++i) {
+        if (pthread_create(&threads[n_started], NULL, stage_worker, stage) == 0) {
+            ++n_started;
+        }
+    }
+    stage_worker(stage);
+    for (size_t i = 0; i < n_started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    pthread_cond_destroy(&stage->idle);
+    pthread_mutex_destroy(&stage->lock);
+    free(stage->devices);
+}
+
+static void print_groups(File **files, size_t n_files, const CichlidHashAlgorithm *algorithm)
+{
+    uint64_t n_groups = 0, wasted = 0;
+
+    for (size_t i = 0; i < n_files;) {
+        size_t j = i + 1;
+        while (j < n_files && same_hash(files[i], files[j])) {
+            ++j;
+        }
+        printf("Duplicates of %" PRIu64 " bytes (%s %s)\n", files[i]->size, algorithm->label, files[i]->hash);
+        for (size_t k = i; k < j; ++k) {
+            printf("    %s\n", files[k]->path);
+        }
+        ++n_groups;
+        wasted += (j - i - 1) * files[i]->size;
+        i = j;
+    }
+    printf("%" PRIu64 " groups of duplicates, %" PRIu64 " bytes in redundant copies\n", n_groups, wasted);
+}
+
+int dedupe_run(const CichlidHashAlgorithm *algorithm, unsigned int n_threads, char *const paths[], size_t n_paths)
+{
+    FileList list = { NULL, 0, 0 };
+    File   **candidates;
+    File   **duplicates;
+    size_t   n_candidates = 0, n_duplicates = 0, n_full = 0, n_kept;
+    bool     errors = false;
+    Stage    stage;
+
+    walk_list = &list;
+    for (size_t i = 0; i < n_paths; ++i) {
+        if (nftw(paths[i], add_file, MAX_OPEN_DIRECTORIES, FTW_PHYS) != 0) {
+            fprintf(stderr, "Could not read \"%s\": %s\n", paths[i], strerror(errno));
+            errors = true;
+        }
+    }
+    walk_list = NULL;
+
+    candidates = malloc(sizeof(*candidates) * (list.n_files ? list.n_files : 1));
+    duplicates = malloc(sizeof(*duplicates) * (list.n_files ? list.n_files : 1));
+
+    /* Size, hard links to an inode already seen are the same file and skipped */
+    for (size_t i = 0; i < list.n_files; ++i) {
+        candidates[n_candidates++] = &list.files[i];
+    }
+    qsort(candidates, n_candidates, sizeof(*candidates), compare_size);
+    n_kept = 0;
+    for (size_t i = 0; i < n_candidates; ++i) {
+        if (n_kept && candidates[n_kept - 1]->dev == candidates[i]->dev &&
+            candidates[n_kept - 1]->ino == candidates[i]->ino) {
+            continue;
+        }
+        candidates[n_kept++] = candidates[i];
+    }
+    n_candidates = n_kept;
+    n_candidates = keep_collisions(candidates, n_candidates, same_size);
+
+    /* Partial hash */
+    stage.tasks = candidates;
+    stage.n_tasks = n_candidates;
+    stage.partial = true;
+    stage.algorithm = algorithm;
+    run_stage(&stage, n_threads);
+    n_kept = remove_errors(candidates, n_candidates);
+    errors |= n_kept != n_candidates;
+    n_candidates = n_kept;
+    qsort(candidates, n_candidates, sizeof(*candidates), compare_hash);
+    n_candidates = keep_collisions(candidates, n_candidates, same_hash);
+
+    /* Files covered entirely by the partial hash are done */
+    for (size_t i = 0; i < n_candidates; ++i) {
+        if (candidates[i]->size <= 2 * PARTIAL_SIZE) {
+            duplicates[n_duplicates++] = candidates[i];
+        } else {
+            candidates[n_full++] = candidates[i];
+        }
+    }
+
+    /* Full hash */
+    stage.tasks = candidates;
+    stage.n_tasks = n_full;
+    stage.partial = false;
+    run_stage(&stage, n_threads);
+    n_kept = remove_errors(candidates, n_full);
+    errors |= n_kept != n_full;
+    n_full = n_kept;
+    qsort(candidates, n_full, sizeof(*candidates), compare_hash);
+    n_full = keep_collisions(candidates, n_full, same_hash);
+
+    memcpy(duplicates + n_duplicates, candidates, sizeof(*candidates) * n_full);
+    n_duplicates += n_full;
+    qsort(duplicates, n_duplicates, sizeof(*duplicates), compare_hash);
+    print_groups(duplicates, n_duplicates, algorithm);
+
+    for (size_t i = 0; i < list.n_files; ++i) {
+        free(list.files[i].path);
+        free(list.files[i].hash);
+    }
+    free(list.files);
+    free(candidates);
+    free(duplicates);
+    return errors ? 2 : 0;
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - dedupe.h
+ *
+ * Duplicate file detection for the command line tool.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DEDUPE_H
+#define DEDUPE_H
+
+#include "cichlid_hash.h"
+#include <stddef.h>
+
+/*!
+ * Find and print groups of identical files. Files are grouped by size first,
+ * then by the hash of their first and last PARTIAL_SIZE bytes, and only the
+ * files still colliding are hashed in full.
+ * \param algorithm Algorithm used for both hashing stages
+ * \param n_threads Number of files read at once
+ * \param paths Files and directories, which are searched recursively
+ * \param n_paths Number of paths
+ * \returns 0 on success, 2 if some file could not be read
+ */
+int dedupe_run(const CichlidHashAlgorithm *algorithm, unsigned int n_threads, char *const paths[], size_t n_paths);
+
+#endif /* DEDUPE_H */
@@ -0,0 +1,276 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - etag.c
+ *
+ * S3 multipart upload ETags for the command line tool.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+#include "etag.h"
+#include "cichlid_hash_md5.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define READ_BUFFER_SIZE (1024 * 1024)
+#define MIB (UINT64_C(1024) * 1024)
+/* The default of the AWS command line tools */
+#define DEFAULT_PART_SIZE (8 * MIB)
+#define MAX_PART_SIZE (5 * 1024 * MIB)
+#define MAX_CANDIDATES (64)
+/* "<32 hex digits>-<parts>" */
+#define ETAG_SIZE (64)
+
+typedef struct
+{
+    int      fd;
+    uint64_t file_size;
+    uint64_t part_size;
+    size_t   n_parts;
+    uint8_t (*digests)[16]; /* One per part */
+    size_t   next_part;     /* Atomic */
+    int      error;         /* Atomic, first errno */
+} Etag;
+
+static void *worker(void *arg)
+{
+    Etag *self = arg;
+    char *buf = malloc(READ_BUFFER_SIZE);
+
+    for (;;) {
+        size_t         part = __atomic_fetch_add(&self->next_part, 1, __ATOMIC_RELAXED);
+        uint64_t       offset = part * self->part_size;
+        uint64_t       end;
+        CichlidHashMd5 md5;
+
+        if (part >= self->n_parts || __atomic_load_n(&self->error, __ATOMIC_RELAXED)) {
+            break;
+        }
+        end = self->file_size - offset < self->part_size ? self->file_size : offset + self->part_size;
+        cichlid_hash_md5_init(&md5);
+        while (offset < end) {
+            size_t  size = end - offset < READ_BUFFER_SIZE ? (size_t)(end - offset) : READ_BUFFER_SIZE;
+            ssize_t n = pread(self->fd, buf, size, (off_t)offset);
+            if (n <= 0) {
+                int expected = 0;
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                /* A file that shrinks while being read is an error too */
+                __atomic_compare_exchange_n(&self->error, &expected, n < 0 ? errno : EIO, false, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED);
+                break;
+            }
+            cichlid_hash_md5_update(&md5, buf, (size_t)n);
+            offset += (uint64_t)n;
+        }
+        cichlid_hash_md5_get_digest(&md5, self->digests[part]);
+    }
+
+    free(buf);
+    return NULL;
+}
+
+static void format_digest(const uint8_t digest[16], char *hex)
+{
+    for (int i = 0; i < 16; ++i) {
+        sprintf(hex + 2 * i, "%.2x", digest[i]);
+    }
+}
+
+/*!
+ * Compute the ETag for a part size, or the plain MD5 of the file if
+ * part_size is 0.
+ * \returns 0 or an errno value
+ */
+static int compute(Etag *self, uint64_t part_size, unsigned int n_threads, char etag[ETAG_SIZE])
+{
+    pthread_t     *threads;
+    size_t         n_started = 0;
+    CichlidHashMd5 md5;
+    uint8_t        digest[16];
+
+    self->part_size = part_size ? part_size : (self->file_size ? self->file_size : 1);
+    self->n_parts = self->file_size ? (size_t)((self->file_size - 1) / self->part_size + 1) : 1;
+    self->digests = malloc(sizeof(*self->digests) * self->n_parts);
+    self->next_part = 0;
+    self->error = 0;
+
+    if (n_threads > self->n_parts) {
+        n_threads = (unsigned int)self->n_parts;
+    }
+    threads = malloc(sizeof(*threads) * n_threads);
+    for (unsigned int i = 0; i < n_threads; ++i) {
+        if (pthread_create(&threads[n_started], NULL, worker, self) == 0) {
+            ++n_started;
+        }
+    }
+    if (n_started == 0) {
+        worker(self);
+    }
+    for (size_t i = 0; i < n_started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    if (self->error == 0) {
+        if (part_size) {
+            cichlid_hash_md5_init(&md5);
+            cichlid_hash_md5_update(&md5, (const char *)self->digests, sizeof(*self->digests) * self->n_parts);
+            cichlid_hash_md5_get_digest(&md5, digest);
+            format_digest(digest, etag);
+            snprintf(etag + 32, ETAG_SIZE - 32, "-%zu", self->n_parts);
+        } else {
+            format_digest(self->digests[0], etag);
+        }
+    }
+    free(self->digests);
+    return self->error;
+}
+
+static bool add_candidate(uint64_t *candidates, size_t *n_candidates, uint64_t file_size, uint64_t n_parts,
+                          uint64_t part_size)
+{
+    if (part_size == 0 || part_size > MAX_PART_SIZE || (file_size + part_size - 1) / part_size != n_parts) {
+        return false;
+    }
+    for (size_t i = 0; i < *n_candidates; ++i) {
+        if (candidates[i] == part_size) {
+            return true;
+        }
+    }
+    if (*n_candidates < MAX_CANDIDATES) {
+        candidates[(*n_candidates)++] = part_size;
+    }
+    return true;
+}
+
+/*!
+ * List the part sizes that split the file into n_parts parts, the defaults
+ * of common tools first, then the other whole MiB sizes and last the
+ * smallest size in bytes.
+ */
+static size_t find_candidates(uint64_t file_size, uint64_t n_parts, uint64_t *candidates)
+{
+    static const uint64_t common[] = { 8, 16, 5, 15, 64, 100, 128, 10, 25, 32, 50, 256, 512, 1024 };
+    uint64_t              smallest = (file_size + n_parts - 1) / n_parts;
+    size_t                n_candidates = 0;
+
+    /* The part size of a single part upload is anything from the file size */
+    if (n_parts == 1) {
+        candidates[n_candidates++] = file_size ? file_size : 1;
+        return n_candidates;
+    }
+    for (size_t i = 0; i < sizeof(common) / sizeof(common[0]); ++i) {
+        add_candidate(candidates, &n_candidates, file_size, n_parts, common[i] * MIB);
+    }
+    for (uint64_t size = (smallest + MIB - 1) / MIB * MIB;
+         add_candidate(candidates, &n_candidates, file_size, n_parts, size); size += MIB) {
+    }
+    add_candidate(candidates, &n_candidates, file_size, n_parts, smallest);
+    return n_candidates;
+}
+
+/*!
+ * Normalize an ETag as shown by S3, with quotes and in either case.
+ */
+static char *parse_target(const char *target)
+{
+    size_t length = strlen(target);
+    char  *etag;
+
+    if (length >= 2 && target[0] == '"' && target[length - 1] == '"') {
+        ++target;
+        length -= 2;
+    }
+    etag = strndup(target, length);
+    for (char *p = etag; *p; ++p) {
+        if (*p >= 'A' && *p <= 'F') {
+            *p = (char)(*p - 'A' + 'a');
+        }
+    }
+    return etag;
+}
+
+int etag_run(const char *path, uint64_t part_size, const char *target, unsigned int n_threads)
+{
+    Etag        self;
+    struct stat st;
+    uint64_t    candidates[MAX_CANDIDATES];
+    size_t      n_candidates = 0;
+    char        etag[ETAG_SIZE] = "";
+    char       *expected = target ? parse_target(target) : NULL;
+    const char *parts = expected ? strrchr(expected, '-') : NULL;
+    int         error = 0;
+    int         rv = 2;
+
+    self.fd = open(path, O_RDONLY);
+    if (self.fd < 0 || fstat(self.fd, &st) != 0) {
+        fprintf(stderr, "Could not read \"%s\": %s\n", path, strerror(errno));
+        if (self.fd >= 0) {
+            close(self.fd);
+        }
+        free(expected);
+        return 2;
+    }
+    self.file_size = (uint64_t)st.st_size;
+
+    if (expected && !parts) {
+        /* Uploaded in one piece, the ETag is the MD5 of the file */
+        candidates[n_candidates++] = 0;
+    } else if (part_size || !expected) {
+        candidates[n_candidates++] = part_size ? part_size : DEFAULT_PART_SIZE;
+    } else {
+        char    *end;
+        uint64_t n_parts = strtoull(parts + 1, &end, 10);
+        if (*end == '\0' && n_parts > 0) {
+            n_candidates = find_candidates(self.file_size, n_parts, candidates);
+        }
+    }
+
+    for (size_t i = 0; i < n_candidates && error == 0; ++i) {
+        error = compute(&self, candidates[i], n_threads, etag);
+        if (error == 0 && (!expected || strcmp(etag, expected) == 0)) {
+            if (candidates[i] && expected && !part_size) {
+                printf("ETag (%s) = %s, part size %" PRIu64 "\n", path, etag, candidates[i]);
+            } else {
+                printf("ETag (%s) = %s\n", path, etag);
+            }
+            rv = 0;
+            break;
+        }
+    }
+
+    if (error) {
+        fprintf(stderr, "Could not read \"%s\": %s\n", path, strerror(error));
+    } else if (rv != 0 && (part_size || !parts)) {
+        printf("ETag (%s) = %s\n", path, etag);
+        fprintf(stderr, "\"%s\" does not match ETag %s\n", path, expected);
+    } else if (rv != 0) {
+        fprintf(stderr, "No part size gives ETag %s for \"%s\"\n", expected, path);
+    }
+    close(self.fd);
+    free(expected);
+    return rv;
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - etag.h
+ *
+ * S3 multipart upload ETags for the command line tool.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ETAG_H
+#define ETAG_H
+
+#include <stdint.h>
+
+/*!
+ * Print the multipart ETag of a file, the MD5 of the concatenated MD5s of
+ * its parts followed by "-" and the number of parts. The parts are hashed
+ * in parallel.
+ * \param path File to hash
+ * \param part_size Upload part size, 0 for the default or to find the part
+ *        size that gives target
+ * \param target ETag to compare with, NULL for none
+ * \param n_threads Number of parts hashed at once
+ * \returns 0 on success, 2 if the file could not be read or does not match
+ *          target
+ */
+int etag_run(const char *path, uint64_t part_size, const char *target, unsigned int n_threads);
+
+#endif /* ETAG_H */
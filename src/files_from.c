@@ -0,0 +1,332 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - files_from.c
+ *
+ * Hashing of a list of files read from stdin for the command line tool.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+#include "files_from.h"
+#include "small_files.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define READ_BUFFER_SIZE (1024 * 1024)
+/* Files a thread reads at once through io_uring */
+#define BATCH_SIZE (64)
+/* Reorder buffer slots per thread, enough to keep the threads busy with full
+ * batches while a slow file holds back the output of the ones after it */
+#define SLOTS_PER_THREAD (2 * BATCH_SIZE)
+
+typedef struct
+{
+    char  *path;
+    char **hashes; /* One per algorithm, NULL if the file could not be read */
+    int    error;
+    bool   done;
+} Slot;
+
+typedef struct
+{
+    const CichlidHashAlgorithm *const *algorithms;
+    size_t                            n_algorithms;
+    const HashSet                    *set;
+    bool                              in_set;
+    Slot                             *slots;
+    size_t                            n_slots;
+    /* Sequence numbers of the next path to be read, hashed and printed, slot
+     * i % n_slots holds path i. Guarded by lock. */
+    size_t                            next_read;
+    size_t                            next_hash;
+    size_t                            next_output;
+    bool                              eof;
+    pthread_mutex_t                   lock;
+    pthread_cond_t                    work;
+    pthread_cond_t                    done;
+} FilesFrom;
+
+static void set_hashes(const FilesFrom *self, Slot *slot, void *contexts[])
+{
+    slot->hashes = malloc(sizeof(*slot->hashes) * self->n_algorithms);
+    for (size_t i = 0; i < self->n_algorithms; ++i) {
+        slot->hashes[i] = self->algorithms[i]->get_hash(contexts[i]);
+    }
+}
+
+static bool hash_file(const FilesFrom *self, Slot *slot, void *contexts[], char *buf)
+{
+    int fd = open(slot->path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    for (size_t i = 0; i < self->n_algorithms; ++i) {
+        self->algorithms[i]->init(contexts[i]);
+    }
+    for (;;) {
+        ssize_t n = read(fd, buf, READ_BUFFER_SIZE);
+        if (n < 0) {
+            int error = errno;
+            if (error == EINTR) {
+                continue;
+            }
+            close(fd);
+            errno = error;
+            return false;
+        } else if (n == 0) {
+            break;
+        }
+        for (size_t i = 0; i < self->n_algorithms; ++i) {
+            self->algorithms[i]->update(contexts[i], buf, (size_t)n);
+        }
+    }
+    close(fd);
+    set_hashes(self, slot, contexts);
+    return true;
+}
+
+/*!
+ * Hash a batch of consecutive slots, reading the files through io_uring when
+ * available. Files that turn out not to be small are read again the usual
+ * way.
+ */
+static void hash_batch(const FilesFrom *self, Slot *slots[], size_t n_slots, SmallFiles *small_files,
+                       void *contexts[], char *buf)
+{
+    SmallFile files[BATCH_SIZE];
+
+    for (size_t i = 0; i < n_slots; ++i) {
+        files[i].path = slots[i]->path;
+    }
+    if (small_files == NULL || !small_files_read(small_files, files, n_slots)) {
+        for (size_t i = 0; i < n_slots; ++i) {
+            slots[i]->hashes = NULL;
+            slots[i]->error = hash_file(self, slots[i], contexts, buf) ? 0 : errno;
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < n_slots; ++i) {
+        slots[i]->hashes = NULL;
+        slots[i]->error = files[i].error;
+        if (files[i].error) {
+            continue;
+        } else if (!files[i].complete) {
+            slots[i]->error = hash_file(self, slots[i], contexts, buf) ? 0 : errno;
+            continue;
+        }
+        for (size_t j = 0; j < self->n_algorithms; ++j) {
+            self->algorithms[j]->init(contexts[j]);
+            self->algorithms[j]->update(contexts[j], files[i].data, files[i].size);
+        }
+        set_hashes(self, slots[i], contexts);
+    }
+}
+
+static void *worker(void *arg)
+{
+    FilesFrom  *self = arg;
+    char       *buf = malloc(READ_BUFFER_SIZE);
+    void      **contexts = malloc(sizeof(*contexts) * self->n_algorithms);
+    SmallFiles *small_files = small_files_new(BATCH_SIZE);
+
+    for (size_t i = 0; i < self->n_algorithms; ++i) {
+        contexts[i] = malloc(self->algorithms[i]->context_size);
+    }
+
+    pthread_mutex_lock(&self->lock);
+    for (;;) {
+        Slot  *slots[BATCH_SIZE];
+        size_t n_slots = 0;
+
+        while (self->next_hash == self->next_read && !self->eof) {
+            pthread_cond_wait(&self->work, &self->lock);
+        }
+        if (self->next_hash == self->next_read) {
+            break;
+        }
+        /* Take what is available rather than wait for a full batch */
+        while (self->next_hash != self->next_read && n_slots < (small_files ? BATCH_SIZE : 1)) {
+            slots[n_slots++] = &self->slots[self->next_hash++ % self->n_slots];
+        }
+        pthread_mutex_unlock(&self->lock);
+
+        /* The slots belong to this thread until they are marked done */
+        hash_batch(self, slots, n_slots, small_files, contexts, buf);
+
+        pthread_mutex_lock(&self->lock);
+        for (size_t i = 0; i < n_slots; ++i) {
+            slots[i]->done = true;
+        }
+        pthread_cond_signal(&self->done);
+    }
+    pthread_mutex_unlock(&self->lock);
+
+    if (small_files) {
+        small_files_free(small_files);
+    }
+
+    for (size_t i = 0; i < self->n_algorithms; ++i) {
+        free(contexts[i]);
+    }
+    free(contexts);
+    free(buf);
+    return NULL;
+}
+
+static void print_slot(const FilesFrom *self, Slot *slot)
+{
+    if (slot->hashes == NULL) {
+        fprintf(stderr, "Could not read \"%s\": %s\n", slot->path, strerror(slot->error));
+    } else {
+        bool print = self->set == NULL || hash_set_contains(self->set, slot->hashes[0]) == self->in_set;
+        for (size_t i = 0; i < self->n_algorithms; ++i) {
+            if (print) {
+                printf("%s (%s) = %s\n", self->algorithms[i]->label, slot->path, slot->hashes[i]);
+            }
+            free(slot->hashes[i]);
+        }
+        free(slot->hashes);
+    }
+    free(slot->path);
+}
+
+/*!
+ * Print the finished files in input order, waiting for the oldest one first
+ * if wait is set.
+ * \returns false if some file could not be read
+ */
+static bool print_done(FilesFrom *self, bool wait)
+{
+    bool ok = true;
+
+    for (;;) {
+        Slot *slot;
+        bool  done;
+
+        pthread_mutex_lock(&self->lock);
+        if (self->next_output == self->next_read) {
+            pthread_mutex_unlock(&self->lock);
+            return ok;
+        }
+        slot = &self->slots[self->next_output % self->n_slots];
+        while (wait && !slot->done) {
+            pthread_cond_wait(&self->done, &self->lock);
+        }
+        done = slot->done;
+        pthread_mutex_unlock(&self->lock);
+        if (!done) {
+            return ok;
+        }
+
+        ok &= slot->hashes != NULL;
+        print_slot(self, slot);
+        pthread_mutex_lock(&self->lock);
+        ++self->next_output;
+        pthread_mutex_unlock(&self->lock);
+        wait = false;
+    }
+}
+
+int files_from_run(const CichlidHashAlgorithm *const algorithms[], size_t n_algorithms, unsigned int n_threads,
+                   char delimiter, const HashSet *set, bool in_set)
+{
+    FilesFrom  self;
+    pthread_t *threads = malloc(sizeof(*threads) * n_threads);
+    size_t     n_started = 0;
+    char      *line = NULL;
+    size_t     line_capacity = 0;
+    ssize_t    line_size;
+    bool       ok = true;
+
+    self.algorithms = algorithms;
+    self.n_algorithms = n_algorithms;
+    self.set = set;
+    self.in_set = in_set;
+    self.n_slots = (size_t)n_threads * SLOTS_PER_THREAD;
+    self.slots = calloc(self.n_slots, sizeof(*self.slots));
+    self.next_read = 0;
+    self.next_hash = 0;
+    self.next_output = 0;
+    self.eof = false;
+    pthread_mutex_init(&self.lock, NULL);
+    pthread_cond_init(&self.work, NULL);
+    pthread_cond_init(&self.done, NULL);
+
+    for (unsigned int i = 0; i < n_threads; ++i) {
+        if (pthread_create(&threads[n_started], NULL, worker, &self) == 0) {
+            ++n_started;
+        }
+    }
+    if (n_started == 0) {
+        fprintf(stderr, "Could not start threads\n");
+        ok = false;
+    }
+
+    while (n_started && (line_size = getdelim(&line, &line_capacity, delimiter, stdin)) >= 0) {
+        Slot *slot;
+
+        if (line_size > 0 && line[line_size - 1] == delimiter) {
+            line[--line_size] = '\0';
+        }
+        if (line_size == 0) {
+            continue;
+        }
+        /* The reorder buffer is full until the oldest file is printed */
+        if (self.next_read - self.next_output == self.n_slots) {
+            ok &= print_done(&self, true);
+        }
+
+        slot = &self.slots[self.next_read % self.n_slots];
+        slot->path = line;
+        slot->done = false;
+        line = NULL;
+        line_capacity = 0;
+        pthread_mutex_lock(&self.lock);
+        ++self.next_read;
+        pthread_cond_signal(&self.work);
+        pthread_mutex_unlock(&self.lock);
+
+        ok &= print_done(&self, false);
+    }
+    free(line);
+
+    pthread_mutex_lock(&self.lock);
+    self.eof = true;
+    pthread_cond_broadcast(&self.work);
+    pthread_mutex_unlock(&self.lock);
+    while (self.next_output != self.next_read) {
+        ok &= print_done(&self, true);
+    }
+    for (size_t i = 0; i < n_started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&self.done);
+    pthread_cond_destroy(&self.work);
+    pthread_mutex_destroy(&self.lock);
+    free(self.slots);
+    free(threads);
+    return ok ? 0 : 2;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - files_from.h
+ *
+ * Hashing of a list of files read from stdin for the command line tool.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FILES_FROM_H
+#define FILES_FROM_H
+
+#include "cichlid_hash.h"
+#include "hash_set.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/*!
+ * Hash the files named on stdin on a pool of threads and print their hashes
+ * in input order, one "LABEL (path) = hash" line per algorithm. At most a
+ * fixed number of files per thread are in flight or waiting to be printed.
+ * \param algorithms Algorithms to compute
+ * \param n_algorithms Number of algorithms
+ * \param n_threads Number of files hashed at once
+ * \param delimiter Character ending each path, '\n' or '\0'
+ * \param set Known hashes of the first algorithm, NULL to print every file
+ * \param in_set Print the files whose hash is in set, or else those whose
+ *        hash is not
+ * \returns 0 on success, 2 if some file could not be read
+ */
+int files_from_run(const CichlidHashAlgorithm *const algorithms[], size_t n_algorithms, unsigned int n_threads,
+                   char delimiter, const HashSet *set, bool in_set);
+
+#endif /* FILES_FROM_H */
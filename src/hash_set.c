@@ -0,0 +1,424 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - hash_set.c
+ *
+ * On-disk index of known hashes for the command line tool, a blocked Bloom
+ * filter in front of a sorted digest table bucketed by prefix, queried
+ * through mmap.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+#include "hash_set.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAGIC "CICHSET1"
+#define MAX_DIGEST_SIZE (64)
+/* The header is padded so that the Bloom filter starts on a cache line */
+#define HEADER_SIZE (128)
+/* The Bloom filter is made of cache line sized blocks, and a lookup only
+ * touches the block selected by the digest */
+#define BLOOM_BLOCK_WORDS (8)
+#define BLOOM_BITS_PER_DIGEST (12)
+#define BLOOM_HASHES (7)
+/* Average number of digests per bucket of the table */
+#define BUCKET_DIGESTS (8)
+#define MAX_BUCKET_BITS (24)
+
+/* Native byte order, an index is not meant to be moved between machines */
+typedef struct
+{
+    char     magic[8];
+    char     algorithm[32];
+    uint32_t digest_size;
+    uint32_t bucket_bits;
+    uint64_t n_digests;
+    uint64_t n_bloom_blocks; /* Power of two */
+} Header;
+
+struct HashSet_
+{
+    const CichlidHashAlgorithm *algorithm;
+    const Header               *header;
+    const uint64_t             *bloom;
+    const uint64_t             *buckets; /* 2^bucket_bits + 1 table offsets */
+    const uint8_t              *digests;
+    void                       *map;
+    size_t                      map_size;
+};
+
+/* Layout of the file after the header */
+static size_t bloom_size(const Header *header)
+{
+    return (size_t)header->n_bloom_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+}
+
+static size_t buckets_size(const Header *header)
+{
+    return (((size_t)1 << header->bucket_bits) + 1) * sizeof(uint64_t);
+}
+
+static uint64_t mix(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return x ^ (x >> 31);
+}
+
+/*!
+ * Digests of weak checksums are not uniform enough to take the Bloom bits
+ * from directly, so they are hashed once more.
+ */
+static uint64_t digest_key(const uint8_t *digest, size_t size)
+{
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+
+    for (size_t i = 0; i < size; ++i) {
+        h = (h ^ digest[i]) * UINT64_C(0x100000001b3);
+    }
+    return mix(h);
+}
+
+/*!
+ * Point block at the Bloom block of the key and fill masks with the bits to
+ * test or set in each of its words.
+ */
+static size_t bloom_position(uint64_t n_blocks, uint64_t key, uint64_t masks[BLOOM_BLOCK_WORDS])
+{
+    uint64_t bits = mix(key + UINT64_C(0x9e3779b97f4a7c15));
+
+    memset(masks, 0, sizeof(uint64_t) * BLOOM_BLOCK_WORDS);
+    for (int i = 0; i < BLOOM_HASHES; ++i, bits >>= 9) {
+        masks[(bits >> 6) & (BLOOM_BLOCK_WORDS - 1)] |= (uint64_t)1 << (bits & 63);
+    }
+    return (size_t)(key & (n_blocks - 1)) * BLOOM_BLOCK_WORDS;
+}
+
+static size_t bucket_of(const Header *header, const uint8_t *digest)
+{
+    uint32_t prefix = 0;
+
+    for (int i = 0; i < 4; ++i) {
+        prefix = (prefix << 8) | ((uint32_t)i < header->digest_size ? digest[i] : 0);
+    }
+    return header->bucket_bits ? prefix >> (32 - header->bucket_bits) : 0;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/*!
+ * \returns The number of bytes of the hex string hash, or 0 if it is not
+ *          one of at most max_size bytes
+ */
+static size_t parse_hex(const char *hash, size_t length, uint8_t *digest, size_t max_size)
+{
+    if (length == 0 || length % 2 || length / 2 > max_size) {
+        return 0;
+    }
+    for (size_t i = 0; i < length / 2; ++i) {
+        int high = hex_value(hash[2 * i]);
+        int low = hex_value(hash[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return 0;
+        }
+        digest[i] = (uint8_t)(high << 4 | low);
+    }
+    return length / 2;
+}
+
+static int compare_digests(const void *a, const void *b, void *size)
+{
+    return memcmp(a, b, *(const size_t *)size);
+}
+
+/*!
+ * \returns The size in bytes of the digests of the algorithm
+ */
+static size_t algorithm_digest_size(const CichlidHashAlgorithm *algorithm)
+{
+    void  *context = malloc(algorithm->context_size);
+    char  *hash;
+    size_t size;
+
+    algorithm->init(context);
+    hash = algorithm->get_hash(context);
+    size = strlen(hash) / 2;
+    free(hash);
+    free(context);
+    return size;
+}
+
+/*!
+ * Find the hash on a line of a hash list. Paths may contain ") = " but the
+ * hash never does, so the last one ends the path.
+ */
+static const char *find_hash(char *line, size_t *length)
+{
+    char *hash = NULL;
+
+    for (char *found = strstr(line, ") = "); found; found = strstr(found + 1, ") = ")) {
+        hash = found;
+    }
+    if (hash) {
+        hash += 4;
+    } else {
+        hash = line + strspn(line, " \t");
+    }
+    *length = strcspn(hash, " \t\r\n");
+    return hash;
+}
+
+static int write_index(const char *path, const Header *header, const uint64_t *bloom, const uint64_t *buckets,
+                       const uint8_t *digests)
+{
+    static const char padding[HEADER_SIZE] = { 0 };
+    FILE             *file = fopen(path, "wb");
+    int               error;
+
+    if (file == NULL) {
+        fprintf(stderr, "Could not open \"%s\": %s\n", path, strerror(errno));
+        return 2;
+    }
+    fwrite(header, sizeof(*header), 1, file);
+    fwrite(padding, HEADER_SIZE - sizeof(*header), 1, file);
+    fwrite(bloom, bloom_size(header), 1, file);
+    fwrite(buckets, buckets_size(header), 1, file);
+    fwrite(digests, header->digest_size, (size_t)header->n_digests, file);
+    error = ferror(file) ? errno : 0;
+    if (fclose(file) != 0 && !error) {
+        error = errno;
+    }
+    if (error) {
+        fprintf(stderr, "Could not write \"%s\": %s\n", path, strerror(error));
+        unlink(path);
+        return 2;
+    }
+    return 0;
+}
+
+int hash_set_build(const CichlidHashAlgorithm *algorithm, FILE *input, const char *path)
+{
+    Header    header;
+    uint8_t  *digests = NULL;
+    size_t    capacity = 0;
+    size_t    n_digests = 0;
+    size_t    digest_size = algorithm_digest_size(algorithm);
+    size_t    line_number = 0;
+    uint64_t *bloom;
+    uint64_t *buckets;
+    char     *line = NULL;
+    size_t    line_capacity = 0;
+    int       rv = 0;
+
+    while (getline(&line, &line_capacity, input) >= 0) {
+        size_t      length;
+        const char *hash = find_hash(line, &length);
+
+        ++line_number;
+        if (length == 0) {
+            continue;
+        }
+        if (n_digests == capacity) {
+            capacity = capacity ? 2 * capacity : 4096;
+            digests = realloc(digests, capacity * digest_size);
+        }
+        if (length != 2 * digest_size || !parse_hex(hash, length, digests + n_digests * digest_size, digest_size)) {
+            fprintf(stderr, "Line %zu is not a %s hash\n", line_number, algorithm->label);
+            rv = 1;
+            break;
+        }
+        ++n_digests;
+    }
+    free(line);
+    if (rv == 0 && ferror(input)) {
+        fprintf(stderr, "Could not read the hash list: %s\n", strerror(errno));
+        rv = 2;
+    }
+    if (rv != 0) {
+        free(digests);
+        return rv;
+    }
+
+    /* Sort and drop duplicates */
+    if (n_digests) {
+        size_t n_unique = 1;
+        qsort_r(digests, n_digests, digest_size, compare_digests, &digest_size);
+        for (size_t i = 1; i < n_digests; ++i) {
+            if (memcmp(digests + i * digest_size, digests + (n_unique - 1) * digest_size, digest_size) != 0) {
+                memmove(digests + n_unique++ * digest_size, digests + i * digest_size, digest_size);
+            }
+        }
+        n_digests = n_unique;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(header.magic));
+    strncpy(header.algorithm, algorithm->name, sizeof(header.algorithm) - 1);
+    header.digest_size = (uint32_t)digest_size;
+    header.n_digests = n_digests;
+    header.n_bloom_blocks = 1;
+    while (header.n_bloom_blocks * BLOOM_BLOCK_WORDS * 64 < (uint64_t)n_digests * BLOOM_BITS_PER_DIGEST) {
+        header.n_bloom_blocks *= 2;
+    }
+    while (header.bucket_bits < MAX_BUCKET_BITS && header.bucket_bits < 8 * digest_size &&
+           ((uint64_t)BUCKET_DIGESTS << (header.bucket_bits + 1)) <= n_digests) {
+        ++header.bucket_bits;
+    }
+
+    bloom = calloc(1, bloom_size(&header));
+    buckets = calloc(1, buckets_size(&header));
+    for (size_t i = 0; i < n_digests; ++i) {
+        const uint8_t *digest = digests + i * digest_size;
+        uint64_t       masks[BLOOM_BLOCK_WORDS];
+        size_t         block = bloom_position(header.n_bloom_blocks, digest_key(digest, digest_size), masks);
+
+        for (int j = 0; j < BLOOM_BLOCK_WORDS; ++j) {
+            bloom[block + (size_t)j] |= masks[j];
+        }
+        /* Count the digests of each bucket, turned into offsets below */
+        ++buckets[bucket_of(&header, digest) + 1];
+    }
+    for (size_t i = 1; i <= (size_t)1 << header.bucket_bits; ++i) {
+        buckets[i] += buckets[i - 1];
+    }
+
+    rv = write_index(path, &header, bloom, buckets, digests);
+    free(buckets);
+    free(bloom);
+    free(digests);
+    return rv;
+}
+
+HashSet *hash_set_open(const char *path)
+{
+    HashSet      *self;
+    const Header *header;
+    struct stat   st;
+    void         *map;
+    int           fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Could not open \"%s\": %s\n", path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NULL;
+    }
+    if ((size_t)st.st_size < HEADER_SIZE) {
+        fprintf(stderr, "\"%s\" is not a hash set\n", path);
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Could not map \"%s\": %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    self = malloc(sizeof(*self));
+    self->map = map;
+    self->map_size = (size_t)st.st_size;
+    self->header = header = map;
+    self->algorithm = cichlid_hash_algorithm_find(header->algorithm);
+    if (memcmp(header->magic, MAGIC, sizeof(header->magic)) != 0 || header->algorithm[31] != '\0' ||
+        self->algorithm == NULL || header->digest_size != algorithm_digest_size(self->algorithm) ||
+        header->bucket_bits > MAX_BUCKET_BITS || header->n_bloom_blocks == 0 ||
+        (header->n_bloom_blocks & (header->n_bloom_blocks - 1)) != 0 ||
+        header->n_bloom_blocks > self->map_size / (BLOOM_BLOCK_WORDS * sizeof(uint64_t)) ||
+        header->n_digests > self->map_size / header->digest_size ||
+        HEADER_SIZE + bloom_size(header) + buckets_size(header) + header->n_digests * header->digest_size !=
+            self->map_size) {
+        fprintf(stderr, "\"%s\" is not a hash set\n", path);
+        hash_set_free(self);
+        return NULL;
+    }
+    self->bloom = (const uint64_t *)(const void *)((const char *)map + HEADER_SIZE);
+    self->buckets = self->bloom + bloom_size(header) / sizeof(uint64_t);
+    self->digests = (const uint8_t *)(self->buckets + buckets_size(header) / sizeof(uint64_t));
+    /* Lookups touch one Bloom block and a bucket or two at random */
+    madvise(map, self->map_size, MADV_RANDOM);
+    return self;
+}
+
+void hash_set_free(HashSet *self)
+{
+    if (self) {
+        munmap(self->map, self->map_size);
+        free(self);
+    }
+}
+
+const CichlidHashAlgorithm *hash_set_get_algorithm(const HashSet *self)
+{
+    return self->algorithm;
+}
+
+bool hash_set_contains(const HashSet *self, const char *hash)
+{
+    const Header *header = self->header;
+    uint8_t       digest[MAX_DIGEST_SIZE];
+    uint64_t      masks[BLOOM_BLOCK_WORDS];
+    size_t        block;
+    uint64_t      low, high;
+
+    if (parse_hex(hash, strlen(hash), digest, sizeof(digest)) != header->digest_size) {
+        return false;
+    }
+
+    block = bloom_position(header->n_bloom_blocks, digest_key(digest, header->digest_size), masks);
+    for (int i = 0; i < BLOOM_BLOCK_WORDS; ++i) {
+        if ((self->bloom[block + (size_t)i] & masks[i]) != masks[i]) {
+            return false;
+        }
+    }
+
+    /* Binary search of the bucket of the prefix */
+    low = self->buckets[bucket_of(header, digest)];
+    high = self->buckets[bucket_of(header, digest) + 1];
+    if (high > header->n_digests || low > high) {
+        return false;
+    }
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        int      order = memcmp(self->digests + middle * header->digest_size, digest, header->digest_size);
+        if (order == 0) {
+            return true;
+        } else if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return false;
+}
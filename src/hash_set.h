@@ -0,0 +1,58 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - hash_set.h
+ *
+ * On-disk index of known hashes for the command line tool, a blocked Bloom
+ * filter in front of a sorted digest table bucketed by prefix, queried
+ * through mmap.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HASH_SET_H
+#define HASH_SET_H
+
+#include "cichlid_hash.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef struct HashSet_ HashSet;
+
+/*!
+ * Build an index of the hashes read from input, one per line, either bare
+ * or as the hash of a "LABEL (path) = hash" or "hash  path" line.
+ * \param algorithm Algorithm that produced the hashes
+ * \param input Hash list
+ * \param path Index file to write
+ * \returns 0 on success, 1 if the list is invalid and 2 on I/O errors
+ */
+int hash_set_build(const CichlidHashAlgorithm *algorithm, FILE *input, const char *path);
+/*!
+ * Map an index built by hash_set_build.
+ * \returns The index or NULL, after printing why, if it could not be opened
+ */
+HashSet *hash_set_open(const char *path);
+void hash_set_free(HashSet *self);
+/*!
+ * \returns The algorithm of the hashes in the index
+ */
+const CichlidHashAlgorithm *hash_set_get_algorithm(const HashSet *self);
+/*!
+ * \param hash Hash as returned by the get_hash function of the algorithm
+ * \returns Whether the index contains the hash
+ */
+bool hash_set_contains(const HashSet *self, const char *hash);
+
+#endif /* HASH_SET_H */
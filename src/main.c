@@ -1,79 +1,789 @@
-#include "cichlid_hash_crc32.h"
-#include "cichlid_hash_md5.h"
-#include "cichlid_hash_sha224.h"
-#include "cichlid_hash_sha256.h"
-#include "cichlid_hash_sha384.h"
-#include "cichlid_hash_sha512.h"
+#define _GNU_SOURCE
+#include "cichlid_hash.h"
+#include "cichlid_hash_chunker.h"
+#include "cichlid_hash_client.h"
+#include "cichlid_hash_fingerprint.h"
+#include "compare.h"
+#include "dedupe.h"
+#include "etag.h"
+#include "files_from.h"
+#include "hash_set.h"
+#include "merkle.h"
+#include "scrub.h"
+#include "tar.h"
+#include "server.h"
+#include "tee.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-static int compute_checksum(const char *filename);
+/* Large enough for BLAKE3 to hash several subtrees per update */
+#define READ_BUFFER_SIZE (1024 * 1024)
+#define MAX_ALGORITHMS (32)
+
+/* FastCDC defaults, 8 KiB average */
+#define CHUNK_MIN_SIZE (2 * 1024)
+#define CHUNK_AVG_SIZE (8 * 1024)
+#define CHUNK_MAX_SIZE (64 * 1024)
+
+enum
+{
+    OPTION_BUILD_SET = 256,
+    OPTION_CHUNK_SIZES,
+    OPTION_COMPARE,
+    OPTION_CPU,
+    OPTION_DAEMON,
+    OPTION_DIGEST_FILE,
+    OPTION_ETAG,
+    OPTION_ETAG_MATCH,
+    OPTION_FILES_FROM,
+    OPTION_FINGERPRINT,
+    OPTION_INTERVAL,
+    OPTION_KNOWN,
+    OPTION_PART_SIZE,
+    OPTION_RATE,
+    OPTION_SAMPLES,
+    OPTION_SAMPLE_SIZE,
+    OPTION_SCRUB,
+    OPTION_SOCKET,
+    OPTION_STATE,
+    OPTION_STORE,
+    OPTION_TAR,
+    OPTION_TREE,
+    OPTION_TREE_DIFF,
+    OPTION_UNKNOWN,
+    OPTION_USE_DAEMON
+};
+
+typedef enum
+{
+    MODE_BUILD_SET,
+    MODE_CHECKSUM,
+    MODE_CHUNKS,
+    MODE_COMPARE,
+    MODE_DAEMON,
+    MODE_DEDUPE,
+    MODE_ETAG,
+    MODE_FILES_FROM,
+    MODE_FINGERPRINT,
+    MODE_SCRUB,
+    MODE_TAR,
+    MODE_TREE,
+    MODE_TREE_DIFF,
+    MODE_TEE
+} Mode;
+
+typedef struct
+{
+    const CichlidHashAlgorithm *algorithms[MAX_ALGORITHMS];
+    size_t                      n_algorithms;
+    Mode                        mode;
+    uint64_t                    chunk_sizes[3]; /* Minimum, average and maximum */
+    unsigned int                n_threads;
+    const char                 *digest_file;    /* Where tee mode prints hashes, stderr if NULL */
+    char                        delimiter;      /* End of each path read by --files-from */
+    ScrubOptions                scrub;
+    const char                 *socket;         /* Daemon socket, the client default if NULL */
+    bool                        use_daemon;     /* Let a running daemon hash the file */
+    const char                 *hash_set;       /* Index built or filtered against */
+    bool                        in_set;         /* Print the files in hash_set rather than the others */
+    uint64_t                    part_size;      /* ETag part size, 0 for the default or to search */
+    const char                 *etag;           /* ETag to compare with */
+    unsigned int                n_samples;      /* Fingerprint samples */
+    size_t                      sample_size;    /* Fingerprint sample size in bytes */
+    const char                 *store;          /* Where --tree saves its directory digests */
+} Options;
+
+static int parse_algorithms(Options *options, const char *list);
+static int parse_chunk_sizes(Options *options, const char *list);
+static int parse_number(const char *value, unsigned long min, unsigned long max, const char *what,
+                        unsigned long *result);
+static unsigned int online_cpus(void);
+static void print_usage(const char *program);
+static int compute_checksum(const Options *options, const char *filename);
+static int compute_checksum_remote(const Options *options, const char *filename, int fd);
+static int compute_chunks(const Options *options, const char *filename);
+static int compute_tee(const Options *options);
+static int compute_fingerprints(const Options *options, char *const filenames[], size_t n_filenames);
 
 int main(int argc, char* argv[])
 {
+    static const struct option long_options[] = {
+        { "algorithms",  required_argument, NULL, 'a'                },
+        { "build-set",   required_argument, NULL, OPTION_BUILD_SET   },
+        { "chunks",      no_argument,       NULL, 'c'                },
+        { "chunk-sizes", required_argument, NULL, OPTION_CHUNK_SIZES },
+        { "compare",     no_argument,       NULL, OPTION_COMPARE     },
+        { "cpu",         required_argument, NULL, OPTION_CPU         },
+        { "daemon",      no_argument,       NULL, OPTION_DAEMON      },
+        { "dedupe",      no_argument,       NULL, 'd'                },
+        { "digest-file", required_argument, NULL, OPTION_DIGEST_FILE },
+        { "etag",        no_argument,       NULL, OPTION_ETAG        },
+        { "etag-match",  required_argument, NULL, OPTION_ETAG_MATCH  },
+        { "files-from",  no_argument,       NULL, OPTION_FILES_FROM  },
+        { "fingerprint", no_argument,       NULL, OPTION_FINGERPRINT },
+        { "help",        no_argument,       NULL, 'h'                },
+        { "interval",    required_argument, NULL, OPTION_INTERVAL    },
+        { "jobs",        required_argument, NULL, 'j'                },
+        { "known",       required_argument, NULL, OPTION_KNOWN       },
+        { "null",        no_argument,       NULL, '0'                },
+        { "part-size",   required_argument, NULL, OPTION_PART_SIZE   },
+        { "rate",        required_argument, NULL, OPTION_RATE        },
+        { "sample-size", required_argument, NULL, OPTION_SAMPLE_SIZE },
+        { "samples",     required_argument, NULL, OPTION_SAMPLES     },
+        { "scrub",       required_argument, NULL, OPTION_SCRUB       },
+        { "socket",      required_argument, NULL, OPTION_SOCKET      },
+        { "state",       required_argument, NULL, OPTION_STATE       },
+        { "store",       required_argument, NULL, OPTION_STORE       },
+        { "tar",         no_argument,       NULL, OPTION_TAR         },
+        { "tee",         no_argument,       NULL, 't'                },
+        { "tree",        no_argument,       NULL, OPTION_TREE        },
+        { "tree-diff",   no_argument,       NULL, OPTION_TREE_DIFF   },
+        { "unknown",     required_argument, NULL, OPTION_UNKNOWN     },
+        { "use-daemon",  no_argument,       NULL, OPTION_USE_DAEMON  },
+        { NULL,          0,                 NULL, 0                  }
+    };
+    Options options = { { NULL }, 0, MODE_CHECKSUM, { CHUNK_MIN_SIZE, CHUNK_AVG_SIZE, CHUNK_MAX_SIZE },
+                        online_cpus(), NULL, '\n',
+                        { NULL, NULL, 0, 100, 0 }, NULL, false, NULL, false, 0, NULL,
+                        CICHLID_HASH_FINGERPRINT_SAMPLES, CICHLID_HASH_FINGERPRINT_SAMPLE_SIZE, NULL };
+    HashSet *set = NULL;
+    unsigned long value;
+    int opt;
     int rv;
-    if (argc == 1) {
-        printf("Usage: %s <filename>\n", argv[0]);
+
+    while ((opt = getopt_long(argc, argv, "0a:cdhj:t", long_options, NULL)) != -1) {
+        switch (opt) {
+        case '0':
+            options.delimiter = '\0';
+            break;
+        case 'a':
+            if (parse_algorithms(&options, optarg)) {
+                return 1;
+            }
+            break;
+        case 'c':
+            options.mode = MODE_CHUNKS;
+            break;
+        case 'd':
+            options.mode = MODE_DEDUPE;
+            break;
+        case 'j':
+            if (parse_number(optarg, 1, 1024, "number of jobs", &value)) {
+                return 1;
+            }
+            options.n_threads = (unsigned int)value;
+            break;
+        case 't':
+            options.mode = MODE_TEE;
+            break;
+        case OPTION_SCRUB:
+            options.mode = MODE_SCRUB;
+            options.scrub.manifest = optarg;
+            break;
+        case OPTION_STATE:
+            options.scrub.state = optarg;
+            break;
+        case OPTION_RATE:
+            if (parse_number(optarg, 1, UINT32_MAX, "rate", &value)) {
+                return 1;
+            }
+            options.scrub.rate = (uint64_t)value * 1024 * 1024;
+            break;
+        case OPTION_CPU:
+            if (parse_number(optarg, 1, 100, "processor share", &value)) {
+                return 1;
+            }
+            options.scrub.cpu_percent = (unsigned int)value;
+            break;
+        case OPTION_INTERVAL:
+            if (parse_number(optarg, 1, UINT32_MAX, "interval", &value)) {
+                return 1;
+            }
+            options.scrub.interval = (unsigned int)value;
+            break;
+        case OPTION_DAEMON:
+            options.mode = MODE_DAEMON;
+            break;
+        case OPTION_SOCKET:
+            options.socket = optarg;
+            break;
+        case OPTION_USE_DAEMON:
+            options.use_daemon = true;
+            break;
+        case OPTION_BUILD_SET:
+            options.mode = MODE_BUILD_SET;
+            options.hash_set = optarg;
+            break;
+        case OPTION_KNOWN:
+        case OPTION_UNKNOWN:
+            options.mode = MODE_FILES_FROM;
+            options.hash_set = optarg;
+            options.in_set = opt == OPTION_KNOWN;
+            break;
+        case OPTION_ETAG:
+            options.mode = MODE_ETAG;
+            break;
+        case OPTION_ETAG_MATCH:
+            options.mode = MODE_ETAG;
+            options.etag = optarg;
+            break;
+        case OPTION_PART_SIZE:
+            /* S3 parts are at most 5 GiB */
+            if (parse_number(optarg, 1, 5 * 1024, "part size", &value)) {
+                return 1;
+            }
+            options.part_size = (uint64_t)value * 1024 * 1024;
+            break;
+        case OPTION_FINGERPRINT:
+            options.mode = MODE_FINGERPRINT;
+            break;
+        case OPTION_SAMPLES:
+            if (parse_number(optarg, 2, 65536, "number of samples", &value)) {
+                return 1;
+            }
+            options.n_samples = (unsigned int)value;
+            break;
+        case OPTION_SAMPLE_SIZE:
+            if (parse_number(optarg, 1, 64 * 1024, "sample size", &value)) {
+                return 1;
+            }
+            options.sample_size = (size_t)value * 1024;
+            break;
+        case OPTION_COMPARE:
+            options.mode = MODE_COMPARE;
+            break;
+        case OPTION_TREE:
+            options.mode = MODE_TREE;
+            break;
+        case OPTION_TREE_DIFF:
+            options.mode = MODE_TREE_DIFF;
+            break;
+        case OPTION_STORE:
+            options.store = optarg;
+            break;
+        case OPTION_TAR:
+            options.mode = MODE_TAR;
+            break;
+        case OPTION_FILES_FROM:
+            options.mode = MODE_FILES_FROM;
+            break;
+        case OPTION_DIGEST_FILE:
+            options.digest_file = optarg;
+            break;
+        case OPTION_CHUNK_SIZES:
+            if (parse_chunk_sizes(&options, optarg)) {
+                return 1;
+            }
+            break;
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    /* Chunks are hashed with a single algorithm, SHA-256 unless given */
+    if (options.mode == MODE_CHUNKS && !options.n_algorithms) {
+        options.algorithms[options.n_algorithms++] = cichlid_hash_algorithm_find("sha256");
+    }
+    /* Duplicates are confirmed with a single fast algorithm, BLAKE3 unless given */
+    if (options.mode == MODE_DEDUPE && !options.n_algorithms) {
+        options.algorithms[options.n_algorithms++] = cichlid_hash_algorithm_find("blake3");
+    }
+    /* Hash lists are of a single algorithm, SHA-256 unless given */
+    if (options.mode == MODE_BUILD_SET && !options.n_algorithms) {
+        options.algorithms[options.n_algorithms++] = cichlid_hash_algorithm_find("sha256");
+    }
+    /* Files are checked against a set with its algorithm, which must come
+     * first if others are given */
+    if (options.mode == MODE_FILES_FROM && options.hash_set) {
+        if ((set = hash_set_open(options.hash_set)) == NULL) {
+            return 2;
+        }
+        if (!options.n_algorithms) {
+            options.algorithms[options.n_algorithms++] = hash_set_get_algorithm(set);
+        } else if (options.algorithms[0] != hash_set_get_algorithm(set)) {
+            fprintf(stderr, "\"%s\" holds %s hashes, which must be the first algorithm\n", options.hash_set,
+                    hash_set_get_algorithm(set)->label);
+            hash_set_free(set);
+            return 1;
+        }
+    }
+    /* Default to all algorithms */
+    if (!options.n_algorithms) {
+        const CichlidHashAlgorithm *algorithm;
+        while ((algorithm = cichlid_hash_algorithm_get(options.n_algorithms)) != NULL) {
+            options.algorithms[options.n_algorithms++] = algorithm;
+        }
+    }
+
+    if (options.mode == MODE_TEE) {
+        rv = compute_tee(&options);
+    } else if (options.mode == MODE_DAEMON) {
+        rv = server_run(options.socket, options.n_threads);
+    } else if (options.mode == MODE_SCRUB) {
+        rv = scrub_run(&options.scrub);
+    } else if (options.mode == MODE_BUILD_SET) {
+        rv = hash_set_build(options.algorithms[0], stdin, options.hash_set);
+    } else if (options.mode == MODE_TAR) {
+        rv = tar_run(options.algorithms, options.n_algorithms, options.n_threads,
+                     optind < argc ? argv[optind] : NULL);
+    } else if (options.mode == MODE_FILES_FROM) {
+        rv = files_from_run(options.algorithms, options.n_algorithms, options.n_threads, options.delimiter, set,
+                            options.in_set);
+        hash_set_free(set);
+    } else if (optind >= argc) {
+        print_usage(argv[0]);
         rv = 1;
+    } else if (options.mode == MODE_CHUNKS) {
+        rv = compute_chunks(&options, argv[optind]);
+    } else if (options.mode == MODE_COMPARE) {
+        if (argc - optind == 2) {
+            rv = compare_run(argv[optind], argv[optind + 1], options.n_threads);
+        } else {
+            print_usage(argv[0]);
+            rv = 1;
+        }
+    } else if (options.mode == MODE_TREE) {
+        rv = merkle_run(argv[optind], options.store, options.n_threads);
+    } else if (options.mode == MODE_TREE_DIFF) {
+        if (argc - optind == 2) {
+            rv = merkle_diff(argv[optind], argv[optind + 1]);
+        } else {
+            print_usage(argv[0]);
+            rv = 1;
+        }
+    } else if (options.mode == MODE_FINGERPRINT) {
+        rv = compute_fingerprints(&options, argv + optind, (size_t)(argc - optind));
+    } else if (options.mode == MODE_ETAG) {
+        rv = etag_run(argv[optind], options.part_size, options.etag, options.n_threads);
+    } else if (options.mode == MODE_DEDUPE) {
+        rv = dedupe_run(options.algorithms[0], options.n_threads, argv + optind, (size_t)(argc - optind));
     } else {
-        rv = compute_checksum(argv[1]);
+        rv = compute_checksum(&options, argv[optind]);
+    }
+    return rv;
+}
+
+static int parse_algorithms(Options *options, const char *list)
+{
+    char *names = strdup(list);
+    char *save_ptr = NULL;
+    int rv = 0;
+
+    for (char *name = strtok_r(names, ",", &save_ptr); name; name = strtok_r(NULL, ",", &save_ptr)) {
+        const CichlidHashAlgorithm *algorithm = cichlid_hash_algorithm_find(name);
+        if (algorithm == NULL) {
+            fprintf(stderr, "Unknown algorithm \"%s\"\n", name);
+            rv = 1;
+            break;
+        } else if (options->n_algorithms == MAX_ALGORITHMS) {
+            fprintf(stderr, "Too many algorithms\n");
+            rv = 1;
+            break;
+        }
+        options->algorithms[options->n_algorithms++] = algorithm;
+    }
+
+    free(names);
+    return rv;
+}
+
+static int parse_chunk_sizes(Options *options, const char *list)
+{
+    const char *p = list;
+
+    for (int i = 0; i < 3; ++i) {
+        char *end;
+        options->chunk_sizes[i] = strtoull(p, &end, 10);
+        if (end == p || *end != (i < 2 ? ',' : '\0')) {
+            fprintf(stderr, "Invalid chunk sizes \"%s\"\n", list);
+            return 1;
+        }
+        p = end + 1;
+    }
+    return 0;
+}
+
+static int parse_number(const char *value, unsigned long min, unsigned long max, const char *what,
+                        unsigned long *result)
+{
+    char *end;
+
+    errno = 0;
+    *result = strtoul(value, &end, 10);
+    if (end == value || *end != '\0' || errno || *result < min || *result > max) {
+        fprintf(stderr, "Invalid %s \"%s\"\n", what, value);
+        return 1;
     }
     return 0;
 }
 
+static unsigned int online_cpus(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    /* -1 if the count is not available */
+    return n > 0 ? (unsigned int)n : 1;
+}
+
+static void print_usage(const char *program)
+{
+    const CichlidHashAlgorithm *algorithm;
+
+    printf("Usage: %s [-a <algorithm>[,<algorithm>...]] <filename>\n", program);
+    printf("       %s -c [--chunk-sizes <min>,<avg>,<max>] [-a <algorithm>] <filename>\n", program);
+    printf("       %s -d [-j <jobs>] [-a <algorithm>] <path>...\n", program);
+    printf("       %s --etag [--part-size <MiB>] [--etag-match <etag>] [-j <jobs>] <filename>\n", program);
+    printf("       %s --compare [-j <jobs>] <filename> <filename>\n", program);
+    printf("       %s --tree [--store <filename>] [-j <jobs>] <directory>\n", program);
+    printf("       %s --tree-diff <store> <store>\n", program);
+    printf("       %s --fingerprint [--samples <n>] [--sample-size <KiB>] [-j <jobs>] <filename>...\n",
+           program);
+    printf("       %s -t [--digest-file <filename>] [-a <algorithm>[,<algorithm>...]]\n", program);
+    printf("       %s --files-from [-0] [-j <jobs>] [-a <algorithm>[,<algorithm>...]]\n", program);
+    printf("       %s --tar [-a <algorithm>[,<algorithm>...]] [<archive>]\n", program);
+    printf("       %s --scrub <manifest> [--state <filename>] [--rate <MiB/s>] [--cpu <percent>]\n"
+           "               [--interval <seconds>]\n", program);
+    printf("       %s --build-set <index> [-a <algorithm>]\n", program);
+    printf("       %s --files-from (--known|--unknown) <index> [-0] [-j <jobs>]\n", program);
+    printf("       %s --daemon [--socket <path>] [-j <jobs>]\n", program);
+    printf("\n  -c, --chunks  Split the file into content-defined chunks and print the\n"
+           "                offset, size and hash of each\n");
+    printf("  -d, --dedupe  Search files and directories for files with identical\n"
+           "                contents and print each group of duplicates\n");
+    printf("  -j, --jobs    Number of files hashed at once when searching for\n"
+           "                duplicates, reading --files-from or digesting trees, of\n"
+           "                ranges, parts or samples read at once for comparisons, ETags\n"
+           "                and fingerprints, or of threads BLAKE3 splits large reads\n"
+           "                over when hashing a file or --tar, defaults to the number\n"
+           "                of processors\n");
+    printf("  --etag        Print the S3 multipart upload ETag of the file, for parts of\n"
+           "                --part-size MiB, 8 by default. With --etag-match the ETag is\n"
+           "                compared with the given one, and without --part-size the part\n"
+           "                size that gives it is searched for\n");
+    printf("  --compare     Compare two files a range at a time in parallel, and print\n"
+           "                the offset of the first difference\n");
+    printf("  --tree        Print the SHA-256 Merkle digest of a directory tree, made of\n"
+           "                the names, modes and contents of everything in it. The\n"
+           "                digests of every directory are saved to the --store file\n");
+    printf("  --tree-diff   Print the entries added (+), removed (-) and modified (M)\n"
+           "                between the trees of two stores, only reading the\n"
+           "                directories whose digests differ\n");
+    printf("  --fingerprint Print a fingerprint of each file made of its size and the hash\n"
+           "                of --samples blocks of --sample-size KiB, 16 of 64 KiB by\n"
+           "                default, spread from its start to its end. Cheap to compute\n"
+           "                for any file size, but blind to changes between the blocks\n");
+    printf("  -t, --tee     Copy stdin to stdout while hashing it and print the hashes\n"
+           "                to stderr, or to the file given by --digest-file, at the end\n");
+    printf("  --files-from  Hash the files named on stdin, one per line, and print\n"
+           "                their hashes in the same order\n");
+    printf("  -0, --null    Paths read by --files-from end with NUL instead of newline\n");
+    printf("  --tar         Hash the regular files in a tar archive, or one read from\n"
+           "                stdin, without extracting it and print them like --files-from\n");
+    printf("  --scrub       Verify the files of a manifest printed by --files-from at idle\n"
+           "                I/O priority, printing those that are missing or changed.\n"
+           "                Progress is saved to the --state file and resumed from, the\n"
+           "                reading rate and processor share can be limited, and with\n"
+           "                --interval a new pass starts every interval seconds\n");
+    printf("  --build-set   Index the hashes read from stdin, one per line, for --known\n"
+           "                and --unknown. The lines may also be those printed by\n"
+           "                --files-from or sha256sum and the like\n");
+    printf("  --known       Only print the files whose hash is in the index\n");
+    printf("  --unknown     Only print the files whose hash is not in the index\n");
+    printf("  --daemon      Hash files passed by other cichlid processes on a Unix\n"
+           "                socket, serving as many of them at once as --jobs\n");
+    printf("  --use-daemon  Let a running daemon hash the file, falling back to hashing\n"
+           "                it here if none is listening on the socket\n");
+    printf("  --socket      Socket of the daemon, defaults to $CICHLID_SOCKET or\n"
+           "                cichlid.sock in $XDG_RUNTIME_DIR\n");
+    printf("\nAlgorithms:");
+    for (size_t i = 0; (algorithm = cichlid_hash_algorithm_get(i)) != NULL; ++i) {
+        printf(" %s", algorithm->name);
+    }
+    printf("\n");
+}
 
-static int compute_checksum(const char *filename)
+/*!
+ * Hash size zero bytes with each algorithm, directly when it supports that
+ * and otherwise by feeding it zeroed copies of buf.
+ */
+static void update_zeros(const Options *options, void *contexts[], char *buf, uint64_t size)
+{
+    bool zeroed = false;
+
+    for (size_t i = 0; i < options->n_algorithms; ++i) {
+        const CichlidHashAlgorithm *algorithm = options->algorithms[i];
+        if (algorithm->update_zeros) {
+            algorithm->update_zeros(contexts[i], size);
+            continue;
+        }
+        if (!zeroed) {
+            memset(buf, 0, READ_BUFFER_SIZE);
+            zeroed = true;
+        }
+        for (uint64_t left = size; left > 0;) {
+            size_t n = left < READ_BUFFER_SIZE ? (size_t)left : READ_BUFFER_SIZE;
+            algorithm->update(contexts[i], buf, n);
+            left -= n;
+        }
+    }
+}
+
+/*!
+ * Hash the data read from fd until end, or until the end of the file if end is
+ * negative.
+ * \returns 0 on success or 2 on read errors
+ */
+static int update_data(const Options *options, void *contexts[], char *buf, int fd, off_t offset, off_t end)
+{
+    while (end < 0 || offset < end) {
+        size_t  size = end < 0 || end - offset > READ_BUFFER_SIZE ? READ_BUFFER_SIZE : (size_t)(end - offset);
+        ssize_t n = read(fd, buf, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 2;
+        } else if (n == 0) {
+            break;
+        }
+        for (size_t i = 0; i < options->n_algorithms; ++i) {
+            options->algorithms[i]->update(contexts[i], buf, (size_t)n);
+        }
+        offset += n;
+    }
+    return 0;
+}
+
+/*!
+ * Hash a regular file one data extent at a time, letting the holes between
+ * them be accounted for without reading them. Falls back to reading the rest
+ * of the file if the file system cannot report holes.
+ */
+static int update_sparse(const Options *options, void *contexts[], char *buf, int fd, off_t file_size)
+{
+    off_t offset = 0;
+
+    while (offset < file_size) {
+        off_t data = lseek(fd, offset, SEEK_DATA);
+        off_t hole;
+        int   rv;
+
+        if (data < 0 && errno == ENXIO) {
+            /* Only a hole is left */
+            data = file_size;
+        } else if (data < 0 || lseek(fd, offset, SEEK_SET) < 0) {
+            return update_data(options, contexts, buf, fd, offset, -1);
+        }
+        if (data > offset) {
+            update_zeros(options, contexts, buf, (uint64_t)(data - offset));
+            offset = data;
+        }
+        if (offset >= file_size) {
+            break;
+        }
+
+        hole = lseek(fd, offset, SEEK_HOLE);
+        if (hole < 0 || lseek(fd, offset, SEEK_SET) < 0) {
+            return update_data(options, contexts, buf, fd, offset, -1);
+        }
+        if ((rv = update_data(options, contexts, buf, fd, offset, hole)) != 0) {
+            return rv;
+        }
+        offset = hole;
+    }
+    return 0;
+}
+
+static int compute_checksum(const Options *options, const char *filename)
 {
     int rv = 0;
-    char buf[1024];
-    size_t fread ( void * ptr, size_t size, size_t count, FILE * stream );
-    FILE *fid = fopen(filename, "r");
-    if (fid == NULL) {
+    char *buf = malloc(READ_BUFFER_SIZE);
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
         rv = 2;
     } else {
-        CichlidHashCrc32 crc32;
-        cichlid_hash_crc32_init(&crc32);
-        CichlidHashMd5 md5;
-        cichlid_hash_md5_init(&md5);
-        CichlidHashSha224 sha224;
-        cichlid_hash_sha224_init(&sha224);
-        CichlidHashSha256 sha256;
-        cichlid_hash_sha256_init(&sha256);
-        CichlidHashSha384 sha384;
-        cichlid_hash_sha384_init(&sha384);
-        CichlidHashSha512 sha512;
-        cichlid_hash_sha512_init(&sha512);
-
-        while (!feof(fid)) {
-            size_t read_elems = fread(buf, sizeof(*buf), sizeof(buf), fid);
-            cichlid_hash_crc32_update(&crc32, buf, read_elems);
-            cichlid_hash_md5_update(&md5, buf, read_elems);
-            cichlid_hash_sha224_update(&sha224, buf, read_elems);
-            cichlid_hash_sha256_update(&sha256, buf, read_elems);
-            cichlid_hash_sha384_update(&sha384, buf, read_elems);
-            cichlid_hash_sha512_update(&sha512, buf, read_elems);
-        }
-
-        printf("Hashes of \"%s\"\n", filename);
-        char *hash_string = cichlid_hash_crc32_get_hash(&crc32);
-        printf(" CRC32: %s\n", hash_string);
-        free(hash_string);
-        hash_string = cichlid_hash_md5_get_hash(&md5);
-        printf("   MD5: %s\n", hash_string);
-        free(hash_string);
-        hash_string = cichlid_hash_sha224_get_hash(&sha224);
-        printf("SHA224: %s\n", hash_string);
-        free(hash_string);
-        hash_string = cichlid_hash_sha256_get_hash(&sha256);
-        printf("SHA256: %s\n", hash_string);
-        free(hash_string);
-        hash_string = cichlid_hash_sha384_get_hash(&sha384);
-        printf("SHA384: %s\n", hash_string);
-        free(hash_string);
-        hash_string = cichlid_hash_sha512_get_hash(&sha512);
-        printf("SHA512: %s\n", hash_string);
-        free(hash_string);
+        void *contexts[MAX_ALGORITHMS];
+        struct stat st;
+
+        if (options->use_daemon && compute_checksum_remote(options, filename, fd) == 0) {
+            close(fd);
+            free(buf);
+            return 0;
+        }
+
+        for (size_t i = 0; i < options->n_algorithms; ++i) {
+            const CichlidHashAlgorithm *algorithm = options->algorithms[i];
+            contexts[i] = malloc(algorithm->context_size);
+            algorithm->init(contexts[i]);
+            if (algorithm->set_threads) {
+                algorithm->set_threads(contexts[i], options->n_threads);
+            }
+        }
+
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            rv = update_sparse(options, contexts, buf, fd, st.st_size);
+        } else {
+            rv = update_data(options, contexts, buf, fd, 0, -1);
+        }
+
+        if (rv == 0) {
+            printf("Hashes of \"%s\"\n", filename);
+        } else {
+            fprintf(stderr, "Could not read \"%s\": %s\n", filename, strerror(errno));
+        }
+        for (size_t i = 0; i < options->n_algorithms; ++i) {
+            if (rv == 0) {
+                char *hash_string = options->algorithms[i]->get_hash(contexts[i]);
+                printf("%10s: %s\n", options->algorithms[i]->label, hash_string);
+                free(hash_string);
+            }
+            free(contexts[i]);
+        }
+        close(fd);
+    }
+    free(buf);
+    return rv;
+}
+
+/*!
+ * Hash the file on a running daemon.
+ * \returns 0 if the hashes were printed, or -1 to hash the file locally
+ */
+static int compute_checksum_remote(const Options *options, const char *filename, int fd)
+{
+    char   names[CICHLID_HASH_CLIENT_ALGORITHMS_SIZE];
+    char  *hashes[MAX_ALGORITHMS];
+    size_t length = 0;
+    int    connection;
+    int    n_hashes;
+
+    for (size_t i = 0; i < options->n_algorithms && length < sizeof(names); ++i) {
+        length += (size_t)snprintf(names + length, sizeof(names) - length, "%s%s", i ? "," : "",
+                                   options->algorithms[i]->name);
+    }
+    if (length >= sizeof(names) || (connection = cichlid_hash_client_connect(options->socket)) < 0) {
+        return -1;
+    }
+    n_hashes = cichlid_hash_client_hash(connection, names, fd, 0, CICHLID_HASH_CLIENT_TO_END, hashes,
+                                        MAX_ALGORITHMS);
+    close(connection);
+    if (n_hashes != (int)options->n_algorithms) {
+        for (int i = 0; i < n_hashes; ++i) {
+            free(hashes[i]);
+        }
+        return -1;
+    }
+
+    printf("Hashes of \"%s\"\n", filename);
+    for (size_t i = 0; i < options->n_algorithms; ++i) {
+        printf("%10s: %s\n", options->algorithms[i]->label, hashes[i]);
+        free(hashes[i]);
+    }
+    return 0;
+}
+
+static void print_chunk(void *user_data, const CichlidHashChunk *chunk)
+{
+    (void)user_data;
+    printf("%12" PRIu64 " %8" PRIu64 " %s\n", chunk->offset, chunk->size, chunk->hash);
+}
+
+static int compute_chunks(const Options *options, const char *filename)
+{
+    int                 rv = 0;
+    char               *buf;
+    FILE               *fid;
+    CichlidHashChunker  chunker;
+
+    if (!cichlid_hash_chunker_init(&chunker, options->algorithms[0], options->chunk_sizes[0],
+                                   options->chunk_sizes[1], options->chunk_sizes[2], print_chunk, NULL)) {
+        fprintf(stderr, "Invalid chunk sizes, the average must be a power of two between the minimum "
+                "(at least %d) and the maximum\n", CICHLID_HASH_CHUNKER_MIN_SIZE);
+        return 1;
+    }
+
+    fid = fopen(filename, "r");
+    if (fid == NULL) {
+        cichlid_hash_chunker_destroy(&chunker);
+        return 2;
+    }
+
+    buf = malloc(READ_BUFFER_SIZE);
+    printf("Chunks of \"%s\" (%s)\n", filename, options->algorithms[0]->label);
+    while (!feof(fid)) {
+        size_t read_elems = fread(buf, sizeof(*buf), READ_BUFFER_SIZE, fid);
+        if (ferror(fid)) {
+            fprintf(stderr, "Could not read \"%s\": %s\n", filename, strerror(errno));
+            rv = 2;
+            break;
+        }
+        cichlid_hash_chunker_update(&chunker, buf, read_elems);
+    }
+    if (rv == 0) {
+        cichlid_hash_chunker_finish(&chunker);
+    }
+
+    cichlid_hash_chunker_destroy(&chunker);
+    fclose(fid);
+    free(buf);
+    return rv;
+}
+
+static int compute_tee(const Options *options)
+{
+    FILE *output = stderr;
+    int   rv;
+
+    if (options->digest_file) {
+        output = fopen(options->digest_file, "w");
+        if (output == NULL) {
+            fprintf(stderr, "Could not open \"%s\": %s\n", options->digest_file, strerror(errno));
+            return 2;
+        }
+    }
+    rv = tee_run(options->algorithms, options->n_algorithms, output);
+    if (output != stderr && fclose(output) != 0) {
+        fprintf(stderr, "Could not write \"%s\": %s\n", options->digest_file, strerror(errno));
+        rv = 2;
+    }
+    return rv;
+}
+
+static int compute_fingerprints(const Options *options, char *const filenames[], size_t n_filenames)
+{
+    int rv = 0;
+
+    for (size_t i = 0; i < n_filenames; ++i) {
+        char *fingerprint = NULL;
+        int   fd = open(filenames[i], O_RDONLY);
+
+        if (fd >= 0) {
+            fingerprint = cichlid_hash_fingerprint_fd(fd, options->n_samples, options->sample_size,
+                                                      options->n_threads);
+        }
+        if (fingerprint == NULL) {
+            fprintf(stderr, "Could not read \"%s\": %s\n", filenames[i], strerror(errno));
+            rv = 2;
+        } else {
+            printf("Fingerprint (%s) = %s\n", filenames[i], fingerprint);
+            free(fingerprint);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
     }
     return rv;
 }
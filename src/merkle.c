@@ -0,0 +1,668 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - merkle.c
+ *
+ * Merkle digests of directory trees for the command line tool, with a store
+ * of the digest of every directory so that two trees can be compared one
+ * differing subtree at a time.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+#include "merkle.h"
+#include "cichlid_hash_sha256.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define READ_BUFFER_SIZE (1024 * 1024)
+#define DIGEST_SIZE (32)
+#define MAGIC "CICHTREE"
+#define NO_PARENT (SIZE_MAX)
+
+typedef struct
+{
+    char    *name;
+    size_t   parent;
+    size_t   first_child; /* Children are consecutive and sorted by name */
+    size_t   n_children;
+    uint32_t mode;
+    uint8_t  digest[DIGEST_SIZE];
+} Node;
+
+typedef struct
+{
+    const char *root;
+    Node       *nodes;    /* Every node comes after its parent */
+    size_t      n_nodes;
+    size_t      capacity;
+    size_t     *files;    /* Regular files to hash */
+    size_t      n_files;
+    size_t      next_file; /* Atomic */
+    int         failed;    /* Atomic */
+} Tree;
+
+/* Store layout, in native byte order: the header, the directories sorted by
+ * path, the entries of each directory in turn and the names */
+typedef struct
+{
+    char     magic[8];
+    uint64_t n_dirs;
+    uint64_t n_entries;
+    uint64_t strings_size;
+} StoreHeader;
+
+typedef struct
+{
+    uint64_t path_offset;
+    uint32_t path_size;
+    uint32_t n_entries;
+    uint64_t first_entry;
+    uint8_t  digest[DIGEST_SIZE];
+} StoreDir;
+
+typedef struct
+{
+    uint64_t name_offset;
+    uint32_t name_size;
+    uint32_t mode;
+    uint8_t  digest[DIGEST_SIZE];
+} StoreEntry;
+
+typedef struct
+{
+    const StoreHeader *header;
+    const StoreDir    *dirs;
+    const StoreEntry  *entries;
+    const char        *strings;
+    void              *map;
+    size_t             map_size;
+} Store;
+
+/*!
+ * \returns The path of a node relative to the root, "" for the root itself
+ */
+static char *relative_path(const Tree *tree, size_t index)
+{
+    size_t length = 0;
+    char  *path;
+    char  *p;
+
+    for (size_t i = index; tree->nodes[i].parent != NO_PARENT; i = tree->nodes[i].parent) {
+        length += strlen(tree->nodes[i].name) + 1;
+    }
+    /* No separator before the first component */
+    length -= length ? 1 : 0;
+    path = malloc(length + 1);
+    p = path + length;
+    *p = '\0';
+    for (size_t i = index; tree->nodes[i].parent != NO_PARENT; i = tree->nodes[i].parent) {
+        size_t size = strlen(tree->nodes[i].name);
+        p -= size;
+        memcpy(p, tree->nodes[i].name, size);
+        if (p != path) {
+            *--p = '/';
+        }
+    }
+    return path;
+}
+
+static char *full_path(const Tree *tree, size_t index)
+{
+    char *relative = relative_path(tree, index);
+    char *path = malloc(strlen(tree->root) + strlen(relative) + 2);
+
+    sprintf(path, *relative ? "%s/%s" : "%s%s", tree->root, relative);
+    free(relative);
+    return path;
+}
+
+static void fail(Tree *tree, size_t index, int error)
+{
+    char *path = full_path(tree, index);
+
+    fprintf(stderr, "Could not read \"%s\": %s\n", path, strerror(error));
+    free(path);
+    __atomic_store_n(&tree->failed, 1, __ATOMIC_RELAXED);
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static size_t add_node(Tree *tree, char *name, size_t parent, uint32_t mode)
+{
+    Node *node;
+
+    if (tree->n_nodes == tree->capacity) {
+        tree->capacity = tree->capacity ? 2 * tree->capacity : 1024;
+        tree->nodes = realloc(tree->nodes, sizeof(*tree->nodes) * tree->capacity);
+    }
+    node = &tree->nodes[tree->n_nodes];
+    node->name = name;
+    node->parent = parent;
+    node->first_child = 0;
+    node->n_children = 0;
+    node->mode = mode;
+    cichlid_sha256("", 0, node->digest);
+    return tree->n_nodes++;
+}
+
+/*!
+ * Add the entries of a directory as its children, sorted by name.
+ * \returns false if the directory could not be read
+ */
+static bool read_dir(Tree *tree, size_t index)
+{
+    char          *path = full_path(tree, index);
+    DIR           *dir = opendir(path);
+    struct dirent *entry;
+    char         **names = NULL;
+    size_t         n_names = 0;
+    size_t         capacity = 0;
+
+    free(path);
+    if (dir == NULL) {
+        fail(tree, index, errno);
+        return false;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (n_names == capacity) {
+            capacity = capacity ? 2 * capacity : 64;
+            names = realloc(names, sizeof(*names) * capacity);
+        }
+        names[n_names++] = strdup(entry->d_name);
+    }
+    qsort(names, n_names, sizeof(*names), compare_names);
+
+    tree->nodes[index].first_child = tree->n_nodes;
+    tree->nodes[index].n_children = n_names;
+    for (size_t i = 0; i < n_names; ++i) {
+        struct stat st;
+        size_t      child;
+
+        int         error = 0;
+
+        if (fstatat(dirfd(dir), names[i], &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            error = errno;
+            st.st_mode = 0;
+        }
+        child = add_node(tree, names[i], index, (uint32_t)(st.st_mode & (S_IFMT | 07777)));
+        if (error) {
+            fail(tree, child, error);
+        } else if (S_ISREG(st.st_mode)) {
+            if (tree->n_files % 1024 == 0) {
+                tree->files = realloc(tree->files, sizeof(*tree->files) * (tree->n_files + 1024));
+            }
+            tree->files[tree->n_files++] = child;
+        } else if (S_ISLNK(st.st_mode)) {
+            char    target[PATH_MAX];
+            ssize_t size = readlinkat(dirfd(dir), names[i], target, sizeof(target));
+            if (size < 0) {
+                fail(tree, child, errno);
+            } else {
+                cichlid_sha256(target, (size_t)size, tree->nodes[child].digest);
+            }
+        }
+    }
+    free(names);
+    closedir(dir);
+    return true;
+}
+
+static void *hash_files(void *arg)
+{
+    Tree *tree = arg;
+    char *buf = malloc(READ_BUFFER_SIZE);
+
+    for (;;) {
+        size_t            i = __atomic_fetch_add(&tree->next_file, 1, __ATOMIC_RELAXED);
+        size_t            index;
+        char             *path;
+        int               fd;
+        CichlidHashSha256 sha256;
+        ssize_t           n;
+
+        if (i >= tree->n_files) {
+            break;
+        }
+        index = tree->files[i];
+        path = full_path(tree, index);
+        fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+        free(path);
+        if (fd < 0) {
+            fail(tree, index, errno);
+            continue;
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        cichlid_hash_sha256_init(&sha256);
+        while ((n = read(fd, buf, READ_BUFFER_SIZE)) != 0) {
+            if (n < 0 && errno != EINTR) {
+                break;
+            } else if (n > 0) {
+                cichlid_hash_sha256_update(&sha256, buf, (size_t)n);
+            }
+        }
+        if (n < 0) {
+            fail(tree, index, errno);
+        } else {
+            cichlid_hash_sha2_32_get_digest(&sha256, tree->nodes[index].digest);
+        }
+        close(fd);
+    }
+
+    free(buf);
+    return NULL;
+}
+
+static void digest_dir(Tree *tree, size_t index)
+{
+    Node             *node = &tree->nodes[index];
+    CichlidHashSha256 sha256;
+    char              mode[16];
+
+    cichlid_hash_sha256_init(&sha256);
+    for (size_t i = node->first_child; i < node->first_child + node->n_children; ++i) {
+        const Node *child = &tree->nodes[i];
+        int         size = snprintf(mode, sizeof(mode), "%o ", child->mode);
+
+        cichlid_hash_sha256_update(&sha256, mode, (size_t)size);
+        /* With the terminating NUL, which no name contains */
+        cichlid_hash_sha256_update(&sha256, child->name, strlen(child->name) + 1);
+        cichlid_hash_sha256_update(&sha256, (const char *)child->digest, DIGEST_SIZE);
+    }
+    cichlid_hash_sha2_32_get_digest(&sha256, node->digest);
+}
+
+typedef struct
+{
+    char  *path;
+    size_t index;
+} DirPath;
+
+static int compare_dir_paths(const void *a, const void *b)
+{
+    return strcmp(((const DirPath *)a)->path, ((const DirPath *)b)->path);
+}
+
+static bool write_store(const Tree *tree, const char *path)
+{
+    StoreHeader header;
+    DirPath    *dirs = malloc(sizeof(*dirs) * tree->n_nodes);
+    size_t      n_dirs = 0;
+    uint64_t    n_entries = 0;
+    uint64_t    strings_size = 0;
+    FILE       *file;
+    int         error = 0;
+
+    for (size_t i = 0; i < tree->n_nodes; ++i) {
+        if (S_ISDIR(tree->nodes[i].mode)) {
+            dirs[n_dirs].path = relative_path(tree, i);
+            dirs[n_dirs++].index = i;
+        }
+    }
+    qsort(dirs, n_dirs, sizeof(*dirs), compare_dir_paths);
+
+    if ((file = fopen(path, "wb")) == NULL) {
+        error = errno;
+    } else {
+        memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.n_dirs = n_dirs;
+        header.n_entries = tree->n_nodes - 1;
+        header.strings_size = 0;
+        for (size_t i = 0; i < n_dirs; ++i) {
+            const Node *node = &tree->nodes[dirs[i].index];
+            header.strings_size += strlen(dirs[i].path);
+            for (size_t j = node->first_child; j < node->first_child + node->n_children; ++j) {
+                header.strings_size += strlen(tree->nodes[j].name);
+            }
+        }
+        fwrite(&header, sizeof(header), 1, file);
+
+        for (size_t i = 0; i < n_dirs; ++i) {
+            const Node *node = &tree->nodes[dirs[i].index];
+            StoreDir    dir;
+
+            dir.path_offset = strings_size;
+            dir.path_size = (uint32_t)strlen(dirs[i].path);
+            dir.n_entries = (uint32_t)node->n_children;
+            dir.first_entry = n_entries;
+            memcpy(dir.digest, node->digest, DIGEST_SIZE);
+            fwrite(&dir, sizeof(dir), 1, file);
+            strings_size += dir.path_size;
+            for (size_t j = node->first_child; j < node->first_child + node->n_children; ++j) {
+                strings_size += strlen(tree->nodes[j].name);
+            }
+            n_entries += node->n_children;
+        }
+
+        /* Each directory path is followed by the names of its entries */
+        strings_size = 0;
+        for (size_t i = 0; i < n_dirs; ++i) {
+            const Node *node = &tree->nodes[dirs[i].index];
+            strings_size += strlen(dirs[i].path);
+            for (size_t j = node->first_child; j < node->first_child + node->n_children; ++j) {
+                StoreEntry entry;
+                entry.name_offset = strings_size;
+                entry.name_size = (uint32_t)strlen(tree->nodes[j].name);
+                entry.mode = tree->nodes[j].mode;
+                memcpy(entry.digest, tree->nodes[j].digest, DIGEST_SIZE);
+                fwrite(&entry, sizeof(entry), 1, file);
+                strings_size += entry.name_size;
+            }
+        }
+        for (size_t i = 0; i < n_dirs; ++i) {
+            const Node *node = &tree->nodes[dirs[i].index];
+            fputs(dirs[i].path, file);
+            for (size_t j = node->first_child; j < node->first_child + node->n_children; ++j) {
+                fputs(tree->nodes[j].name, file);
+            }
+        }
+        error = ferror(file) ? errno : 0;
+        if (fclose(file) != 0 && !error) {
+            error = errno;
+        }
+    }
+
+    for (size_t i = 0; i < n_dirs; ++i) {
+        free(dirs[i].path);
+    }
+    free(dirs);
+    if (error) {
+        fprintf(stderr, "Could not write \"%s\": %s\n", path, strerror(error));
+        return false;
+    }
+    return true;
+}
+
+int merkle_run(const char *path, const char *store, unsigned int n_threads)
+{
+    Tree        tree = { path, NULL, 0, 0, NULL, 0, 0, 0 };
+    struct stat st;
+    pthread_t  *threads;
+    size_t      n_started = 0;
+    char        hex[2 * DIGEST_SIZE + 1];
+    int         rv;
+
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "Could not read \"%s\": %s\n", path, strerror(errno ? errno : ENOTDIR));
+        return 2;
+    }
+    add_node(&tree, strdup(""), NO_PARENT, (uint32_t)(st.st_mode & (S_IFMT | 07777)));
+    /* Every directory is read after its parent, so the nodes end up in an
+     * order where children come after their parents */
+    for (size_t i = 0; i < tree.n_nodes; ++i) {
+        if (S_ISDIR(tree.nodes[i].mode)) {
+            read_dir(&tree, i);
+        }
+    }
+
+    threads = malloc(sizeof(*threads) * (n_threads ? n_threads : 1));
+    for (unsigned int i = 0; i < n_threads && i < tree.n_files; ++i) {
+        if (pthread_create(&threads[n_started], NULL, hash_files, &tree) == 0) {
+            ++n_started;
+        }
+    }
+    if (n_started == 0) {
+        hash_files(&tree);
+    }
+    for (size_t i = 0; i < n_started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    for (size_t i = tree.n_nodes; i-- > 0;) {
+        if (S_ISDIR(tree.nodes[i].mode)) {
+            digest_dir(&tree, i);
+        }
+    }
+
+    for (int i = 0; i < DIGEST_SIZE; ++i) {
+        sprintf(hex + 2 * i, "%.2x", tree.nodes[0].digest[i]);
+    }
+    printf("Tree (%s) = %s\n", path, hex);
+    rv = tree.failed ? 2 : 0;
+    if (store && !write_store(&tree, store)) {
+        rv = 2;
+    }
+
+    for (size_t i = 0; i < tree.n_nodes; ++i) {
+        free(tree.nodes[i].name);
+    }
+    free(tree.nodes);
+    free(tree.files);
+    return rv;
+}
+
+static bool open_store(const char *path, Store *store)
+{
+    struct stat st;
+    int         fd = open(path, O_RDONLY | O_CLOEXEC);
+    uint64_t    tables_size;
+
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Could not open \"%s\": %s\n", path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    store->map_size = (size_t)st.st_size;
+    store->map = store->map_size >= sizeof(StoreHeader)
+                     ? mmap(NULL, store->map_size, PROT_READ, MAP_SHARED, fd, 0)
+                     : MAP_FAILED;
+    close(fd);
+    if (store->map == MAP_FAILED) {
+        fprintf(stderr, "\"%s\" is not a tree store\n", path);
+        return false;
+    }
+
+    store->header = store->map;
+    tables_size = store->header->n_dirs * sizeof(StoreDir) + store->header->n_entries * sizeof(StoreEntry);
+    if (memcmp(store->header->magic, MAGIC, sizeof(store->header->magic)) != 0 || store->header->n_dirs == 0 ||
+        store->header->n_dirs > store->map_size / sizeof(StoreDir) ||
+        store->header->n_entries > store->map_size / sizeof(StoreEntry) ||
+        sizeof(StoreHeader) + tables_size + store->header->strings_size != store->map_size) {
+        fprintf(stderr, "\"%s\" is not a tree store\n", path);
+        munmap(store->map, store->map_size);
+        return false;
+    }
+    store->dirs = (const StoreDir *)(const void *)(store->header + 1);
+    store->entries = (const StoreEntry *)(const void *)(store->dirs + store->header->n_dirs);
+    store->strings = (const char *)(store->entries + store->header->n_entries);
+    /* Only the differing subtrees are looked at */
+    madvise(store->map, store->map_size, MADV_RANDOM);
+    return true;
+}
+
+/*!
+ * Order strings by their bytes and then length, as strcmp orders names.
+ */
+static int compare_strings(const char *a, size_t a_size, const char *b, size_t b_size)
+{
+    int order = memcmp(a, b, a_size < b_size ? a_size : b_size);
+
+    return order ? order : (a_size > b_size) - (a_size < b_size);
+}
+
+static bool valid_string(const Store *store, uint64_t offset, uint32_t size)
+{
+    return offset <= store->header->strings_size && size <= store->header->strings_size - offset;
+}
+
+/*!
+ * Binary search of the directories for path.
+ */
+static const StoreDir *find_dir(const Store *store, const char *path, size_t path_size)
+{
+    uint64_t low = 0;
+    uint64_t high = store->header->n_dirs;
+
+    while (low < high) {
+        uint64_t        middle = low + (high - low) / 2;
+        const StoreDir *dir = &store->dirs[middle];
+        int             order;
+
+        if (!valid_string(store, dir->path_offset, dir->path_size)) {
+            return NULL;
+        }
+        order = compare_strings(store->strings + dir->path_offset, dir->path_size, path, path_size);
+        if (order == 0) {
+            return dir->first_entry <= store->header->n_entries &&
+                           dir->n_entries <= store->header->n_entries - dir->first_entry
+                       ? dir
+                       : NULL;
+        } else if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return NULL;
+}
+
+static void print_entry(char change, const char *path, size_t path_size, const Store *store,
+                        const StoreEntry *entry)
+{
+    printf("%c %.*s%s%.*s%s\n", change, (int)path_size, path, path_size ? "/" : "", (int)entry->name_size,
+           store->strings + entry->name_offset, S_ISDIR(entry->mode) ? "/" : "");
+}
+
+/*!
+ * Print the differences between two versions of a directory, recursing into
+ * the subdirectories whose digests differ.
+ * \returns false if a store is damaged
+ */
+static bool diff_dir(const Store *a, const StoreDir *dir_a, const Store *b, const StoreDir *dir_b, char **path,
+                     size_t *path_capacity, size_t path_size)
+{
+    uint64_t i = 0;
+    uint64_t j = 0;
+
+    while (i < dir_a->n_entries || j < dir_b->n_entries) {
+        const StoreEntry *entry_a = i < dir_a->n_entries ? &a->entries[dir_a->first_entry + i] : NULL;
+        const StoreEntry *entry_b = j < dir_b->n_entries ? &b->entries[dir_b->first_entry + j] : NULL;
+        int               order;
+
+        if ((entry_a && !valid_string(a, entry_a->name_offset, entry_a->name_size)) ||
+            (entry_b && !valid_string(b, entry_b->name_offset, entry_b->name_size))) {
+            return false;
+        }
+        if (entry_a == NULL) {
+            order = 1;
+        } else if (entry_b == NULL) {
+            order = -1;
+        } else {
+            order = compare_strings(a->strings + entry_a->name_offset, entry_a->name_size,
+                                    b->strings + entry_b->name_offset, entry_b->name_size);
+        }
+        if (order < 0) {
+            print_entry('-', *path, path_size, a, entry_a);
+            ++i;
+            continue;
+        } else if (order > 0) {
+            print_entry('+', *path, path_size, b, entry_b);
+            ++j;
+            continue;
+        }
+        ++i;
+        ++j;
+        if (memcmp(entry_a->digest, entry_b->digest, DIGEST_SIZE) == 0 && entry_a->mode == entry_b->mode) {
+            continue;
+        }
+
+        if (S_ISDIR(entry_a->mode) && S_ISDIR(entry_b->mode) &&
+            memcmp(entry_a->digest, entry_b->digest, DIGEST_SIZE) != 0) {
+            size_t          child_size = path_size + (path_size ? 1 : 0) + entry_a->name_size;
+            const StoreDir *child_a;
+            const StoreDir *child_b;
+
+            if (child_size + 1 > *path_capacity) {
+                *path_capacity = 2 * (child_size + 1);
+                *path = realloc(*path, *path_capacity);
+            }
+            if (path_size) {
+                (*path)[path_size] = '/';
+            }
+            memcpy(*path + child_size - entry_a->name_size, a->strings + entry_a->name_offset, entry_a->name_size);
+            child_a = find_dir(a, *path, child_size);
+            child_b = find_dir(b, *path, child_size);
+            if (child_a == NULL || child_b == NULL || !diff_dir(a, child_a, b, child_b, path, path_capacity,
+                                                                 child_size)) {
+                return false;
+            }
+            /* Only the mode of the directory itself may differ too */
+            if (entry_a->mode == entry_b->mode) {
+                continue;
+            }
+        }
+        print_entry('M', *path, path_size, b, entry_b);
+    }
+    return true;
+}
+
+int merkle_diff(const char *store_a, const char *store_b)
+{
+    Store           a, b;
+    const StoreDir *root_a;
+    const StoreDir *root_b;
+    char           *path;
+    size_t          path_capacity = 256;
+    bool            ok;
+    bool            same;
+
+    if (!open_store(store_a, &a)) {
+        return 2;
+    }
+    if (!open_store(store_b, &b)) {
+        munmap(a.map, a.map_size);
+        return 2;
+    }
+
+    path = malloc(path_capacity);
+    root_a = find_dir(&a, "", 0);
+    root_b = find_dir(&b, "", 0);
+    ok = root_a && root_b;
+    same = ok && memcmp(root_a->digest, root_b->digest, DIGEST_SIZE) == 0;
+    if (ok && !same) {
+        ok = diff_dir(&a, root_a, &b, root_b, &path, &path_capacity, 0);
+    }
+    if (!ok) {
+        fprintf(stderr, "\"%s\" or \"%s\" is damaged\n", store_a, store_b);
+    }
+
+    free(path);
+    munmap(b.map, b.map_size);
+    munmap(a.map, a.map_size);
+    if (!ok) {
+        return 2;
+    }
+    return same ? 0 : 1;
+}
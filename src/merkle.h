@@ -0,0 +1,50 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - merkle.h
+ *
+ * Merkle digests of directory trees for the command line tool, with a store
+ * of the digest of every directory so that two trees can be compared one
+ * differing subtree at a time.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MERKLE_H
+#define MERKLE_H
+
+/*!
+ * Compute the SHA-256 Merkle digest of a directory tree and print it. A
+ * directory is digested over its entries sorted by name, each as its mode in
+ * octal, a space, its name, a NUL byte and its digest. The digest of a file
+ * is that of its contents and the digest of a symbolic link that of its
+ * target. Other entries have the digest of nothing.
+ * \param path Root directory
+ * \param store File to save the digest of every directory and its entries
+ *        to, NULL for none
+ * \param n_threads Number of files hashed at once
+ * \returns 0 on success, 2 if some file or directory could not be read
+ */
+int merkle_run(const char *path, const char *store, unsigned int n_threads);
+/*!
+ * Print the differences between the trees of two stores, as "+ path" for
+ * entries only in the second, "- path" for entries only in the first and
+ * "M path" for changed entries, descending only into directories whose
+ * digests differ.
+ * \returns 0 if the trees are identical, 1 if they differ or 2 if a store
+ *          could not be read or is damaged
+ */
+int merkle_diff(const char *store_a, const char *store_b);
+
+#endif /* MERKLE_H */
@@ -0,0 +1,453 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - scrub.c
+ *
+ * Throttled background verification of files against stored hashes for the
+ * command line tool.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+#include "scrub.h"
+#include "cichlid_hash.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Small enough for the rate limit to be smooth */
+#define READ_BUFFER_SIZE (256 * 1024)
+#define MAX_ALGORITHMS (32)
+/* Seconds between saves of the progress */
+#define SAVE_INTERVAL (10)
+
+/* From linux/ioprio.h, which older systems lack */
+#define IOPRIO_WHO_PROCESS (1)
+#define IOPRIO_CLASS_IDLE (3)
+#define IOPRIO_CLASS_SHIFT (13)
+
+typedef struct
+{
+    char                       *path;
+    size_t                      n_algorithms;
+    const CichlidHashAlgorithm *algorithms[MAX_ALGORITHMS];
+    char                       *expected[MAX_ALGORITHMS];
+    bool                        unknown;  /* Some label was not recognized */
+} Entry;
+
+typedef struct
+{
+    const ScrubOptions *options;
+    char               *buf;
+    void               *contexts[MAX_ALGORITHMS];
+    /* Token bucket of the rate limit, in bytes */
+    double              tokens;
+    struct timespec     refilled;
+    /* Start of the period the processor share is measured over */
+    struct timespec     wall_start;
+    struct timespec     cpu_start;
+    /* Progress, saved to the state file */
+    intmax_t            manifest_size;
+    intmax_t            manifest_mtime;
+    uintmax_t           pass;
+    intmax_t            offset;
+    time_t              saved;
+} Scrub;
+
+static double seconds_between(const struct timespec *start, const struct timespec *end)
+{
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void sleep_seconds(double seconds)
+{
+    struct timespec duration;
+
+    duration.tv_sec = (time_t)seconds;
+    duration.tv_nsec = (long)((seconds - (double)duration.tv_sec) * 1e9);
+    while (nanosleep(&duration, &duration) < 0 && errno == EINTR) {
+    }
+}
+
+/*!
+ * Take size bytes from the token bucket, sleeping off any debt. The bucket
+ * holds at most one second of reading, so idle time does not build up into
+ * a long burst.
+ */
+static void throttle_io(Scrub *self, size_t size)
+{
+    double          rate = (double)self->options->rate;
+    struct timespec now;
+
+    if (self->options->rate == 0) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    self->tokens += seconds_between(&self->refilled, &now) * rate;
+    if (self->tokens > rate) {
+        self->tokens = rate;
+    }
+    self->refilled = now;
+    self->tokens -= (double)size;
+    if (self->tokens < 0) {
+        sleep_seconds(-self->tokens / rate);
+    }
+}
+
+/*!
+ * Sleep for as long as needed to keep the processor time used since the
+ * start of the pass within the configured share of the time passed.
+ */
+static void throttle_cpu(Scrub *self)
+{
+    struct timespec wall, cpu;
+    double          wanted_wall;
+
+    if (self->options->cpu_percent >= 100) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+    wanted_wall = seconds_between(&self->cpu_start, &cpu) * 100.0 / self->options->cpu_percent;
+    if (wanted_wall > seconds_between(&self->wall_start, &wall)) {
+        sleep_seconds(wanted_wall - seconds_between(&self->wall_start, &wall));
+    }
+}
+
+static void save_state(Scrub *self)
+{
+    char *tmp_path;
+    FILE *fid;
+
+    if (self->options->state == NULL) {
+        return;
+    }
+    tmp_path = malloc(strlen(self->options->state) + 5);
+    sprintf(tmp_path, "%s.tmp", self->options->state);
+    fid = fopen(tmp_path, "w");
+    if (fid == NULL) {
+        fprintf(stderr, "Could not save progress to \"%s\": %s\n", tmp_path, strerror(errno));
+    } else {
+        fprintf(fid, "%jd %jd %ju %jd\n", self->manifest_size, self->manifest_mtime, self->pass, self->offset);
+        /* Replace the old state only once the new one is complete */
+        if (fflush(fid) != 0 || fsync(fileno(fid)) != 0 || fclose(fid) != 0 ||
+            rename(tmp_path, self->options->state) != 0) {
+            fprintf(stderr, "Could not save progress to \"%s\": %s\n", self->options->state, strerror(errno));
+        }
+    }
+    free(tmp_path);
+    self->saved = time(NULL);
+}
+
+/*!
+ * Resume from the saved state if it belongs to the current version of the
+ * manifest.
+ */
+static void load_state(Scrub *self)
+{
+    FILE     *fid;
+    intmax_t  size, mtime, offset;
+    uintmax_t pass;
+
+    if (self->options->state == NULL || (fid = fopen(self->options->state, "r")) == NULL) {
+        return;
+    }
+    if (fscanf(fid, "%jd %jd %ju %jd", &size, &mtime, &pass, &offset) == 4 && size == self->manifest_size &&
+        mtime == self->manifest_mtime && offset >= 0 && offset <= size) {
+        self->pass = pass;
+        self->offset = offset;
+    }
+    fclose(fid);
+}
+
+static const CichlidHashAlgorithm *find_by_label(const char *label)
+{
+    const CichlidHashAlgorithm *algorithm;
+
+    for (size_t i = 0; (algorithm = cichlid_hash_algorithm_get(i)) != NULL; ++i) {
+        if (!strcasecmp(algorithm->label, label)) {
+            return algorithm;
+        }
+    }
+    return NULL;
+}
+
+/*!
+ * Split a "LABEL (path) = hash" line in place.
+ * \returns false if the line is not of that form
+ */
+static bool parse_line(char *line, char **label, char **path, char **hash)
+{
+    char  *open = strstr(line, " (");
+    char  *close;
+    size_t length = strlen(line);
+
+    if (length && line[length - 1] == '\n') {
+        line[--length] = '\0';
+    }
+    if (open == NULL) {
+        return false;
+    }
+    /* The path may contain ") = " itself, the hash does not */
+    for (close = line + length; close > open && strncmp(close, ") = ", 4) != 0; --close) {
+    }
+    if (close == open) {
+        return false;
+    }
+    *open = '\0';
+    *close = '\0';
+    *label = line;
+    *path = open + 2;
+    *hash = close + 4;
+    return true;
+}
+
+static void clear_entry(Entry *entry)
+{
+    free(entry->path);
+    for (size_t i = 0; i < entry->n_algorithms; ++i) {
+        free(entry->expected[i]);
+    }
+    entry->path = NULL;
+    entry->n_algorithms = 0;
+    entry->unknown = false;
+}
+
+/*!
+ * Hash a file within the limits, dropping what was read from the page cache.
+ * \returns true if every hash matched and none was of an unknown algorithm
+ */
+static bool verify(Scrub *self, const Entry *entry, uint64_t *bytes)
+{
+    int   fd;
+    bool  ok = true;
+    off_t offset = 0;
+
+    if (entry->n_algorithms == 0) {
+        /* Only unknown algorithms, there is nothing to read the file for */
+        printf("UNVERIFIED %s: unknown algorithm\n", entry->path);
+        return false;
+    }
+    fd = open(entry->path, O_RDONLY | O_CLOEXEC | O_NOATIME);
+    if (fd < 0 && errno == EPERM) {
+        /* O_NOATIME is only allowed for the owner */
+        fd = open(entry->path, O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        printf("MISSING %s: %s\n", entry->path, strerror(errno));
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    for (size_t i = 0; i < entry->n_algorithms; ++i) {
+        entry->algorithms[i]->init(self->contexts[i]);
+    }
+
+    for (;;) {
+        ssize_t n;
+
+        n = read(fd, self->buf, READ_BUFFER_SIZE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            printf("UNREADABLE %s: %s\n", entry->path, strerror(errno));
+            close(fd);
+            return false;
+        } else if (n == 0) {
+            break;
+        }
+        for (size_t i = 0; i < entry->n_algorithms; ++i) {
+            entry->algorithms[i]->update(self->contexts[i], self->buf, (size_t)n);
+        }
+        posix_fadvise(fd, offset, n, POSIX_FADV_DONTNEED);
+        offset += n;
+        throttle_io(self, (size_t)n);
+        throttle_cpu(self);
+    }
+    close(fd);
+    *bytes += (uint64_t)offset;
+
+    for (size_t i = 0; i < entry->n_algorithms; ++i) {
+        char *hash = entry->algorithms[i]->get_hash(self->contexts[i]);
+        if (strcasecmp(hash, entry->expected[i]) != 0) {
+            printf("FAILED %s: %s is %s, expected %s\n", entry->path, entry->algorithms[i]->label, hash,
+                   entry->expected[i]);
+            ok = false;
+        }
+        free(hash);
+    }
+    if (entry->unknown) {
+        printf("UNVERIFIED %s: unknown algorithm\n", entry->path);
+        ok = false;
+    }
+    return ok;
+}
+
+/*!
+ * Verify the files of the manifest from the saved offset to the end. Lines
+ * for the same path that follow each other are verified with one read.
+ * \param failed Set if some file did not match
+ * \returns false if the manifest could not be read
+ */
+static bool run_pass(Scrub *self, bool *failed)
+{
+    FILE       *fid = fopen(self->options->manifest, "r");
+    Entry       entry = { NULL, 0, { NULL }, { NULL }, false };
+    char       *line = NULL;
+    size_t      line_capacity = 0;
+    uint64_t    n_files = 0, n_failed = 0, bytes = 0;
+    intmax_t    line_offset;
+    bool        done = false;
+    struct stat st;
+
+    if (fid == NULL || fstat(fileno(fid), &st) != 0) {
+        fprintf(stderr, "Could not read \"%s\": %s\n", self->options->manifest, strerror(errno));
+        if (fid) {
+            fclose(fid);
+        }
+        return false;
+    }
+    /* Saved progress is only valid for the manifest it was made for */
+    if ((intmax_t)st.st_size != self->manifest_size || (intmax_t)st.st_mtime != self->manifest_mtime) {
+        self->manifest_size = (intmax_t)st.st_size;
+        self->manifest_mtime = (intmax_t)st.st_mtime;
+        self->offset = 0;
+    }
+    fseeko(fid, (off_t)self->offset, SEEK_SET);
+    clock_gettime(CLOCK_MONOTONIC, &self->wall_start);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &self->cpu_start);
+    self->refilled = self->wall_start;
+    self->tokens = 0;
+
+    while (!done) {
+        char *label, *path, *hash;
+
+        line_offset = (intmax_t)ftello(fid);
+        done = getline(&line, &line_capacity, fid) < 0;
+        if (!done && !parse_line(line, &label, &path, &hash)) {
+            continue;
+        }
+        if (entry.path && (done || strcmp(path, entry.path) != 0)) {
+            ++n_files;
+            n_failed += !verify(self, &entry, &bytes);
+            clear_entry(&entry);
+            /* Everything before this line is done */
+            self->offset = line_offset;
+            if (time(NULL) - self->saved >= SAVE_INTERVAL) {
+                save_state(self);
+            }
+        }
+        if (done) {
+            break;
+        }
+
+        if (entry.path == NULL) {
+            entry.path = strdup(path);
+        }
+        if (entry.n_algorithms == MAX_ALGORITHMS) {
+            continue;
+        }
+        entry.algorithms[entry.n_algorithms] = find_by_label(label);
+        if (entry.algorithms[entry.n_algorithms] == NULL) {
+            fprintf(stderr, "Unknown algorithm \"%s\" for \"%s\"\n", label, path);
+            entry.unknown = true;
+            continue;
+        }
+        entry.expected[entry.n_algorithms++] = strdup(hash);
+    }
+    free(line);
+    fclose(fid);
+
+    printf("Pass %ju: %" PRIu64 " files, %" PRIu64 " bytes, %" PRIu64 " failed\n", self->pass, n_files, bytes,
+           n_failed);
+    fflush(stdout);
+    ++self->pass;
+    self->offset = 0;
+    save_state(self);
+    *failed = n_failed > 0;
+    return true;
+}
+
+static size_t max_context_size(void)
+{
+    const CichlidHashAlgorithm *algorithm;
+    size_t                      size = 0;
+
+    for (size_t i = 0; (algorithm = cichlid_hash_algorithm_get(i)) != NULL; ++i) {
+        if (algorithm->context_size > size) {
+            size = algorithm->context_size;
+        }
+    }
+    return size;
+}
+
+int scrub_run(const ScrubOptions *options)
+{
+    Scrub       self;
+    struct stat st;
+    bool        failed = false;
+    int         rv = 0;
+
+    memset(&self, 0, sizeof(self));
+    self.options = options;
+    if (stat(options->manifest, &st) != 0) {
+        fprintf(stderr, "Could not read \"%s\": %s\n", options->manifest, strerror(errno));
+        return 2;
+    }
+    self.manifest_size = (intmax_t)st.st_size;
+    self.manifest_mtime = (intmax_t)st.st_mtime;
+    load_state(&self);
+
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) != 0) {
+        fprintf(stderr, "Could not set idle I/O priority: %s\n", strerror(errno));
+    }
+
+    self.buf = malloc(READ_BUFFER_SIZE);
+    for (size_t i = 0; i < MAX_ALGORITHMS; ++i) {
+        self.contexts[i] = malloc(max_context_size());
+    }
+
+    for (;;) {
+        struct timespec start, end;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (!run_pass(&self, &failed)) {
+            rv = 2;
+            break;
+        } else if (options->interval == 0) {
+            rv = failed ? 2 : 0;
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (seconds_between(&start, &end) < options->interval) {
+            sleep_seconds(options->interval - seconds_between(&start, &end));
+        }
+    }
+
+    for (size_t i = 0; i < MAX_ALGORITHMS; ++i) {
+        free(self.contexts[i]);
+    }
+    free(self.buf);
+    return rv;
+}
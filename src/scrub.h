@@ -0,0 +1,48 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - scrub.h
+ *
+ * Throttled background verification of files against stored hashes for the
+ * command line tool.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCRUB_H
+#define SCRUB_H
+
+#include <stdint.h>
+
+typedef struct
+{
+    const char  *manifest;    /* "LABEL (path) = hash" lines, as printed by --files-from */
+    const char  *state;       /* Where progress is saved, NULL to always start over */
+    uint64_t     rate;        /* Maximum bytes read per second, 0 for no limit */
+    unsigned int cpu_percent; /* Maximum share of one processor, 1 to 100 */
+    unsigned int interval;    /* Seconds between the start of passes, 0 for one pass */
+} ScrubOptions;
+
+/*!
+ * Verify the files of a manifest at idle I/O priority within the given
+ * limits, printing the files that are missing or do not match. Progress is
+ * saved regularly, and a scrub of the same manifest resumes from it.
+ * \param options Scrub settings
+ * \returns 0 if every file matched, 2 otherwise or if the manifest could not
+ *          be read. Does not return when repeating passes, unless the
+ *          manifest cannot be read.
+ */
+int scrub_run(const ScrubOptions *options);
+
+#endif /* SCRUB_H */
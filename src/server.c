@@ -0,0 +1,316 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - server.c
+ *
+ * Hashing daemon for the command line tool, serving the requests of
+ * cichlid_hash_client on a Unix domain socket.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+#include "server.h"
+#include "cichlid_hash.h"
+#include "cichlid_hash_client.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define READ_BUFFER_SIZE (1024 * 1024)
+#define MAX_ALGORITHMS (32)
+/* Accepted connections waiting for a thread */
+#define MAX_WAITING (1024)
+/* Microseconds to wait before accepting again when out of descriptors */
+#define ACCEPT_RETRY_DELAY (100 * 1000)
+
+typedef struct
+{
+    int             connections[MAX_WAITING];
+    size_t          first;
+    size_t          n_waiting;
+    pthread_mutex_t lock;
+    pthread_cond_t  not_empty;
+    pthread_cond_t  not_full;
+} Server;
+
+typedef struct
+{
+    char *buf;
+    void *contexts[MAX_ALGORITHMS];
+} Worker;
+
+/*!
+ * Receive a request and the file descriptor sent with it.
+ * \returns 1 on success, 0 when the client is done and -1 on errors
+ */
+static int receive_request(int connection, CichlidHashClientRequest *request, int *fd)
+{
+    union
+    {
+        struct cmsghdr header;
+        char           buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct iovec    iov = { request, sizeof(*request) };
+    struct msghdr   message;
+    struct cmsghdr *cmsg;
+    ssize_t         n;
+
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buf;
+    message.msg_controllen = sizeof(control.buf);
+    while ((n = recvmsg(connection, &message, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {
+    }
+    if (n <= 0) {
+        return (int)n;
+    }
+
+    *fd = -1;
+    for (cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+            memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    if ((size_t)n != sizeof(*request) || request->magic != CICHLID_HASH_CLIENT_MAGIC ||
+        (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+        if (*fd >= 0) {
+            close(*fd);
+        }
+        return -1;
+    }
+    return 1;
+}
+
+/*!
+ * Hash the requested range of fd with every requested algorithm.
+ * \returns 0 or an errno value
+ */
+static int hash_range(Worker *worker, CichlidHashClientRequest *request, int fd,
+                      CichlidHashClientResponse *response)
+{
+    const CichlidHashAlgorithm *algorithms[MAX_ALGORITHMS];
+    size_t                      n_algorithms = 0;
+    char                       *save_ptr = NULL;
+    uint64_t                    offset = request->offset;
+    uint64_t                    left = request->size;
+    size_t                      length = 0;
+
+    request->algorithms[sizeof(request->algorithms) - 1] = '\0';
+    for (char *name = strtok_r(request->algorithms, ",", &save_ptr); name; name = strtok_r(NULL, ",", &save_ptr)) {
+        if (n_algorithms == MAX_ALGORITHMS || (algorithms[n_algorithms] = cichlid_hash_algorithm_find(name)) == NULL) {
+            return EINVAL;
+        }
+        algorithms[n_algorithms]->init(worker->contexts[n_algorithms]);
+        ++n_algorithms;
+    }
+    if (fd < 0) {
+        return EBADF;
+    }
+
+    while (left > 0) {
+        size_t  size = left < READ_BUFFER_SIZE ? (size_t)left : READ_BUFFER_SIZE;
+        ssize_t n = pread(fd, worker->buf, size, (off_t)offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        } else if (n == 0) {
+            /* A range to the end of the file ends here, others are too long */
+            if (request->size != CICHLID_HASH_CLIENT_TO_END) {
+                return EINVAL;
+            }
+            break;
+        }
+        for (size_t i = 0; i < n_algorithms; ++i) {
+            algorithms[i]->update(worker->contexts[i], worker->buf, (size_t)n);
+        }
+        offset += (uint64_t)n;
+        left -= (uint64_t)n;
+    }
+
+    for (size_t i = 0; i < n_algorithms; ++i) {
+        char *hash = algorithms[i]->get_hash(worker->contexts[i]);
+        length += (size_t)snprintf(response->hashes + length, sizeof(response->hashes) - length, "%s%s",
+                                   i ? " " : "", hash);
+        free(hash);
+    }
+    return 0;
+}
+
+static void serve(Worker *worker, int connection)
+{
+    CichlidHashClientRequest  request;
+    CichlidHashClientResponse response;
+    int                       fd;
+
+    while (receive_request(connection, &request, &fd) > 0) {
+        memset(&response, 0, sizeof(response));
+        response.error = hash_range(worker, &request, fd, &response);
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (send(connection, &response, sizeof(response), MSG_NOSIGNAL) < 0) {
+            break;
+        }
+    }
+    close(connection);
+}
+
+static size_t max_context_size(void)
+{
+    const CichlidHashAlgorithm *algorithm;
+    size_t                      size = 0;
+
+    for (size_t i = 0; (algorithm = cichlid_hash_algorithm_get(i)) != NULL; ++i) {
+        if (algorithm->context_size > size) {
+            size = algorithm->context_size;
+        }
+    }
+    return size;
+}
+
+static void *worker_run(void *arg)
+{
+    Server *server = arg;
+    Worker  worker;
+
+    worker.buf = malloc(READ_BUFFER_SIZE);
+    for (size_t i = 0; i < MAX_ALGORITHMS; ++i) {
+        worker.contexts[i] = malloc(max_context_size());
+    }
+
+    for (;;) {
+        int connection;
+
+        pthread_mutex_lock(&server->lock);
+        while (server->n_waiting == 0) {
+            pthread_cond_wait(&server->not_empty, &server->lock);
+        }
+        connection = server->connections[server->first];
+        server->first = (server->first + 1) % MAX_WAITING;
+        --server->n_waiting;
+        pthread_cond_signal(&server->not_full);
+        pthread_mutex_unlock(&server->lock);
+
+        serve(&worker, connection);
+    }
+    return NULL;
+}
+
+/*!
+ * Bind the socket, replacing a socket file left behind by a daemon that is
+ * no longer running.
+ */
+static int listen_on(const char *path)
+{
+    struct sockaddr_un address;
+    int                listener;
+    mode_t             mask;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path \"%s\" is too long\n", path);
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    listener = cichlid_hash_client_connect(path);
+    if (listener >= 0) {
+        fprintf(stderr, "A daemon is already listening on \"%s\"\n", path);
+        close(listener);
+        return -1;
+    } else if (errno == ECONNREFUSED) {
+        unlink(path);
+    }
+
+    listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    /* Only the owner may connect */
+    mask = umask(0077);
+    if (listener < 0 || bind(listener, (const struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0) {
+        fprintf(stderr, "Could not listen on \"%s\": %s\n", path, strerror(errno));
+        umask(mask);
+        if (listener >= 0) {
+            close(listener);
+        }
+        return -1;
+    }
+    umask(mask);
+    return listener;
+}
+
+int server_run(const char *path, unsigned int n_threads)
+{
+    Server *server;
+    char   *default_path = NULL;
+    int     listener;
+
+    if (path == NULL && (path = default_path = cichlid_hash_client_default_path()) == NULL) {
+        fprintf(stderr, "Could not create a private socket directory: %s\n", strerror(errno));
+        return 2;
+    }
+    listener = listen_on(path);
+    free(default_path);
+    if (listener < 0) {
+        return 2;
+    }
+
+    server = calloc(1, sizeof(*server));
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->not_empty, NULL);
+    pthread_cond_init(&server->not_full, NULL);
+    for (unsigned int i = 0; i < n_threads; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker_run, server) == 0) {
+            pthread_detach(thread);
+        }
+    }
+
+    for (;;) {
+        int connection = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+        if (connection < 0) {
+            if (errno != EINTR && errno != ECONNABORTED && errno != EMFILE && errno != ENFILE) {
+                fprintf(stderr, "Could not accept connections: %s\n", strerror(errno));
+                break;
+            } else if (errno == EMFILE || errno == ENFILE) {
+                /* Wait for connections to be closed rather than spinning */
+                usleep(ACCEPT_RETRY_DELAY);
+            }
+            continue;
+        }
+        pthread_mutex_lock(&server->lock);
+        while (server->n_waiting == MAX_WAITING) {
+            pthread_cond_wait(&server->not_full, &server->lock);
+        }
+        server->connections[(server->first + server->n_waiting) % MAX_WAITING] = connection;
+        ++server->n_waiting;
+        pthread_cond_signal(&server->not_empty);
+        pthread_mutex_unlock(&server->lock);
+    }
+    close(listener);
+    return 2;
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - server.h
+ *
+ * Hashing daemon for the command line tool, serving the requests of
+ * cichlid_hash_client on a Unix domain socket.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+/*!
+ * Listen on a socket and hash the files passed by clients on a pool of
+ * threads, until the process is killed.
+ * \param path Socket path, NULL for the default of cichlid_hash_client
+ * \param n_threads Number of connections served at once
+ * \returns 2 if the socket could not be set up
+ */
+int server_run(const char *path, unsigned int n_threads);
+
+#endif /* SERVER_H */
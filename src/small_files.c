@@ -0,0 +1,350 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - small_files.c
+ *
+ * Reading of many small files at once through io_uring for the command line
+ * tool.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+#include "small_files.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* Operations per file, in user_data order */
+enum
+{
+    OP_OPEN,
+    OP_STATX,
+    OP_READ,
+    OP_CLOSE,
+    N_OPS
+};
+
+struct SmallFiles_
+{
+    int                  ring_fd;
+    size_t               max_files;
+    char                *buffers;     /* SMALL_FILES_MAX_SIZE per file */
+    int                 *open_results;
+    int                 *read_results;
+    int                 *statx_results;
+    struct statx        *statx_buffers; /* Sizes, to tell a short read from the end */
+    bool                 broken;      /* A batch was cut short, the ring is unusable */
+
+    void                *sq_ring;
+    size_t               sq_ring_size;
+    void                *cq_ring;
+    size_t               cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t               sqes_size;
+    unsigned int        *sq_tail;
+    unsigned int        *sq_mask;
+    unsigned int        *sq_array;
+    unsigned int        *cq_head;
+    unsigned int        *cq_tail;
+    unsigned int        *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+static int io_uring_setup(unsigned int entries, struct io_uring_params *params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned int opcode, const void *arg, unsigned int n_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, n_args);
+}
+
+static bool map_rings(SmallFiles *self, const struct io_uring_params *params)
+{
+    self->sq_ring_size = params->sq_off.array + params->sq_entries * sizeof(unsigned int);
+    self->cq_ring_size = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+    if (params->features & IORING_FEAT_SINGLE_MMAP) {
+        if (self->cq_ring_size > self->sq_ring_size) {
+            self->sq_ring_size = self->cq_ring_size;
+        }
+        self->cq_ring_size = 0;
+    }
+
+    self->sq_ring = mmap(NULL, self->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         self->ring_fd, IORING_OFF_SQ_RING);
+    if (self->sq_ring == MAP_FAILED) {
+        self->sq_ring = NULL;
+        return false;
+    }
+    if (self->cq_ring_size) {
+        self->cq_ring = mmap(NULL, self->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             self->ring_fd, IORING_OFF_CQ_RING);
+        if (self->cq_ring == MAP_FAILED) {
+            self->cq_ring = NULL;
+            return false;
+        }
+    } else {
+        self->cq_ring = self->sq_ring;
+    }
+    self->sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+    self->sqes = mmap(NULL, self->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      self->ring_fd, IORING_OFF_SQES);
+    if (self->sqes == MAP_FAILED) {
+        self->sqes = NULL;
+        return false;
+    }
+
+    self->sq_tail = (unsigned int *)((char *)self->sq_ring + params->sq_off.tail);
+    self->sq_mask = (unsigned int *)((char *)self->sq_ring + params->sq_off.ring_mask);
+    self->sq_array = (unsigned int *)((char *)self->sq_ring + params->sq_off.array);
+    self->cq_head = (unsigned int *)((char *)self->cq_ring + params->cq_off.head);
+    self->cq_tail = (unsigned int *)((char *)self->cq_ring + params->cq_off.tail);
+    self->cq_mask = (unsigned int *)((char *)self->cq_ring + params->cq_off.ring_mask);
+    self->cqes = (struct io_uring_cqe *)((char *)self->cq_ring + params->cq_off.cqes);
+    return true;
+}
+
+SmallFiles *small_files_new(size_t max_files)
+{
+    SmallFiles            *self = calloc(1, sizeof(*self));
+    struct io_uring_params params;
+    int                   *slots;
+    bool                   ok;
+
+    if (self == NULL || max_files == 0 || max_files > 4096 / N_OPS) {
+        free(self);
+        return NULL;
+    }
+    memset(&params, 0, sizeof(params));
+    self->ring_fd = io_uring_setup((unsigned int)(max_files * N_OPS), &params);
+    if (self->ring_fd < 0) {
+        free(self);
+        return NULL;
+    }
+    ok = map_rings(self, &params);
+
+    /* Files are opened into a table of direct descriptors, one slot per file
+     * of a batch, so that the read and close linked to an open can refer to
+     * its file before it exists */
+    slots = malloc(sizeof(*slots) * max_files);
+    for (size_t i = 0; i < max_files; ++i) {
+        slots[i] = -1;
+    }
+    ok = ok && io_uring_register(self->ring_fd, IORING_REGISTER_FILES, slots, (unsigned int)max_files) == 0;
+    free(slots);
+
+    self->max_files = max_files;
+    self->buffers = malloc(max_files * SMALL_FILES_MAX_SIZE);
+    self->open_results = malloc(sizeof(*self->open_results) * max_files);
+    self->read_results = malloc(sizeof(*self->read_results) * max_files);
+    self->statx_results = malloc(sizeof(*self->statx_results) * max_files);
+    self->statx_buffers = malloc(sizeof(*self->statx_buffers) * max_files);
+    if (!ok || self->buffers == NULL || self->open_results == NULL || self->read_results == NULL ||
+        self->statx_results == NULL || self->statx_buffers == NULL) {
+        small_files_free(self);
+        return NULL;
+    }
+    return self;
+}
+
+void small_files_free(SmallFiles *self)
+{
+    if (self->sqes) {
+        munmap(self->sqes, self->sqes_size);
+    }
+    if (self->cq_ring && self->cq_ring != self->sq_ring) {
+        munmap(self->cq_ring, self->cq_ring_size);
+    }
+    if (self->sq_ring) {
+        munmap(self->sq_ring, self->sq_ring_size);
+    }
+    close(self->ring_fd);
+    free(self->buffers);
+    free(self->open_results);
+    free(self->read_results);
+    free(self->statx_results);
+    free(self->statx_buffers);
+    free(self);
+}
+
+static void prepare(struct io_uring_sqe *sqe, uint8_t opcode, uint8_t flags, uint64_t user_data)
+{
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->flags = flags;
+    sqe->user_data = user_data;
+}
+
+/*!
+ * Queue open, statx, read and close of file i, using direct descriptor slot
+ * i. Hard links keep the chain going when the read comes up short, which it
+ * does for every file smaller than the buffer, so the close always runs.
+ */
+static void queue_file(SmallFiles *self, const SmallFile *file, size_t i)
+{
+    unsigned int         tail = *self->sq_tail;
+    struct io_uring_sqe *sqe;
+
+    for (unsigned int op = 0; op < N_OPS; ++op) {
+        unsigned int index = (tail + op) & *self->sq_mask;
+        sqe = &self->sqes[index];
+        self->sq_array[index] = index;
+        prepare(sqe, 0, 0, i * N_OPS + op);
+        switch (op) {
+        case OP_OPEN:
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->flags = IOSQE_IO_HARDLINK;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uint64_t)(uintptr_t)file->path;
+            sqe->open_flags = O_RDONLY;
+            sqe->file_index = (uint32_t)i + 1;
+            break;
+        case OP_STATX:
+            /* By path as the open, statx does not take fixed files */
+            sqe->opcode = IORING_OP_STATX;
+            sqe->flags = IOSQE_IO_HARDLINK;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uint64_t)(uintptr_t)file->path;
+            sqe->len = STATX_TYPE | STATX_SIZE;
+            sqe->off = (uint64_t)(uintptr_t)&self->statx_buffers[i];
+            break;
+        case OP_READ:
+            sqe->opcode = IORING_OP_READ;
+            sqe->flags = IOSQE_IO_HARDLINK | IOSQE_FIXED_FILE;
+            sqe->fd = (int)i;
+            sqe->addr = (uint64_t)(uintptr_t)(self->buffers + i * SMALL_FILES_MAX_SIZE);
+            sqe->len = SMALL_FILES_MAX_SIZE;
+            sqe->off = 0;
+            break;
+        default:
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->file_index = (uint32_t)i + 1;
+            break;
+        }
+    }
+    __atomic_store_n(self->sq_tail, tail + N_OPS, __ATOMIC_RELEASE);
+}
+
+/*!
+ * Collect the results of the operations in the completion queue.
+ * \returns The number of completions seen
+ */
+static unsigned int reap(SmallFiles *self)
+{
+    unsigned int head = *self->cq_head;
+    unsigned int tail = __atomic_load_n(self->cq_tail, __ATOMIC_ACQUIRE);
+    unsigned int n = 0;
+
+    for (; head != tail; ++head, ++n) {
+        const struct io_uring_cqe *cqe = &self->cqes[head & *self->cq_mask];
+        size_t                     i = (size_t)(cqe->user_data / N_OPS);
+
+        if (cqe->user_data % N_OPS == OP_OPEN) {
+            self->open_results[i] = cqe->res;
+        } else if (cqe->user_data % N_OPS == OP_STATX) {
+            self->statx_results[i] = cqe->res;
+        } else if (cqe->user_data % N_OPS == OP_READ) {
+            self->read_results[i] = cqe->res;
+        }
+    }
+    __atomic_store_n(self->cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+bool small_files_read(SmallFiles *self, SmallFile *files, size_t n_files)
+{
+    unsigned int n_ops = (unsigned int)(n_files * N_OPS);
+    unsigned int n_submitted = 0;
+    unsigned int n_completed = 0;
+    int          error = 0;
+
+    if (self->broken || n_files > self->max_files) {
+        return false;
+    }
+    for (size_t i = 0; i < n_files; ++i) {
+        self->open_results[i] = -ECANCELED;
+        self->statx_results[i] = -ECANCELED;
+        self->read_results[i] = -ECANCELED;
+        queue_file(self, &files[i], i);
+    }
+
+    while (n_submitted < n_ops) {
+        int rv = io_uring_enter(self->ring_fd, n_ops - n_submitted, 0, 0);
+        if (rv < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = errno;
+            break;
+        }
+        n_submitted += (unsigned int)rv;
+    }
+    if (n_submitted == 0) {
+        /* Take the operations back off the queue */
+        __atomic_store_n(self->sq_tail, *self->sq_tail - n_ops, __ATOMIC_RELEASE);
+        return false;
+    } else if (n_submitted < n_ops) {
+        self->broken = true;
+    }
+
+    while ((n_completed += reap(self)) < n_submitted) {
+        if (io_uring_enter(self->ring_fd, 0, n_submitted - n_completed, IORING_ENTER_GETEVENTS) < 0 &&
+            errno != EINTR) {
+            self->broken = true;
+            error = errno;
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < n_files; ++i) {
+        SmallFile          *file = &files[i];
+        int                 open_result = self->open_results[i];
+        int                 read_result = self->read_results[i];
+        const struct statx *stx = &self->statx_buffers[i];
+
+        file->data = self->buffers + i * SMALL_FILES_MAX_SIZE;
+        file->size = 0;
+        file->complete = false;
+        if (open_result == -ECANCELED && error) {
+            file->error = error;
+        } else if (open_result < 0) {
+            file->error = -open_result;
+        } else if (read_result < 0) {
+            file->error = -read_result;
+        } else {
+            file->error = 0;
+            file->size = (size_t)read_result;
+            /* A read may come up short before the end of the file, so only
+             * a regular file read to its full size is complete */
+            file->complete = self->statx_results[i] == 0 && S_ISREG(stx->stx_mode) &&
+                             stx->stx_size == file->size && file->size < SMALL_FILES_MAX_SIZE;
+        }
+    }
+    return true;
+}
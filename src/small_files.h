@@ -0,0 +1,61 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - small_files.h
+ *
+ * Reading of many small files at once through io_uring for the command line
+ * tool.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SMALL_FILES_H
+#define SMALL_FILES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Files of this size or larger are only partially read */
+#define SMALL_FILES_MAX_SIZE (64 * 1024)
+
+typedef struct SmallFiles_ SmallFiles;
+
+typedef struct
+{
+    const char *path;
+    const char *data;     /* Contents, valid until the next batch */
+    size_t      size;
+    int         error;    /* errno of a failed open or read, or 0 */
+    bool        complete; /* False if the file did not fit in the buffer */
+} SmallFile;
+
+/*!
+ * Set up an io_uring for reading batches of files.
+ * \param max_files Maximum number of files per batch
+ * \returns The reader or NULL if io_uring is not available
+ */
+SmallFiles *small_files_new(size_t max_files);
+void small_files_free(SmallFiles *self);
+/*!
+ * Open, read and close a batch of files with a chain of linked operations
+ * per file, all submitted with a single system call.
+ * \param self Reader instance
+ * \param files Files to read, path is set by the caller and the rest on return
+ * \param n_files Number of files, at most max_files
+ * \returns false if the batch could not be submitted, in which case the
+ *          files have to be read some other way
+ */
+bool small_files_read(SmallFiles *self, SmallFile *files, size_t n_files);
+
+#endif /* SMALL_FILES_H */
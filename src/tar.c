@@ -0,0 +1,826 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - tar.c
+ *
+ * Hashing of the members of tar archives as they are read, for the command
+ * line tool.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tar.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define READ_BUFFER_SIZE (1024 * 1024)
+#define BLOCK_SIZE (512)
+#define MAX_ALGORITHMS (32)
+/* Largest pax or GNU long name header that is read */
+#define MAX_EXTENDED_SIZE (1024 * 1024)
+
+/* Fields of a ustar header block */
+#define NAME_OFFSET     (0)
+#define NAME_SIZE       (100)
+#define SIZE_OFFSET     (124)
+#define SIZE_SIZE       (12)
+#define CHKSUM_OFFSET   (148)
+#define CHKSUM_SIZE     (8)
+#define TYPEFLAG_OFFSET (156)
+#define MAGIC_OFFSET    (257)
+#define PREFIX_OFFSET   (345)
+#define PREFIX_SIZE     (155)
+/* Sparse map of old GNU sparse headers, entries of an offset and a size,
+ * continued in extension blocks while the isextended flag is set */
+#define GNU_SPARSE_OFFSET        (386)
+#define GNU_SPARSE_ENTRIES       (4)
+#define GNU_ISEXTENDED_OFFSET    (482)
+#define GNU_REALSIZE_OFFSET      (483)
+#define SPARSE_ENTRY_SIZE        (24)
+#define SPARSE_ENTRIES           (21)
+#define SPARSE_ISEXTENDED_OFFSET (504)
+
+typedef struct
+{
+    int      fd;
+    char    *buf;
+    size_t   start;  /* Unconsumed data is buf[start, end) */
+    size_t   end;
+    uint64_t offset; /* Archive offset of buf[start] */
+    int      error;  /* errno of a failed read */
+} Reader;
+
+/* Data region of a sparse member */
+typedef struct
+{
+    uint64_t offset;
+    uint64_t size;
+} Region;
+
+typedef struct
+{
+    Region  *regions;
+    size_t   n_regions;
+    size_t   capacity;
+    uint64_t real_size;
+    bool     has_real_size;
+    bool     invalid;       /* Some entry could not be parsed */
+} SparseMap;
+
+/* Name and size of the next member, from pax and GNU extension headers */
+typedef struct
+{
+    char     *path;
+    char     *sparse_name;       /* Real name of a pax sparse member */
+    uint64_t  size;
+    bool      has_size;
+    bool      sparse;
+    SparseMap map;
+    uint64_t  sparse_offset;     /* GNU.sparse.offset waiting for its numbytes */
+    bool      has_sparse_offset;
+    uint64_t  sparse_major;      /* 1 if the map is stored in the member data */
+} Extended;
+
+typedef void (*Consume)(void *user_data, const char *data, size_t data_size);
+
+/*!
+ * \returns The number of bytes available, 0 at the end of the archive or on
+ *          errors
+ */
+static size_t fill(Reader *reader)
+{
+    if (reader->start == reader->end) {
+        ssize_t n;
+        while ((n = read(reader->fd, reader->buf, READ_BUFFER_SIZE)) < 0 && errno == EINTR) {
+        }
+        if (n < 0) {
+            reader->error = errno;
+            n = 0;
+        }
+        reader->start = 0;
+        reader->end = (size_t)n;
+    }
+    return reader->end - reader->start;
+}
+
+/*!
+ * Pass the next size bytes to consume, in pieces as they are read, or skip
+ * them if consume is NULL.
+ * \returns false if the archive ended first
+ */
+static bool read_data(Reader *reader, uint64_t size, Consume consume, void *user_data)
+{
+    while (size > 0) {
+        size_t available = fill(reader);
+        size_t n = size < available ? (size_t)size : available;
+        if (n == 0) {
+            return false;
+        }
+        if (consume) {
+            consume(user_data, reader->buf + reader->start, n);
+        }
+        reader->start += n;
+        reader->offset += n;
+        size -= n;
+    }
+    return true;
+}
+
+static void copy_data(void *user_data, const char *data, size_t data_size)
+{
+    char **p = user_data;
+
+    memcpy(*p, data, data_size);
+    *p += data_size;
+}
+
+static bool read_block(Reader *reader, char block[BLOCK_SIZE])
+{
+    char *p = block;
+
+    return read_data(reader, BLOCK_SIZE, copy_data, &p);
+}
+
+/*!
+ * Skip the padding after size bytes of member data.
+ */
+static bool skip_padding(Reader *reader, uint64_t size)
+{
+    return read_data(reader, (BLOCK_SIZE - size % BLOCK_SIZE) % BLOCK_SIZE, NULL, NULL);
+}
+
+/*!
+ * Parse a numeric field, octal or, as GNU tar writes large values, base-256
+ * with the high bit of the first byte set.
+ * \returns false if the field is not a number
+ */
+static bool parse_number(const char *field, size_t size, uint64_t *value)
+{
+    size_t i = 0;
+
+    *value = 0;
+    if ((unsigned char)field[0] & 0x80) {
+        for (; i < size; ++i) {
+            unsigned char c = (unsigned char)(i ? field[i] : field[i] & 0x7f);
+            /* Negative or wider than 64 bits */
+            if (c && i + 8 < size) {
+                return false;
+            }
+            *value = (*value << 8) | c;
+        }
+        return true;
+    }
+
+    while (i < size && field[i] == ' ') {
+        ++i;
+    }
+    if (i == size || field[i] < '0' || field[i] > '7') {
+        return false;
+    }
+    for (; i < size && field[i] >= '0' && field[i] <= '7'; ++i) {
+        if (*value >> 61) {
+            return false;
+        }
+        *value = (*value << 3) | (uint64_t)(field[i] - '0');
+    }
+    return i == size || field[i] == ' ' || field[i] == '\0';
+}
+
+static bool is_zero_block(const char block[BLOCK_SIZE])
+{
+    for (int i = 0; i < BLOCK_SIZE; ++i) {
+        if (block[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*!
+ * Check the header checksum, which old tar implementations computed over
+ * signed chars.
+ */
+static bool check_header(const char block[BLOCK_SIZE])
+{
+    uint64_t stored;
+    int64_t  sum = 0;
+    uint64_t usum = 0;
+
+    if (!parse_number(block + CHKSUM_OFFSET, CHKSUM_SIZE, &stored)) {
+        return false;
+    }
+    for (int i = 0; i < BLOCK_SIZE; ++i) {
+        char c = i >= CHKSUM_OFFSET && i < CHKSUM_OFFSET + CHKSUM_SIZE ? ' ' : block[i];
+        usum += (unsigned char)c;
+        sum += (signed char)c;
+    }
+    return stored == usum || (int64_t)stored == sum;
+}
+
+/*!
+ * \returns false if value is not a decimal number
+ */
+static bool parse_decimal(const char *value, uint64_t *result)
+{
+    char *end;
+
+    if (*value < '0' || *value > '9') {
+        return false;
+    }
+    errno = 0;
+    *result = strtoull(value, &end, 10);
+    return *end == '\0' && errno == 0;
+}
+
+static void add_region(SparseMap *map, uint64_t offset, uint64_t size)
+{
+    if (map->n_regions == map->capacity) {
+        size_t  capacity = map->capacity ? 2 * map->capacity : 16;
+        Region *regions = realloc(map->regions, sizeof(*regions) * capacity);
+        if (regions == NULL) {
+            map->invalid = true;
+            return;
+        }
+        map->regions = regions;
+        map->capacity = capacity;
+    }
+    map->regions[map->n_regions].offset = offset;
+    map->regions[map->n_regions].size = size;
+    ++map->n_regions;
+}
+
+/*!
+ * Apply a GNU.sparse record of the 0.0, 0.1 and 1.0 pax sparse formats.
+ * \param key Key without the "GNU.sparse." prefix
+ */
+static void parse_pax_sparse(Extended *extended, const char *key, char *value)
+{
+    SparseMap *map = &extended->map;
+    uint64_t   number;
+
+    if (strcmp(key, "name") == 0) {
+        free(extended->sparse_name);
+        extended->sparse_name = strdup(value);
+    } else if (strcmp(key, "size") == 0 || strcmp(key, "realsize") == 0) {
+        map->has_real_size = parse_decimal(value, &map->real_size);
+        map->invalid |= !map->has_real_size;
+    } else if (strcmp(key, "major") == 0) {
+        map->invalid |= !parse_decimal(value, &extended->sparse_major);
+    } else if (strcmp(key, "offset") == 0) {
+        /* 0.0, each region is an offset record followed by a numbytes one */
+        extended->has_sparse_offset = parse_decimal(value, &extended->sparse_offset);
+        map->invalid |= !extended->has_sparse_offset;
+    } else if (strcmp(key, "numbytes") == 0) {
+        if (!extended->has_sparse_offset || !parse_decimal(value, &number)) {
+            map->invalid = true;
+        } else {
+            add_region(map, extended->sparse_offset, number);
+        }
+        extended->has_sparse_offset = false;
+    } else if (strcmp(key, "map") == 0) {
+        /* 0.1, all regions as "offset,size,offset,size..." */
+        char *state;
+        for (char *field = strtok_r(value, ",", &state); field && !map->invalid;
+             field = strtok_r(NULL, ",", &state)) {
+            char    *size_field = strtok_r(NULL, ",", &state);
+            uint64_t size;
+            if (size_field == NULL || !parse_decimal(field, &number) || !parse_decimal(size_field, &size)) {
+                map->invalid = true;
+            } else {
+                add_region(map, number, size);
+            }
+        }
+    }
+}
+
+/*!
+ * Apply the records of a pax extended header, each "length key=value\n".
+ */
+static void parse_pax(Extended *extended, char *data, size_t size)
+{
+    char *end = data + size;
+
+    while (data < end) {
+        char    *record = data;
+        char    *key;
+        char    *value;
+        uint64_t length = 0;
+
+        while (data < end && *data >= '0' && *data <= '9') {
+            length = length * 10 + (uint64_t)(*data++ - '0');
+        }
+        if (data == end || *data != ' ' || length == 0 || length > (uint64_t)(end - record) ||
+            record[length - 1] != '\n') {
+            return;
+        }
+        key = data + 1;
+        record[length - 1] = '\0';
+        data = record + length;
+        if ((value = strchr(key, '=')) == NULL) {
+            continue;
+        }
+        *value++ = '\0';
+
+        if (strcmp(key, "path") == 0) {
+            free(extended->path);
+            extended->path = strdup(value);
+        } else if (strcmp(key, "size") == 0) {
+            extended->has_size = parse_decimal(value, &extended->size);
+        } else if (strncmp(key, "GNU.sparse.", 11) == 0) {
+            parse_pax_sparse(extended, key + 11, value);
+            extended->sparse = true;
+        }
+    }
+}
+
+/*!
+ * Read the data of an extension header into a string.
+ * \returns The data or NULL if the archive ended first
+ */
+static char *read_extended(Reader *reader, uint64_t size)
+{
+    char *data = malloc(size + 1);
+    char *p = data;
+
+    if (!read_data(reader, size, copy_data, &p) || !skip_padding(reader, size)) {
+        free(data);
+        return NULL;
+    }
+    data[size] = '\0';
+    return data;
+}
+
+/*!
+ * Check for the magic numbers of the usual compression formats.
+ */
+static bool is_compressed(const char block[BLOCK_SIZE])
+{
+    static const struct
+    {
+        const char *magic;
+        size_t      size;
+    } formats[] = {
+        { "\x1f\x8b", 2 },                 /* gzip */
+        { "\xfd" "7zXZ\0", 6 },             /* xz */
+        { "BZh", 3 },                       /* bzip2 */
+        { "\x28\xb5\x2f\xfd", 4 },         /* zstd */
+    };
+
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+        if (memcmp(block, formats[i].magic, formats[i].size) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void parse_sparse_entries(SparseMap *map, const char *entries, int n_entries)
+{
+    for (int i = 0; i < n_entries; ++i) {
+        const char *entry = entries + i * SPARSE_ENTRY_SIZE;
+        uint64_t    offset, size;
+
+        /* Unused entries are empty */
+        if (entry[0] == '\0') {
+            break;
+        } else if (!parse_number(entry, 12, &offset) || !parse_number(entry + 12, 12, &size)) {
+            map->invalid = true;
+            break;
+        }
+        add_region(map, offset, size);
+    }
+}
+
+/*!
+ * Read the sparse map of an old GNU sparse header and of the extension blocks
+ * that follow it, which are not counted in the member size.
+ * \returns false if the archive ended first
+ */
+static bool read_gnu_sparse_map(Reader *reader, const char header[BLOCK_SIZE], SparseMap *map)
+{
+    char block[BLOCK_SIZE];
+    bool extended = header[GNU_ISEXTENDED_OFFSET] != 0;
+
+    parse_sparse_entries(map, header + GNU_SPARSE_OFFSET, GNU_SPARSE_ENTRIES);
+    map->has_real_size = parse_number(header + GNU_REALSIZE_OFFSET, 12, &map->real_size);
+    while (extended) {
+        if (!read_block(reader, block)) {
+            return false;
+        }
+        parse_sparse_entries(map, block, SPARSE_ENTRIES);
+        extended = block[SPARSE_ISEXTENDED_OFFSET] != 0;
+    }
+    return true;
+}
+
+/*!
+ * Read one newline terminated number of a sparse map stored in the member
+ * data, a block at a time without reading past size bytes.
+ * \param pos Position in block, BLOCK_SIZE when the next block is due
+ * \param consumed Member data read so far
+ * \returns false if the archive ended first, a malformed number marks the
+ *          map invalid instead
+ */
+static bool read_map_number(Reader *reader, SparseMap *map, char block[BLOCK_SIZE], size_t *pos, uint64_t size,
+                            uint64_t *consumed, uint64_t *value)
+{
+    int n_digits = 0;
+
+    *value = 0;
+    for (;;) {
+        char c;
+
+        if (*pos == BLOCK_SIZE) {
+            if (size - *consumed < BLOCK_SIZE) {
+                map->invalid = true;
+                return true;
+            } else if (!read_block(reader, block)) {
+                return false;
+            }
+            *pos = 0;
+            *consumed += BLOCK_SIZE;
+        }
+        c = block[(*pos)++];
+        if (c == '\n' && n_digits > 0) {
+            return true;
+        } else if (c < '0' || c > '9' || *value > (UINT64_MAX - 9) / 10) {
+            map->invalid = true;
+            return true;
+        }
+        *value = *value * 10 + (uint64_t)(c - '0');
+        ++n_digits;
+    }
+}
+
+/*!
+ * Read the sparse map at the start of the data of a pax 1.0 sparse member,
+ * the number of regions and then the offset and size of each on lines of
+ * their own, padded to a whole block.
+ * \param size Size of the member data
+ * \param consumed Set to the size of the map
+ * \returns false if the archive ended first
+ */
+static bool read_sparse_map_data(Reader *reader, SparseMap *map, uint64_t size, uint64_t *consumed)
+{
+    char     block[BLOCK_SIZE];
+    size_t   pos = BLOCK_SIZE;
+    uint64_t n_regions;
+
+    *consumed = 0;
+    if (!read_map_number(reader, map, block, &pos, size, consumed, &n_regions)) {
+        return false;
+    }
+    for (uint64_t i = 0; i < n_regions && !map->invalid; ++i) {
+        uint64_t offset, region_size;
+        if (!read_map_number(reader, map, block, &pos, size, consumed, &offset) ||
+            !read_map_number(reader, map, block, &pos, size, consumed, &region_size)) {
+            return false;
+        }
+        if (!map->invalid) {
+            add_region(map, offset, region_size);
+        }
+    }
+    return true;
+}
+
+/*!
+ * Check that the regions of a sparse map are in order and fit the data.
+ * \param data_size Size of the member data after any map
+ * \param stored Set to the size of the regions together
+ */
+static bool check_sparse_map(SparseMap *map, uint64_t data_size, uint64_t *stored)
+{
+    uint64_t end = 0;
+
+    *stored = 0;
+    if (map->invalid) {
+        return false;
+    }
+    for (size_t i = 0; i < map->n_regions; ++i) {
+        const Region *region = &map->regions[i];
+        if (region->offset < end || region->size > UINT64_MAX - region->offset ||
+            region->size > data_size - *stored) {
+            return false;
+        }
+        end = region->offset + region->size;
+        *stored += region->size;
+    }
+    if (!map->has_real_size) {
+        map->real_size = end;
+    }
+    return map->real_size >= end;
+}
+
+static void clear_sparse_map(SparseMap *map)
+{
+    map->n_regions = 0;
+    map->real_size = 0;
+    map->has_real_size = false;
+    map->invalid = false;
+}
+
+/*!
+ * \returns The member name of a ustar header, with the prefix of POSIX
+ *          archives
+ */
+static char *header_name(const char block[BLOCK_SIZE])
+{
+    size_t name_size = strnlen(block + NAME_OFFSET, NAME_SIZE);
+    size_t prefix_size = 0;
+    char  *name;
+
+    /* GNU archives use the prefix field for other things */
+    if (memcmp(block + MAGIC_OFFSET, "ustar\0", 6) == 0) {
+        prefix_size = strnlen(block + PREFIX_OFFSET, PREFIX_SIZE);
+    }
+    name = malloc(prefix_size + name_size + 2);
+    if (prefix_size) {
+        memcpy(name, block + PREFIX_OFFSET, prefix_size);
+        name[prefix_size++] = '/';
+    }
+    memcpy(name + prefix_size, block + NAME_OFFSET, name_size);
+    name[prefix_size + name_size] = '\0';
+    return name;
+}
+
+typedef struct
+{
+    const CichlidHashAlgorithm *const *algorithms;
+    size_t                            n_algorithms;
+    unsigned int                      n_threads;
+    void                             *contexts[MAX_ALGORITHMS];
+    char                             *zeros;     /* READ_BUFFER_SIZE zero bytes */
+} Hasher;
+
+static void hash_data(void *user_data, const char *data, size_t data_size)
+{
+    Hasher *hasher = user_data;
+
+    for (size_t i = 0; i < hasher->n_algorithms; ++i) {
+        hasher->algorithms[i]->update(hasher->contexts[i], data, data_size);
+    }
+}
+
+/*!
+ * Hash size zero bytes, directly with the algorithms that support that.
+ */
+static void hash_zeros(Hasher *hasher, uint64_t size)
+{
+    for (size_t i = 0; i < hasher->n_algorithms; ++i) {
+        const CichlidHashAlgorithm *algorithm = hasher->algorithms[i];
+        if (algorithm->update_zeros) {
+            algorithm->update_zeros(hasher->contexts[i], size);
+            continue;
+        }
+        for (uint64_t left = size; left > 0;) {
+            size_t n = left < READ_BUFFER_SIZE ? (size_t)left : READ_BUFFER_SIZE;
+            algorithm->update(hasher->contexts[i], hasher->zeros, n);
+            left -= n;
+        }
+    }
+}
+
+static void start_member(Hasher *hasher)
+{
+    for (size_t i = 0; i < hasher->n_algorithms; ++i) {
+        hasher->algorithms[i]->init(hasher->contexts[i]);
+        if (hasher->algorithms[i]->set_threads) {
+            hasher->algorithms[i]->set_threads(hasher->contexts[i], hasher->n_threads);
+        }
+    }
+}
+
+static void finish_member(Hasher *hasher, const char *name)
+{
+    for (size_t i = 0; i < hasher->n_algorithms; ++i) {
+        char *hash = hasher->algorithms[i]->get_hash(hasher->contexts[i]);
+        printf("%s (%s) = %s\n", hasher->algorithms[i]->label, name, hash);
+        free(hash);
+    }
+}
+
+/*!
+ * Hash a regular file member and print its hashes.
+ * \returns false if the archive ended first
+ */
+static bool hash_member(Reader *reader, Hasher *hasher, const char *name, uint64_t size)
+{
+    start_member(hasher);
+    if (!read_data(reader, size, hash_data, hasher)) {
+        return false;
+    }
+    finish_member(hasher, name);
+    return true;
+}
+
+/*!
+ * Hash a sparse member as the file it was made from, the stored data regions
+ * with the holes between them filled with zeros, and print its hashes. A
+ * member with a damaged map is skipped.
+ * \param header Header of the member, of type 'S' for old GNU sparse members
+ *               and otherwise from a pax archive
+ * \param size Size of the member data
+ * \param skipped Set if the member was skipped
+ * \returns false if the archive ended first
+ */
+static bool hash_sparse_member(Reader *reader, Hasher *hasher, Extended *extended, const char header[BLOCK_SIZE],
+                               const char *name, uint64_t size, bool *skipped)
+{
+    SparseMap *map = &extended->map;
+    uint64_t   consumed = 0;
+    uint64_t   stored;
+    uint64_t   end = 0;
+
+    if (header[TYPEFLAG_OFFSET] == 'S') {
+        if (!read_gnu_sparse_map(reader, header, map)) {
+            return false;
+        }
+    } else if (extended->sparse_major == 1 && !read_sparse_map_data(reader, map, size, &consumed)) {
+        return false;
+    }
+    if (!check_sparse_map(map, size - consumed, &stored)) {
+        fprintf(stderr, "Skipping sparse member \"%s\" with a damaged map\n", name);
+        *skipped = true;
+        return read_data(reader, size - consumed, NULL, NULL);
+    }
+
+    start_member(hasher);
+    for (size_t i = 0; i < map->n_regions; ++i) {
+        hash_zeros(hasher, map->regions[i].offset - end);
+        if (!read_data(reader, map->regions[i].size, hash_data, hasher)) {
+            return false;
+        }
+        end = map->regions[i].offset + map->regions[i].size;
+    }
+    hash_zeros(hasher, map->real_size - end);
+    finish_member(hasher, name);
+    return read_data(reader, size - consumed - stored, NULL, NULL);
+}
+
+/*!
+ * Read the members of the archive until the end marker.
+ * \returns 0 or 2 with the reason printed
+ */
+static int read_archive(Reader *reader, Hasher *hasher, const char *path)
+{
+    Extended extended = { NULL, NULL, 0, false, false, { NULL, 0, 0, 0, false, false }, 0, false, 0 };
+    char     block[BLOCK_SIZE];
+    bool     ok = true;
+    bool     skipped = false;
+    int      rv = 0;
+
+    while ((ok = read_block(reader, block))) {
+        uint64_t header_offset = reader->offset - BLOCK_SIZE;
+        uint64_t size;
+        char     type = block[TYPEFLAG_OFFSET];
+        char    *name;
+
+        /* The archive ends with two zero blocks, but some writers stop
+         * after one */
+        if (is_zero_block(block)) {
+            break;
+        }
+        if (!check_header(block) || !parse_number(block + SIZE_OFFSET, SIZE_SIZE, &size)) {
+            if (header_offset == 0 && is_compressed(block)) {
+                fprintf(stderr, "\"%s\" is compressed, decompress it to stdin\n", path);
+            } else {
+                fprintf(stderr, "\"%s\" has no valid tar header at offset %" PRIu64 "\n", path, header_offset);
+            }
+            rv = 2;
+            break;
+        }
+
+        if (type == 'x' || type == 'L') {
+            /* Extended attributes or the long name of the next member */
+            char *data;
+            if (size > MAX_EXTENDED_SIZE) {
+                if (!(ok = read_data(reader, size, NULL, NULL) && skip_padding(reader, size))) {
+                    break;
+                }
+                continue;
+            } else if ((data = read_extended(reader, size)) == NULL) {
+                ok = false;
+                break;
+            }
+            if (type == 'x') {
+                parse_pax(&extended, data, size);
+            } else {
+                free(extended.path);
+                extended.path = strndup(data, size);
+            }
+            free(data);
+            continue;
+        } else if (type == 'g' || type == 'K') {
+            /* Global attributes and long link names are of no interest */
+            if (!(ok = read_data(reader, size, NULL, NULL) && skip_padding(reader, size))) {
+                break;
+            }
+            continue;
+        }
+
+        if (extended.has_size) {
+            size = extended.size;
+        }
+
+        if (extended.sparse_name) {
+            free(extended.path);
+            extended.path = extended.sparse_name;
+            extended.sparse_name = NULL;
+        }
+        name = extended.path ? extended.path : header_name(block);
+        extended.path = NULL;
+        if (type == 'S' || (extended.sparse && (type == '0' || type == '\0' || type == '7'))) {
+            ok = hash_sparse_member(reader, hasher, &extended, block, name, size, &skipped);
+        } else if (type == '0' || type == '\0' || type == '7') {
+            ok = hash_member(reader, hasher, name, size);
+        } else {
+            /* Directories, links, devices and the like */
+            ok = read_data(reader, size, NULL, NULL);
+        }
+        ok = ok && skip_padding(reader, size);
+        free(name);
+        extended.has_size = false;
+        extended.sparse = false;
+        extended.has_sparse_offset = false;
+        extended.sparse_major = 0;
+        clear_sparse_map(&extended.map);
+        if (!ok) {
+            break;
+        }
+    }
+
+    if (!ok) {
+        if (reader->error) {
+            fprintf(stderr, "Could not read \"%s\": %s\n", path, strerror(reader->error));
+        } else {
+            fprintf(stderr, "\"%s\" ends in the middle of a member\n", path);
+        }
+        rv = 2;
+    } else if (skipped) {
+        /* The hashes printed do not cover the whole archive */
+        rv = 2;
+    }
+    free(extended.map.regions);
+    free(extended.sparse_name);
+    free(extended.path);
+    return rv;
+}
+
+int tar_run(const CichlidHashAlgorithm *const algorithms[], size_t n_algorithms, unsigned int n_threads,
+            const char *path)
+{
+    Reader reader = { STDIN_FILENO, NULL, 0, 0, 0, 0 };
+    Hasher hasher;
+    int    rv;
+
+    if (path && strcmp(path, "-") != 0) {
+        reader.fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (reader.fd < 0) {
+            fprintf(stderr, "Could not read \"%s\": %s\n", path, strerror(errno));
+            return 2;
+        }
+        posix_fadvise(reader.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    } else {
+        path = "stdin";
+    }
+
+    hasher.algorithms = algorithms;
+    hasher.n_algorithms = n_algorithms;
+    hasher.n_threads = n_threads;
+    for (size_t i = 0; i < n_algorithms; ++i) {
+        hasher.contexts[i] = malloc(algorithms[i]->context_size);
+    }
+    hasher.zeros = calloc(1, READ_BUFFER_SIZE);
+    reader.buf = malloc(READ_BUFFER_SIZE);
+
+    rv = read_archive(&reader, &hasher, path);
+
+    free(reader.buf);
+    free(hasher.zeros);
+    for (size_t i = 0; i < n_algorithms; ++i) {
+        free(hasher.contexts[i]);
+    }
+    if (reader.fd != STDIN_FILENO) {
+        close(reader.fd);
+    }
+    return rv;
+}
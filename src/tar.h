@@ -0,0 +1,44 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - tar.h
+ *
+ * Hashing of the members of tar archives as they are read, for the command
+ * line tool.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TAR_H
+#define TAR_H
+
+#include "cichlid_hash.h"
+#include <stddef.h>
+
+/*!
+ * Read a ustar, pax or GNU tar archive in one pass and print one "LABEL
+ * (member) = hash" line per algorithm for each regular file in it, without
+ * extracting anything. Sparse members are hashed as the files they were made
+ * from.
+ * \param algorithms Algorithms to compute
+ * \param n_algorithms Number of algorithms
+ * \param n_threads Threads for algorithms that can split large updates
+ * \param path Archive, NULL or "-" for stdin
+ * \returns 0 on success, 2 if the archive could not be read or is damaged or
+ *          a sparse member was skipped
+ */
+int tar_run(const CichlidHashAlgorithm *const algorithms[], size_t n_algorithms, unsigned int n_threads,
+            const char *path);
+
+#endif /* TAR_H */
@@ -0,0 +1,230 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - tee.c
+ *
+ * Hashing of data passed from stdin to stdout for the command line tool.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+#include "tee.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define READ_BUFFER_SIZE (1024 * 1024)
+
+typedef struct
+{
+    const CichlidHashAlgorithm *const *algorithms;
+    size_t                            n_algorithms;
+    void                            **contexts;
+    char                             *buf;
+} Tee;
+
+static void update(Tee *self, size_t size)
+{
+    for (size_t i = 0; i < self->n_algorithms; ++i) {
+        self->algorithms[i]->update(self->contexts[i], self->buf, size);
+    }
+}
+
+static bool is_pipe(int fd)
+{
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+/*!
+ * Read exactly size bytes from stdin into the buffer, which the caller knows
+ * to be available.
+ */
+static bool read_all(Tee *self, size_t size)
+{
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t n = read(STDIN_FILENO, self->buf + done, size - done);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        done += (size_t)n;
+    }
+    return true;
+}
+
+static bool write_all(const char *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = write(STDOUT_FILENO, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+/*!
+ * Duplicate the contents of the stdin pipe into the stdout pipe in the kernel
+ * and then consume the same bytes from stdin for hashing, so the data is
+ * copied to user space once instead of twice.
+ * \returns 0 on success, 1 if tee is not supported by the pipes and nothing
+ *          has been copied, 2 on errors
+ */
+static int copy_tee(Tee *self)
+{
+    bool started = false;
+
+    for (;;) {
+        ssize_t n = tee(STDIN_FILENO, STDOUT_FILENO, READ_BUFFER_SIZE, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return !started && errno == EINVAL ? 1 : 2;
+        } else if (n == 0) {
+            return 0;
+        }
+        started = true;
+        if (!read_all(self, (size_t)n)) {
+            return 2;
+        }
+        update(self, (size_t)n);
+    }
+}
+
+/*!
+ * Read stdin, which is a regular file, for hashing and then splice the same
+ * range from the page cache into the stdout pipe instead of writing the
+ * buffer back to the kernel.
+ * \returns 0 on success, 1 if splice is not supported and nothing has been
+ *          copied, 2 on errors
+ */
+static int copy_splice(Tee *self)
+{
+    bool started = false;
+
+    for (;;) {
+        loff_t  offset = lseek(STDIN_FILENO, 0, SEEK_CUR);
+        ssize_t n = read(STDIN_FILENO, self->buf, READ_BUFFER_SIZE);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 2;
+        } else if (n == 0) {
+            return 0;
+        }
+        update(self, (size_t)n);
+
+        for (size_t left = (size_t)n; left > 0;) {
+            ssize_t m = splice(STDIN_FILENO, &offset, STDOUT_FILENO, NULL, left, SPLICE_F_MORE);
+            if (m <= 0) {
+                if (m < 0 && errno == EINTR) {
+                    continue;
+                } else if (!started && left == (size_t)n && m < 0 && errno == EINVAL) {
+                    /* Write the first buffer as usual and report the fallback */
+                    return write_all(self->buf, (size_t)n) ? 1 : 2;
+                } else if (m < 0) {
+                    return 2;
+                }
+                /* The file was truncated after reading, pass on what was hashed */
+                if (!write_all(self->buf + (size_t)n - left, left)) {
+                    return 2;
+                }
+                m = (ssize_t)left;
+            }
+            left -= (size_t)m;
+        }
+        started = true;
+    }
+}
+
+static int copy_read_write(Tee *self)
+{
+    for (;;) {
+        ssize_t n = read(STDIN_FILENO, self->buf, READ_BUFFER_SIZE);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 2;
+        } else if (n == 0) {
+            return 0;
+        }
+        update(self, (size_t)n);
+        if (!write_all(self->buf, (size_t)n)) {
+            return 2;
+        }
+    }
+}
+
+int tee_run(const CichlidHashAlgorithm *const algorithms[], size_t n_algorithms, FILE *output)
+{
+    Tee self = { algorithms, n_algorithms, NULL, NULL };
+    int rv = 1;
+
+    self.contexts = malloc(sizeof(*self.contexts) * (n_algorithms ? n_algorithms : 1));
+    self.buf = malloc(READ_BUFFER_SIZE);
+    for (size_t i = 0; i < n_algorithms; ++i) {
+        self.contexts[i] = malloc(algorithms[i]->context_size);
+        algorithms[i]->init(self.contexts[i]);
+    }
+
+    if (is_pipe(STDOUT_FILENO)) {
+        struct stat st;
+        /* Best effort, a larger pipe means fewer tee and splice calls */
+        fcntl(STDOUT_FILENO, F_SETPIPE_SZ, READ_BUFFER_SIZE);
+        if (is_pipe(STDIN_FILENO)) {
+            rv = copy_tee(&self);
+        } else if (fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode)) {
+            rv = copy_splice(&self);
+        }
+    }
+    if (rv == 1) {
+        rv = copy_read_write(&self);
+    }
+
+    if (rv == 0) {
+        fprintf(output, "Hashes of stdin\n");
+    } else {
+        fprintf(stderr, "Could not copy stdin to stdout: %s\n", strerror(errno));
+    }
+    for (size_t i = 0; i < n_algorithms; ++i) {
+        if (rv == 0) {
+            char *hash_string = algorithms[i]->get_hash(self.contexts[i]);
+            fprintf(output, "%10s: %s\n", algorithms[i]->label, hash_string);
+            free(hash_string);
+        }
+        free(self.contexts[i]);
+    }
+    free(self.contexts);
+    free(self.buf);
+    return rv;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright © 2015 Erik Cederberg <erikced@gmail.com>
+ *
+ * cichlid - tee.h
+ *
+ * Hashing of data passed from stdin to stdout for the command line tool.
+ *
+ * cichlid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * cichlid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with cichlid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEE_H
+#define TEE_H
+
+#include "cichlid_hash.h"
+#include <stddef.h>
+#include <stdio.h>
+
+/*!
+ * Copy stdin to stdout unchanged until end of file while hashing the data, and
+ * print the hashes when done.
+ * \param algorithms Algorithms to compute
+ * \param n_algorithms Number of algorithms
+ * \param output Where the hashes are printed
+ * \returns 0 on success, 2 if reading or writing failed
+ */
+int tee_run(const CichlidHashAlgorithm *const algorithms[], size_t n_algorithms, FILE *output);
+
+#endif /* TEE_H */